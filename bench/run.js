@@ -0,0 +1,408 @@
+'use strict';
+
+// Measures the throughput and latency of attach, openFile, clone and
+// start/stop at several concurrency levels.
+//
+// Usage: node bench/run.js [options]
+//
+//   --backend stub|real  liblxc to run against (default: stub)
+//   --container <name>   container to use (real backend, required)
+//   --path <path>        LXC path (real backend)
+//   --duration <ms>      time per scenario and concurrency (default: 3000)
+//   --concurrency <n,..> concurrency levels (default: 1,4,16,64)
+//   --only <name,..>     scenarios to run (default: attach,open,clone,start)
+//   --destructive        allow clone and start with the real backend
+//   --json               print the results as JSON
+//
+// The stub backend replaces liblxc with bench/stub/lxc.c, which only keeps
+// track of container states and forks in the current namespaces on attach,
+// so that the overhead of the binding can be measured without privileges.
+//
+// With the real backend, attach and open need a running container. clone and
+// start create and destroy clones of the container, which must be stopped,
+// and are only run with --destructive.
+
+var childProcess = require('child_process');
+var fs = require('fs');
+var pathModule = require('path');
+
+var BUILD_DIR = pathModule.join(__dirname, 'build');
+var STUB_SOURCE = pathModule.join(__dirname, 'stub', 'lxc.c');
+var STUB_LIBRARY = pathModule.join(BUILD_DIR, 'liblxc.so.1');
+
+var SCENARIOS = ['attach', 'open', 'clone', 'start'];
+
+function parseArgs(argv) {
+  var options = {
+    backend: 'stub',
+    container: 'bench',
+    path: '',
+    duration: 3000,
+    concurrency: [1, 4, 16, 64],
+    only: SCENARIOS,
+    destructive: false,
+    json: false
+  };
+
+  for (var i = 0; i < argv.length; i++) {
+    var arg = argv[i];
+
+    switch (arg) {
+      case '--backend':
+      case '--container':
+      case '--path':
+        options[arg.slice(2)] = argv[++i];
+        break;
+      case '--duration':
+        options.duration = parseInt(argv[++i]);
+        break;
+      case '--concurrency':
+        options.concurrency = argv[++i].split(',').map(Number);
+        break;
+      case '--only':
+        options.only = argv[++i].split(',');
+        break;
+      case '--destructive':
+      case '--json':
+        options[arg.slice(2)] = true;
+        break;
+      default:
+        throw new Error('Unknown argument: ' + arg);
+    }
+  }
+
+  if (options.backend !== 'stub' && options.backend !== 'real') {
+    throw new Error('backend must be stub or real');
+  }
+
+  return options;
+}
+
+// Builds the stub library and runs this script again with the stub in front
+// of the real liblxc. Returns false if this already is the second run.
+function relaunchWithStub() {
+  if (process.env.SOURCEBOX_LXC_STUB) {
+    return false;
+  }
+
+  var stale = !fs.existsSync(STUB_LIBRARY) ||
+    fs.statSync(STUB_LIBRARY).mtime < fs.statSync(STUB_SOURCE).mtime;
+
+  if (stale) {
+    try {
+      fs.mkdirSync(BUILD_DIR);
+    } catch (err) {
+      if (err.code !== 'EEXIST') {
+        throw err;
+      }
+    }
+
+    childProcess.execFileSync(process.env.CC || 'cc', [
+      '-std=gnu99', '-O2', '-shared', '-fPIC',
+      '-Wl,-soname,liblxc.so.1',
+      '-o', STUB_LIBRARY, STUB_SOURCE, '-lpthread'
+    ], {stdio: 'inherit'});
+  }
+
+  var env = Object.create(process.env);
+  env.SOURCEBOX_LXC_STUB = '1';
+  env.LD_LIBRARY_PATH = BUILD_DIR +
+    (process.env.LD_LIBRARY_PATH ? ':' + process.env.LD_LIBRARY_PATH : '');
+
+  var child = childProcess.spawn(process.execPath, process.argv.slice(1), {
+    env: env,
+    stdio: 'inherit'
+  });
+
+  child.on('exit', function (code, signal) {
+    process.exit(signal ? 1 : code);
+  });
+
+  return true;
+}
+
+// Scenarios, every loop gets its own context from setup()
+
+var scenarios = {
+  attach: {
+    op: function (context, callback) {
+      var child = context.container.attach('true');
+
+      child.on('error', callback);
+      child.on('close', function (code) {
+        callback(code === 0 ? null : new Error('attach exited with ' + code));
+      });
+    }
+  },
+
+  open: {
+    op: function (context, callback) {
+      context.container.openFile('/etc/hostname', 'r', function (err, fd) {
+        if (err) {
+          return callback(err);
+        }
+
+        fs.close(fd, callback);
+      });
+    }
+  },
+
+  clone: {
+    destructive: true,
+    setup: function (context, callback) {
+      context.count = 0;
+      callback();
+    },
+    op: function (context, callback) {
+      var name = context.prefix + '-' + context.count++;
+
+      context.container.clone(name, function (err, clone) {
+        if (err) {
+          return callback(err);
+        }
+
+        clone.destroy(callback);
+      });
+    }
+  },
+
+  start: {
+    destructive: true,
+    setup: function (context, callback) {
+      context.container.clone(context.prefix, function (err, clone) {
+        context.clone = clone;
+        callback(err);
+      });
+    },
+    op: function (context, callback) {
+      context.clone.start('sleep', ['infinity'], {init: 'lxc-init'}, function (err) {
+        if (err) {
+          return callback(err);
+        }
+
+        context.clone.stop(callback);
+      });
+    },
+    teardown: function (context, callback) {
+      context.clone.destroy(callback);
+    }
+  }
+};
+
+function percentile(sorted, q) {
+  if (sorted.length === 0) {
+    return 0;
+  }
+
+  return sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))];
+}
+
+function series(items, fn, callback) {
+  var results = [];
+
+  var next = function (i) {
+    if (i === items.length) {
+      return callback(null, results);
+    }
+
+    fn(items[i], function (err, result) {
+      if (err) {
+        return callback(err);
+      }
+
+      results.push(result);
+      next(i + 1);
+    });
+  };
+
+  next(0);
+}
+
+function parallel(count, fn, callback) {
+  var pending = count;
+  var failed = false;
+
+  if (count === 0) {
+    return callback(null);
+  }
+
+  for (var i = 0; i < count; i++) {
+    fn(i, function (err) {
+      if (failed) {
+        return;
+      }
+
+      if (err) {
+        failed = true;
+        return callback(err);
+      }
+
+      if (--pending === 0) {
+        callback(null);
+      }
+    });
+  }
+}
+
+function run(scenario, name, container, concurrency, duration, callback) {
+  var contexts = [];
+  var latencies = [];
+  var noop = function (context, callback) {
+    callback();
+  };
+
+  for (var i = 0; i < concurrency; i++) {
+    contexts.push({
+      container: container,
+      prefix: 'bench-' + name + '-' + process.pid + '-' + concurrency + '-' + i
+    });
+  }
+
+  parallel(concurrency, function (i, callback) {
+    (scenario.setup || noop)(contexts[i], callback);
+  }, function (err) {
+    if (err) {
+      return callback(err);
+    }
+
+    var start = Date.now();
+
+    var loop = function (context, callback) {
+      if (Date.now() - start >= duration) {
+        return callback();
+      }
+
+      var time = process.hrtime();
+
+      scenario.op(context, function (err) {
+        if (err) {
+          return callback(err);
+        }
+
+        var diff = process.hrtime(time);
+        latencies.push(diff[0] * 1e3 + diff[1] / 1e6);
+
+        // do not grow the stack when the callback was synchronous
+        setImmediate(loop, context, callback);
+      });
+    };
+
+    parallel(concurrency, function (i, callback) {
+      loop(contexts[i], callback);
+    }, function (err) {
+      var elapsed = Date.now() - start;
+
+      parallel(concurrency, function (i, callback) {
+        (scenario.teardown || noop)(contexts[i], callback);
+      }, function (teardownErr) {
+        if (err || teardownErr) {
+          return callback(err || teardownErr);
+        }
+
+        latencies.sort(function (a, b) {
+          return a - b;
+        });
+
+        callback(null, {
+          scenario: name,
+          concurrency: concurrency,
+          ops: latencies.length,
+          opsPerSec: latencies.length / (elapsed / 1e3),
+          p50: percentile(latencies, 0.5),
+          p99: percentile(latencies, 0.99)
+        });
+      });
+    });
+  });
+}
+
+function pad(value, width) {
+  value = String(value);
+  return new Array(Math.max(0, width - value.length) + 1).join(' ') + value;
+}
+
+function main() {
+  var options = parseArgs(process.argv.slice(2));
+
+  if (options.backend === 'stub' && relaunchWithStub()) {
+    return;
+  }
+
+  var lxc = require('..');
+
+  var names = options.only.filter(function (name) {
+    if (!scenarios[name]) {
+      throw new Error('Unknown scenario: ' + name);
+    }
+
+    return options.backend === 'stub' || options.destructive ||
+      !scenarios[name].destructive;
+  });
+
+  lxc.getContainer(options.container, {path: options.path}, function (err, container) {
+    if (err) {
+      throw err;
+    }
+
+    var prepare = function (callback) {
+      // the stub's containers are stopped until started, but attach and open
+      // need a running one
+      if (options.backend !== 'stub') {
+        return callback();
+      }
+
+      container.start('sleep', ['infinity'], callback);
+    };
+
+    prepare(function (err) {
+      if (err) {
+        throw err;
+      }
+
+      var runs = [];
+
+      names.forEach(function (name) {
+        options.concurrency.forEach(function (concurrency) {
+          runs.push({name: name, concurrency: concurrency});
+        });
+      });
+
+      series(runs, function (item, callback) {
+        run(scenarios[item.name], item.name, container, item.concurrency,
+            options.duration, function (err, result) {
+          if (err) {
+            return callback(err);
+          }
+
+          if (!options.json) {
+            console.log(pad(result.scenario, 8) +
+                        '  c=' + pad(result.concurrency, 3) +
+                        '  ops/s=' + pad(result.opsPerSec.toFixed(1), 9) +
+                        '  p50=' + pad(result.p50.toFixed(2), 8) + 'ms' +
+                        '  p99=' + pad(result.p99.toFixed(2), 8) + 'ms');
+          }
+
+          callback(null, result);
+        });
+      }, function (err, results) {
+        if (err) {
+          throw err;
+        }
+
+        if (options.json) {
+          console.log(JSON.stringify({
+            backend: options.backend,
+            version: lxc.version,
+            results: results
+          }, null, 2));
+        }
+
+        if (options.backend === 'stub') {
+          container.stop(function () {});
+        }
+      });
+    });
+  });
+}
+
+main();
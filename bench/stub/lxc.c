@@ -0,0 +1,522 @@
+/*
+ * Stand-in for liblxc, used by the benchmarks to measure the overhead of the
+ * binding itself. Containers only exist as entries in an in-memory table:
+ * every name is a defined, stopped container until it is destroyed, start()
+ * and stop() only flip its state and attach() forks a child in the current
+ * namespaces.
+ *
+ * Built as liblxc.so.1 and picked up through LD_LIBRARY_PATH instead of the
+ * real library, see bench/run.js.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <lxc/lxccontainer.h>
+#include <lxc/attach_options.h>
+
+#define MAX_ITEMS 64
+
+struct item {
+    char *key;
+    char *value;
+};
+
+struct entry {
+    char *name;
+    char *path;
+    bool destroyed;
+    bool running;
+    struct item items[MAX_ITEMS];
+    int count;
+    struct entry *next;
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+static struct entry *entries;
+
+static const char *default_path(const char *path) {
+    return path ? path : "/var/lib/lxc";
+}
+
+/* must be called with the lock held */
+static struct entry *lookup(const char *name, const char *path) {
+    struct entry *e;
+
+    for (e = entries; e; e = e->next) {
+        if (strcmp(e->name, name) == 0 && strcmp(e->path, path) == 0) {
+            return e;
+        }
+    }
+
+    e = calloc(1, sizeof(*e));
+    e->name = strdup(name);
+    e->path = strdup(path);
+    e->next = entries;
+    entries = e;
+
+    return e;
+}
+
+static struct entry *entry_of(struct lxc_container *c) {
+    return lookup(c->name, c->config_path);
+}
+
+static struct item *find_item(struct entry *e, const char *key) {
+    int i;
+
+    for (i = 0; i < e->count; i++) {
+        if (strcmp(e->items[i].key, key) == 0) {
+            return &e->items[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int copy_result(const char *value, char *retv, int inlen) {
+    int len = strlen(value);
+
+    if (retv && inlen > 0) {
+        snprintf(retv, inlen, "%s", value);
+    }
+
+    return len;
+}
+
+static bool stub_is_defined(struct lxc_container *c) {
+    bool ret;
+
+    pthread_mutex_lock(&lock);
+    ret = !entry_of(c)->destroyed;
+    pthread_mutex_unlock(&lock);
+
+    return ret;
+}
+
+static bool stub_is_running(struct lxc_container *c) {
+    bool ret;
+
+    pthread_mutex_lock(&lock);
+    ret = entry_of(c)->running;
+    pthread_mutex_unlock(&lock);
+
+    return ret;
+}
+
+static const char *stub_state(struct lxc_container *c) {
+    return stub_is_running(c) ? "RUNNING" : "STOPPED";
+}
+
+static pid_t stub_init_pid(struct lxc_container *c) {
+    /* paths below /proc/<pid>/root resolve on the host */
+    return stub_is_running(c) ? getpid() : -1;
+}
+
+static bool stub_may_control(struct lxc_container *c) {
+    return true;
+}
+
+static bool set_running(struct lxc_container *c, bool running) {
+    pthread_mutex_lock(&lock);
+    entry_of(c)->running = running;
+    pthread_cond_broadcast(&changed);
+    pthread_mutex_unlock(&lock);
+
+    return true;
+}
+
+static bool stub_start(struct lxc_container *c, int useinit, char * const argv[]) {
+    return stub_is_defined(c) && set_running(c, true);
+}
+
+static bool stub_stop(struct lxc_container *c) {
+    return set_running(c, false);
+}
+
+static bool stub_shutdown(struct lxc_container *c, int timeout) {
+    return set_running(c, false);
+}
+
+static bool stub_want_daemonize(struct lxc_container *c, bool state) {
+    c->daemonize = state;
+    return true;
+}
+
+static bool stub_wait(struct lxc_container *c, const char *state, int timeout) {
+    struct timespec deadline;
+    bool ret;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout;
+
+    pthread_mutex_lock(&lock);
+
+    for (;;) {
+        const char *current = entry_of(c)->running ? "RUNNING" : "STOPPED";
+
+        ret = strstr(state, current) != NULL;
+
+        if (ret || timeout == 0 || (timeout > 0 &&
+                pthread_cond_timedwait(&changed, &lock, &deadline) == ETIMEDOUT)) {
+            break;
+        }
+
+        if (timeout < 0) {
+            pthread_cond_wait(&changed, &lock);
+        }
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return ret;
+}
+
+static bool stub_create(struct lxc_container *c, const char *t, const char *bdevtype,
+        struct bdev_specs *specs, int flags, char *const argv[]) {
+    pthread_mutex_lock(&lock);
+    entry_of(c)->destroyed = false;
+    pthread_mutex_unlock(&lock);
+
+    return true;
+}
+
+static bool stub_destroy(struct lxc_container *c) {
+    struct entry *e;
+    bool ret;
+    int i;
+
+    pthread_mutex_lock(&lock);
+
+    e = entry_of(c);
+    ret = !e->running && !e->destroyed;
+
+    if (ret) {
+        e->destroyed = true;
+
+        for (i = 0; i < e->count; i++) {
+            free(e->items[i].key);
+            free(e->items[i].value);
+        }
+
+        e->count = 0;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return ret;
+}
+
+static struct lxc_container *stub_clone(struct lxc_container *c, const char *newname,
+        const char *lxcpath, int flags, const char *bdevtype, const char *bdevdata,
+        uint64_t newsize, char **hookargs) {
+    struct entry *from, *to;
+    int i;
+
+    lxcpath = default_path(lxcpath ? lxcpath : c->config_path);
+
+    pthread_mutex_lock(&lock);
+
+    from = entry_of(c);
+    to = lookup(newname, lxcpath);
+
+    to->destroyed = false;
+    to->running = false;
+
+    for (i = 0; i < from->count; i++) {
+        if (!find_item(to, from->items[i].key)) {
+            to->items[to->count].key = strdup(from->items[i].key);
+            to->items[to->count].value = strdup(from->items[i].value);
+            to->count++;
+        }
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return lxc_container_new(newname, lxcpath);
+}
+
+static bool stub_load_config(struct lxc_container *c, const char *alt_file) {
+    return true;
+}
+
+static bool stub_save_config(struct lxc_container *c, const char *alt_file) {
+    return true;
+}
+
+static bool stub_set_config_item(struct lxc_container *c, const char *key,
+        const char *value) {
+    struct entry *e;
+    struct item *item;
+    bool ret = true;
+
+    pthread_mutex_lock(&lock);
+
+    e = entry_of(c);
+    item = find_item(e, key);
+
+    if (item) {
+        free(item->value);
+        item->value = strdup(value);
+    } else if (e->count < MAX_ITEMS) {
+        e->items[e->count].key = strdup(key);
+        e->items[e->count].value = strdup(value);
+        e->count++;
+    } else {
+        ret = false;
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return ret;
+}
+
+static bool stub_clear_config_item(struct lxc_container *c, const char *key) {
+    struct entry *e;
+    struct item *item;
+
+    pthread_mutex_lock(&lock);
+
+    e = entry_of(c);
+    item = find_item(e, key);
+
+    if (item) {
+        free(item->key);
+        free(item->value);
+        *item = e->items[--e->count];
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return true;
+}
+
+static int stub_get_config_item(struct lxc_container *c, const char *key,
+        char *retv, int inlen) {
+    struct item *item;
+    int ret = -1;
+
+    pthread_mutex_lock(&lock);
+
+    item = find_item(entry_of(c), key);
+
+    if (item) {
+        ret = copy_result(item->value, retv, inlen);
+    } else if (strcmp(key, "lxc.rootfs.path") == 0 || strcmp(key, "lxc.rootfs") == 0) {
+        char rootfs[4096];
+        snprintf(rootfs, sizeof(rootfs), "dir:%s/%s/rootfs", c->config_path, c->name);
+        ret = copy_result(rootfs, retv, inlen);
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return ret;
+}
+
+static char *stub_get_running_config_item(struct lxc_container *c, const char *key) {
+    return NULL;
+}
+
+static int stub_get_keys(struct lxc_container *c, const char *key, char *retv, int inlen) {
+    return copy_result("", retv, inlen);
+}
+
+static char **stub_get_ips(struct lxc_container *c, const char *interface,
+        const char *family, int scope) {
+    return calloc(1, sizeof(char *));
+}
+
+static int stub_get_cgroup_item(struct lxc_container *c, const char *subsys,
+        char *retv, int inlen) {
+    return -1;
+}
+
+static bool stub_set_cgroup_item(struct lxc_container *c, const char *subsys,
+        const char *value) {
+    return true;
+}
+
+static int stub_attach(struct lxc_container *c, lxc_attach_exec_t exec_function,
+        void *exec_payload, lxc_attach_options_t *options, pid_t *attached_process) {
+    pid_t pid;
+
+    if (!stub_is_running(c)) {
+        return -1;
+    }
+
+    pid = fork();
+
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (pid == 0) {
+        if (options->stdin_fd >= 0 && options->stdin_fd != 0) {
+            dup2(options->stdin_fd, 0);
+        }
+
+        if (options->stdout_fd >= 0 && options->stdout_fd != 1) {
+            dup2(options->stdout_fd, 1);
+        }
+
+        if (options->stderr_fd >= 0 && options->stderr_fd != 2) {
+            dup2(options->stderr_fd, 2);
+        }
+
+        if (options->initial_cwd && chdir(options->initial_cwd) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+
+        if (options->env_policy == LXC_ATTACH_CLEAR_ENV) {
+            char **env;
+
+            clearenv();
+
+            for (env = options->extra_env_vars; env && *env; env++) {
+                putenv(*env);
+            }
+        }
+
+        _exit(exec_function(exec_payload));
+    }
+
+    *attached_process = pid;
+
+    return 0;
+}
+
+int lxc_attach_run_command(void *payload) {
+    lxc_attach_command_t *command = payload;
+
+    execvp(command->program, command->argv);
+
+    return -1;
+}
+
+struct lxc_container *lxc_container_new(const char *name, const char *configpath) {
+    struct lxc_container *c = calloc(1, sizeof(*c));
+
+    c->name = strdup(name);
+    c->config_path = strdup(default_path(configpath));
+    c->numthreads = 1;
+
+    c->is_defined = stub_is_defined;
+    c->is_running = stub_is_running;
+    c->state = stub_state;
+    c->init_pid = stub_init_pid;
+    c->may_control = stub_may_control;
+    c->start = stub_start;
+    c->stop = stub_stop;
+    c->shutdown = stub_shutdown;
+    c->want_daemonize = stub_want_daemonize;
+    c->wait = stub_wait;
+    c->create = stub_create;
+    c->destroy = stub_destroy;
+    c->clone = stub_clone;
+    c->load_config = stub_load_config;
+    c->save_config = stub_save_config;
+    c->set_config_item = stub_set_config_item;
+    c->clear_config_item = stub_clear_config_item;
+    c->get_config_item = stub_get_config_item;
+    c->get_running_config_item = stub_get_running_config_item;
+    c->get_keys = stub_get_keys;
+    c->get_ips = stub_get_ips;
+    c->get_cgroup_item = stub_get_cgroup_item;
+    c->set_cgroup_item = stub_set_cgroup_item;
+    c->attach = stub_attach;
+
+    return c;
+}
+
+int lxc_container_get(struct lxc_container *c) {
+    __atomic_add_fetch(&c->numthreads, 1, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+int lxc_container_put(struct lxc_container *c) {
+    if (!c) {
+        return -1;
+    }
+
+    if (__atomic_sub_fetch(&c->numthreads, 1, __ATOMIC_SEQ_CST) > 0) {
+        return 0;
+    }
+
+    free(c->name);
+    free(c->config_path);
+    free(c);
+
+    return 1;
+}
+
+const char *lxc_get_version(void) {
+    return "stub";
+}
+
+const char *lxc_get_global_config_item(const char *key) {
+    return strcmp(key, "lxc.lxcpath") == 0 ? default_path(NULL) : NULL;
+}
+
+static int list(const char *lxcpath, char ***names, struct lxc_container ***cret,
+        bool active, bool defined) {
+    struct entry *e;
+    int count = 0;
+
+    lxcpath = default_path(lxcpath);
+
+    if (names) {
+        *names = NULL;
+    }
+
+    if (cret) {
+        *cret = NULL;
+    }
+
+    pthread_mutex_lock(&lock);
+
+    for (e = entries; e; e = e->next) {
+        if (strcmp(e->path, lxcpath) != 0 || e->destroyed) {
+            continue;
+        }
+
+        if ((active && e->running) || defined) {
+            count++;
+
+            if (names) {
+                *names = realloc(*names, count * sizeof(char *));
+                (*names)[count - 1] = strdup(e->name);
+            }
+
+            if (cret) {
+                *cret = realloc(*cret, count * sizeof(struct lxc_container *));
+                (*cret)[count - 1] = lxc_container_new(e->name, lxcpath);
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&lock);
+
+    return count;
+}
+
+int list_defined_containers(const char *lxcpath, char ***names,
+        struct lxc_container ***cret) {
+    return list(lxcpath, names, cret, false, true);
+}
+
+int list_active_containers(const char *lxcpath, char ***names,
+        struct lxc_container ***cret) {
+    return list(lxcpath, names, cret, true, false);
+}
+
+int list_all_containers(const char *lxcpath, char ***names,
+        struct lxc_container ***cret) {
+    return list(lxcpath, names, cret, true, true);
+}
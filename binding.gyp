@@ -5,13 +5,27 @@
       "src/lxc.cc",
       "src/async.cc",
       "src/get.cc",
+      "src/list.cc",
       "src/create.cc",
       "src/destroy.cc",
       "src/clone.cc",
       "src/config.cc",
       "src/start.cc",
       "src/stop.cc",
-      "src/attach.cc"
+      "src/attach.cc",
+      "src/profile.cc",
+      "src/bulk.cc",
+      "src/exec.cc",
+      "src/scheduler.cc",
+      "src/pressure.cc",
+      "src/metrics.cc",
+      "src/placement.cc",
+      "src/cgroup.cc",
+      "src/sampler.cc",
+      "src/watch.cc",
+      "src/shm.cc",
+      "src/memory.cc",
+      "src/supervise.cc"
     ],
     "libraries": [
       "-lutil",
@@ -23,7 +37,25 @@
       "-Wpedantic"
     ],
     "include_dirs": [
-      "<!(node -e \"require('nan')\")"
+      "<!(node -e \"require('nan')\")",
+      "include"
+    ]
+  }, {
+    "target_name": "sourcebox-supervisor",
+    "type": "executable",
+    "sources": [
+      "src/supervisor.cc"
+    ],
+    "libraries": [
+      "-lutil",
+      "-llxc"
+    ],
+    "cflags": [
+      "-std=c++11",
+      "-Wpedantic"
+    ],
+    "include_dirs": [
+      "include"
     ]
   }]
 }
@@ -0,0 +1,92 @@
+'use strict';
+
+// Compares the time it takes to start a container with its full init system
+// to starting it as an application container with lxc-init.
+//
+// Usage: node examples/start-benchmark.js <container> [path] [runs]
+//
+// The container must exist and be stopped. Every run starts the container,
+// waits for the start callback and stops it again.
+
+var lxc = require('..');
+
+var name = process.argv[2];
+var path = process.argv[3] || '';
+var runs = parseInt(process.argv[4]) || 10;
+
+// start() must return even though `sleep` never exits
+var TIMEOUT = 60 * 1000;
+
+if (!name) {
+  console.error('usage: start-benchmark.js <container> [path] [runs]');
+  process.exit(1);
+}
+
+function measure(container, mode, options, runsLeft, times, callback) {
+  if (runsLeft === 0) {
+    return callback(null, times);
+  }
+
+  var timeout = setTimeout(function () {
+    callback(new Error(mode + ': start did not return within ' + TIMEOUT + 'ms'));
+  }, TIMEOUT);
+
+  var start = process.hrtime();
+
+  container.start('sleep', ['infinity'], options, function (err) {
+    clearTimeout(timeout);
+
+    if (err) {
+      return callback(err);
+    }
+
+    var diff = process.hrtime(start);
+    times.push(diff[0] * 1e3 + diff[1] / 1e6);
+
+    container.stop(function (err) {
+      if (err) {
+        return callback(err);
+      }
+
+      measure(container, mode, options, runsLeft - 1, times, callback);
+    });
+  });
+}
+
+function report(mode, times) {
+  times.sort(function (a, b) {
+    return a - b;
+  });
+
+  var sum = times.reduce(function (a, b) {
+    return a + b;
+  }, 0);
+
+  console.log('%s: mean %sms, median %sms, min %sms, max %sms (%d runs)', mode,
+              (sum / times.length).toFixed(1),
+              times[Math.floor(times.length / 2)].toFixed(1),
+              times[0].toFixed(1), times[times.length - 1].toFixed(1),
+              times.length);
+}
+
+lxc(name, {path: path}, function (err, container) {
+  if (err) {
+    return console.error(err.message);
+  }
+
+  measure(container, 'init system', {}, runs, [], function (err, times) {
+    if (err) {
+      return console.error(err.message);
+    }
+
+    report('init system', times);
+
+    measure(container, 'lxc-init', {init: 'lxc-init'}, runs, [], function (err, times) {
+      if (err) {
+        return console.error(err.message);
+      }
+
+      report('lxc-init', times);
+    });
+  });
+});
@@ -0,0 +1,184 @@
+/*
+ * Producer side of the shared memory channel of sourcebox-lxc.
+ *
+ * A process attached with the `shm` option inherits a ring buffer (a memfd)
+ * and two eventfds. Their fd numbers are passed in the environment variables
+ * SOURCEBOX_SHM_FD, SOURCEBOX_SHM_DATA_FD and SOURCEBOX_SHM_SPACE_FD.
+ *
+ *     struct sourcebox_ring ring;
+ *
+ *     if (sourcebox_ring_open(&ring) == 0) {
+ *         sourcebox_ring_write(&ring, data, length);
+ *         sourcebox_ring_close(&ring);
+ *     }
+ *
+ * Every write is delivered as one message. A message may be at most half the
+ * size of the ring minus 8 bytes, writes block while the ring is full. There
+ * must only be one writer at a time.
+ *
+ * Needs GCC or Clang for the __atomic builtins.
+ */
+
+#ifndef SOURCEBOX_SHM_RING_H
+#define SOURCEBOX_SHM_RING_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SOURCEBOX_RING_MAGIC 0x53425247u /* "SBRG" */
+#define SOURCEBOX_RING_VERSION 1
+#define SOURCEBOX_RING_HEADER_SIZE 256
+
+/* Length of a record that skips the rest of the ring */
+#define SOURCEBOX_RING_PAD 0xffffffffu
+
+/*
+ * Lives at the start of the memfd, the data follows at
+ * SOURCEBOX_RING_HEADER_SIZE. head and tail count the bytes ever written and
+ * consumed, their position in the ring is the count modulo the capacity.
+ * Records are a 32 bit length followed by the payload, padded to 8 bytes.
+ */
+struct sourcebox_ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint32_t closed;
+    uint8_t pad0[44];
+
+    /* written by the producer */
+    uint64_t head;
+    uint8_t pad1[56];
+
+    /* written by the consumer */
+    uint64_t tail;
+    uint8_t pad2[56];
+
+    /* set by the producer before it waits for space */
+    uint32_t producer_waiting;
+    uint8_t pad3[60];
+};
+
+struct sourcebox_ring {
+    struct sourcebox_ring_header *header;
+    unsigned char *data;
+    size_t size;
+    int data_fd;
+    int space_fd;
+};
+
+static inline uint64_t sourcebox_ring_record_size(size_t length) {
+    return (4 + (uint64_t) length + 7) & ~(uint64_t) 7;
+}
+
+static inline int sourcebox_ring_env_fd(const char *name) {
+    const char *value = getenv(name);
+    return value ? atoi(value) : -1;
+}
+
+/* Maps the ring passed by sourcebox-lxc. Returns -1 and sets errno on error. */
+static inline int sourcebox_ring_open(struct sourcebox_ring *ring) {
+    int fd = sourcebox_ring_env_fd("SOURCEBOX_SHM_FD");
+    struct stat st;
+    void *map;
+
+    ring->data_fd = sourcebox_ring_env_fd("SOURCEBOX_SHM_DATA_FD");
+    ring->space_fd = sourcebox_ring_env_fd("SOURCEBOX_SHM_SPACE_FD");
+
+    if (fd < 0 || ring->data_fd < 0 || ring->space_fd < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1) {
+        return -1;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    ring->header = (struct sourcebox_ring_header *) map;
+    ring->data = (unsigned char *) map + SOURCEBOX_RING_HEADER_SIZE;
+    ring->size = st.st_size;
+
+    if (ring->header->magic != SOURCEBOX_RING_MAGIC ||
+            ring->header->version != SOURCEBOX_RING_VERSION) {
+        munmap(map, st.st_size);
+        errno = EPROTO;
+        return -1;
+    }
+
+    return 0;
+}
+
+static inline void sourcebox_ring_signal(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+/* Returns 0 once the message is in the ring, -1 and sets errno on error. */
+static inline int sourcebox_ring_write(struct sourcebox_ring *ring,
+        const void *message, size_t length) {
+    struct sourcebox_ring_header *header = ring->header;
+    uint64_t capacity = header->capacity;
+    uint64_t total = sourcebox_ring_record_size(length);
+    uint64_t head = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+    uint64_t pos = head & (capacity - 1);
+    uint64_t pad = capacity - pos < total ? capacity - pos : 0;
+    uint32_t length32 = (uint32_t) length;
+
+    if (total > capacity / 2) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    while (head + pad + total - __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE) > capacity) {
+        uint64_t value;
+
+        __atomic_store_n(&header->producer_waiting, 1, __ATOMIC_SEQ_CST);
+
+        /* the consumer may have made space before it saw the flag */
+        if (head + pad + total - __atomic_load_n(&header->tail, __ATOMIC_SEQ_CST) <= capacity) {
+            __atomic_store_n(&header->producer_waiting, 0, __ATOMIC_RELAXED);
+            break;
+        }
+
+        if (read(ring->space_fd, &value, sizeof(value)) == -1 && errno != EINTR) {
+            return -1;
+        }
+    }
+
+    if (pad > 0) {
+        uint32_t marker = SOURCEBOX_RING_PAD;
+        memcpy(ring->data + pos, &marker, sizeof(marker));
+        pos = 0;
+    }
+
+    memcpy(ring->data + pos, &length32, sizeof(length32));
+    memcpy(ring->data + pos + 4, message, length);
+
+    __atomic_store_n(&header->head, head + pad + total, __ATOMIC_SEQ_CST);
+
+    /* the consumer only needs a wakeup if it saw the ring empty */
+    if (__atomic_load_n(&header->tail, __ATOMIC_SEQ_CST) == head) {
+        sourcebox_ring_signal(ring->data_fd);
+    }
+
+    return 0;
+}
+
+/* Tells the consumer that no more messages follow and unmaps the ring. */
+static inline void sourcebox_ring_close(struct sourcebox_ring *ring) {
+    __atomic_store_n(&ring->header->closed, 1, __ATOMIC_SEQ_CST);
+    sourcebox_ring_signal(ring->data_fd);
+    munmap(ring->header, ring->size);
+}
+
+#endif
@@ -1,6 +1,7 @@
 'use strict';
 
 var events = require('events');
+var fs = require('fs');
 var net = require('net');
 var util = require('util');
 
@@ -16,7 +17,9 @@ function maybeClose(attachedProcess) {
 }
 
 function flushStdio(attachedProcess) {
-  attachedProcess.stdio.forEach(function (stream) {
+  closeUnusedFds(attachedProcess);
+
+  attachedProcess._streams.forEach(function (stream) {
     if (!stream || !stream.readable || stream._consuming ||
         stream._readableState.flowing) {
       return;
@@ -26,6 +29,85 @@ function flushStdio(attachedProcess) {
   });
 }
 
+// Streams are only created when they are used for the first time
+function getStream(attachedProcess, i) {
+  var streams = attachedProcess._streams;
+  var fd = attachedProcess._fds[i];
+
+  if (streams[i] !== undefined || fd === null || fd === undefined) {
+    return streams[i] || null;
+  }
+
+  var onClose = maybeClose.bind(null, attachedProcess);
+
+  if (attachedProcess._term && i < 3) {
+    // stdin, stdout and stderr share the terminal
+    var tty = new TTYStream(fd);
+
+    streams[0] = streams[1] = streams[2] = tty;
+    tty.on('close', onClose);
+    tty.on('close', onClose);
+
+    return tty;
+  }
+
+  var stream = new net.Socket({
+    fd: fd,
+    readable: i > 0,
+    writable: i === 0 || i > 2
+  });
+
+  if (i > 0) {
+    stream.on('close', onClose);
+  }
+
+  streams[i] = stream;
+
+  return stream;
+}
+
+// Closes the fds nobody asked for a stream of, their output is discarded
+function closeUnusedFds(attachedProcess) {
+  var closed = {};
+
+  attachedProcess._fds.forEach(function (fd, i) {
+    if (fd === null || attachedProcess._streams[i] !== undefined) {
+      return;
+    }
+
+    attachedProcess._streams[i] = null;
+
+    if (!closed[fd]) {
+      closed[fd] = true;
+      fs.closeSync(fd);
+    }
+
+    if (i > 0) {
+      maybeClose(attachedProcess);
+    }
+  });
+}
+
+// A SIGKILL is put down to the OOM killer if the container's OOM kill counter
+// went up while the process ran. Only known while the container is watched.
+// This is a guess on the container level: the counter does not say which
+// process was killed, so a process that was killed for another reason while
+// the OOM killer hit a different one is labeled as well. Processes we killed
+// ourselves through kill() or cancel() are never labeled.
+function exitReason(attachedProcess) {
+  var container = attachedProcess.container;
+
+  if (attachedProcess.signalCode !== 'SIGKILL' || attachedProcess._killed ||
+      !container || !container._memoryWatcher) {
+    return null;
+  }
+
+  // the inotify event might still be pending
+  var oomKills = container._memoryWatcher.refresh();
+
+  return oomKills > attachedProcess._oomKills ? 'oom' : null;
+}
+
 function exitCallback(attachedProcess, exitCode, signalCode) {
   if (signalCode) {
     attachedProcess.signalCode = signalCode;
@@ -33,15 +115,23 @@ function exitCallback(attachedProcess, exitCode, signalCode) {
     attachedProcess.exitCode = exitCode;
   }
 
-  if (attachedProcess.stdin !== attachedProcess.stdout) {
-    attachedProcess.stdin.destroy();
+  attachedProcess.reason = exitReason(attachedProcess);
+
+  if (attachedProcess._streams[0] && !attachedProcess._term) {
+    attachedProcess._streams[0].destroy();
+  }
+
+  // read what is left in the ring before the exit is reported
+  if (attachedProcess.shm) {
+    attachedProcess.shm.end();
   }
 
   if (exitCode < 0) {
     var err = common.errnoException(-exitCode, 'spawn',  attachedProcess.spawnfile);
     attachedProcess.emit('error', err);
   } else {
-    attachedProcess.emit('exit', attachedProcess.exitCode, attachedProcess.signalCode);
+    attachedProcess.emit('exit', attachedProcess.exitCode, attachedProcess.signalCode,
+                         attachedProcess.reason);
   }
 
   process.nextTick(flushStdio.bind(null, attachedProcess));
@@ -106,12 +196,29 @@ function AttachedProcess(command, fds, term, container) {
   AttachedProcess.super_.call(this);
 
   this._closesGot = 0;
-  this._closesNeeded = fds.length;
   this._ref = true;
 
+  // fds of pipes, null for everything else
+  this._fds = fds;
+  this._term = term;
+  this._streams = [];
+
+  // exit, and the close of every readable stream
+  this._closesNeeded = 1 + fds.filter(function (fd, i) {
+    return i > 0 && fd !== null;
+  }).length;
+
   this.exitCode = null;
   this.signalCode = null;
 
+  // 'oom' if the process was probably killed by the OOM killer, see
+  // Container#watchMemory()
+  this.reason = null;
+  this._oomKills = container ? container._oomKills : 0;
+
+  // whether we sent the SIGKILL, see exitReason()
+  this._killed = false;
+
   // node child API compatibility
   this.spawnfile = command;
 
@@ -122,43 +229,66 @@ function AttachedProcess(command, fds, term, container) {
   // attachment is asynchronous.
   this.pid = null;
 
-  this.stdio = [];
-
-  fds.forEach(function (fd, i) {
-    var stream;
-
-    if (i < 3 && term) {
-      if (i === 0) {
-        stream = new TTYStream(fd);
-      } else {
-        stream = this.stdio[0];
-      }
-    } else {
-      stream = new net.Socket({
-        fd: fd,
-        readable: i > 0,
-        writable: i === 0 || i > 2
-      });
-    }
+  // ShmChannel of the process, if it was attached with `options.shm`
+  this.shm = null;
 
-    if (i > 0) {
-      stream.on('close', maybeClose.bind(null, this));
+  // connection to the supervisor, if it was attached with `options.supervise`
+  // or adopted
+  this._supervised = null;
+}
+
+util.inherits(AttachedProcess, events.EventEmitter);
+
+/**
+ * The streams are created on first access. `null` for fds that are not
+ * piped.
+ */
+Object.defineProperties(AttachedProcess.prototype, {
+  stdin: {
+    get: function () {
+      return getStream(this, 0);
+    }
+  },
+  stdout: {
+    get: function () {
+      return getStream(this, 1);
+    }
+  },
+  stderr: {
+    get: function () {
+      return getStream(this, 2);
+    }
+  },
+  stdio: {
+    get: function () {
+      return this._fds.map(function (fd, i) {
+        return getStream(this, i);
+      }, this);
     }
+  }
+});
 
-    this.stdio[i] = stream;
-  }, this);
+AttachedProcess.prototype.emit = function (event) {
+  // the process never ran, nothing will read from its pipes
+  if (event === 'error' && this.pid === null) {
+    closeUnusedFds(this);
 
-  this.stdin = this.stdio[0];
-  this.stdout = this.stdio[1];
-  this.stderr = this.stdio[2];
-}
+    if (this.shm) {
+      this.shm.close();
+    }
 
-util.inherits(AttachedProcess, events.EventEmitter);
+    AttachedProcess.super_.prototype.emit.call(this, '_attachError');
+  }
+
+  return AttachedProcess.super_.prototype.emit.apply(this, arguments);
+};
 
 AttachedProcess.prototype.ref = function () {
   this._ref = true;
 
-  if (this.pid !== null) {
+  if (this._supervised) {
+    this._supervised.ref();
+  } else if (this.pid !== null) {
     binding.ref(this.pid);
   }
 };
@@ -166,7 +296,9 @@ AttachedProcess.prototype.ref = function () {
 AttachedProcess.prototype.unref = function () {
   this._ref = false;
 
-  if (this.pid !== null) {
+  if (this._supervised) {
+    this._supervised.unref();
+  } else if (this.pid !== null) {
     binding.unref(this.pid);
   }
 };
@@ -189,7 +321,13 @@ AttachedProcess.prototype.kill = function (signal) {
   }
 
   try {
-    return process.kill(this.pid, signal);
+    var sent = process.kill(this.pid, signal);
+
+    if (signal === 'SIGKILL' || signal === 9) {
+      this._killed = true;
+    }
+
+    return sent;
   } catch (err) {
     if (err.code === undefined || err.code === 'EINVAL' ||
         err.code === 'ENOSYS') {
@@ -205,8 +343,30 @@ AttachedProcess.prototype.kill = function (signal) {
   return false;
 };
 
+/**
+ * Cancels attaching the process. A process that is already running is killed
+ * with `SIGKILL`.
+ *
+ * @returns {Boolean} Whether there was anything to cancel
+ */
+AttachedProcess.prototype.cancel = function () {
+  if (this.pid === null) {
+    // the operation handle is gone once attaching completed
+    if (!this._operation || !this._operation.cancel()) {
+      return false;
+    }
+
+    // a process that already runs is killed once attaching completes
+    this._killed = true;
+
+    return true;
+  }
+
+  return this.kill('SIGKILL');
+};
+
 AttachedProcess.prototype.resize = function (cols, rows) {
-  if (this.stdin.resize) {
+  if (this._term) {
     this.stdin.resize(cols, rows);
   }
 };
@@ -21,3 +21,36 @@ exports.errnoException = function (errno, syscall, path) {
 
   return err;
 };
+
+/**
+ * Calls `start` with a wrapped `callback` and returns the operation handle
+ * it returns. Aborting `signal` (an `AbortSignal`, optional) cancels the
+ * operation.
+ */
+exports.cancellable = function (signal, callback, start) {
+  if (!signal) {
+    return start(callback);
+  }
+
+  var onAbort = null;
+
+  var operation = start(function () {
+    if (onAbort) {
+      signal.removeEventListener('abort', onAbort);
+    }
+
+    callback.apply(this, arguments);
+  });
+
+  if (signal.aborted) {
+    operation.cancel();
+  } else {
+    onAbort = function () {
+      operation.cancel();
+    };
+
+    signal.addEventListener('abort', onAbort);
+  }
+
+  return operation;
+};
@@ -0,0 +1,269 @@
+'use strict';
+
+var childProcess = require('child_process');
+var crypto = require('crypto');
+var fs = require('fs');
+var pathModule = require('path');
+
+var _ = require('lodash');
+
+var NAME_PATTERN = /^[\w][\w.-]*$/;
+
+function mkdirs(paths, callback) {
+  if (paths.length === 0) {
+    return callback(null);
+  }
+
+  fs.mkdir(paths[0], 493 /* 0755 */, function (err) {
+    if (err && err.code !== 'EEXIST') {
+      return callback(err);
+    }
+
+    mkdirs(paths.slice(1), callback);
+  });
+}
+
+function removeTree(path, callback) {
+  childProcess.execFile('rm', ['-rf', '--', path], function (err) {
+    callback(err);
+  });
+}
+
+function hashFile(file, callback) {
+  var hash = crypto.createHash('sha256');
+  var stream = fs.createReadStream(file);
+
+  callback = _.once(callback);
+
+  stream.on('error', callback);
+  stream.on('data', function (chunk) {
+    hash.update(chunk);
+  });
+  stream.on('end', function () {
+    callback(null, hash.digest('hex'));
+  });
+}
+
+/**
+ * A local, content addressed store of root file systems that containers can be
+ * created from (see `Container#create`), instead of running a template script.
+ *
+ * Images are imported from tarballs and unpacked once into
+ * `<root>/objects/sha256-<digest>`, so identical images share the same files
+ * on disk no matter under how many names they are imported.
+ * `<root>/refs/<name>` links a name to an object.
+ *
+ * Containers use an image as the read-only lower layer of an overlay rootfs.
+ * An object must therefore not be deleted while containers still use it.
+ *
+ * @class
+ * @param {String} [root=ImageStore.DEFAULT_ROOT]
+ */
+function ImageStore(root) {
+  this.root = root || ImageStore.DEFAULT_ROOT;
+}
+
+ImageStore.DEFAULT_ROOT = '/var/lib/lxc-images';
+
+ImageStore.prototype._ref = function (name) {
+  if (!NAME_PATTERN.test(name)) {
+    throw new TypeError('Invalid image name: ' + name);
+  }
+
+  return pathModule.join(this.root, 'refs', name);
+};
+
+/**
+ * Imports a (possibly compressed) tarball of a root file system under `name`.
+ * An existing image with the same name is replaced, containers created from
+ * it keep using the old files.
+ *
+ * @param {String} name
+ * @param {String} tarball Path to the tarball
+ * @param {Function} callback Receives the digest of the image
+ */
+ImageStore.prototype.import = function (name, tarball, callback) {
+  var ref = this._ref(name);
+  var objects = pathModule.join(this.root, 'objects');
+  var refs = pathModule.join(this.root, 'refs');
+
+  mkdirs([this.root, objects, refs], function (err) {
+    if (err) {
+      return callback(err);
+    }
+
+    hashFile(tarball, function (err, digest) {
+      if (err) {
+        return callback(err);
+      }
+
+      var id = 'sha256-' + digest;
+      var object = pathModule.join(objects, id);
+
+      var link = function () {
+        // replace the ref atomically
+        var tmp = ref + '.' + process.pid + '.tmp';
+
+        // left over by an earlier process with the same pid
+        fs.unlink(tmp, function () {
+          fs.symlink(pathModule.join('..', 'objects', id), tmp, function (err) {
+            if (err) {
+              return callback(err);
+            }
+
+            fs.rename(tmp, ref, function (err) {
+              if (err) {
+                return fs.unlink(tmp, function () {
+                  callback(err);
+                });
+              }
+
+              callback(null, digest);
+            });
+          });
+        });
+      };
+
+      fs.stat(object, function (err) {
+        if (!err) {
+          // already unpacked
+          return link();
+        }
+
+        var tmp = object + '.' + process.pid + '.tmp';
+
+        // a partially unpacked object is never left behind
+        var fail = function (err) {
+          removeTree(tmp, function () {
+            callback(err);
+          });
+        };
+
+        // left over by an earlier process with the same pid
+        removeTree(tmp, function (err) {
+          if (err) {
+            return callback(err);
+          }
+
+          mkdirs([tmp], function (err) {
+            if (err) {
+              return fail(err);
+            }
+
+            childProcess.execFile('tar', [
+              '-x', '-p', '--numeric-owner', '-f', tarball, '-C', tmp
+            ], function (err) {
+              if (err) {
+                return fail(err);
+              }
+
+              fs.rename(tmp, object, function (err) {
+                if (!err) {
+                  return link();
+                }
+
+                // someone else might have unpacked the same image meanwhile
+                if (err.code !== 'ENOTEMPTY' && err.code !== 'EEXIST') {
+                  return fail(err);
+                }
+
+                removeTree(tmp, function () {
+                  link();
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+};
+
+/**
+ * Resolves an image name to the path of its root file system.
+ *
+ * @param {String} name
+ * @param {Function} callback
+ */
+ImageStore.prototype.resolve = function (name, callback) {
+  var ref;
+
+  try {
+    ref = this._ref(name);
+  } catch (err) {
+    return process.nextTick(function () {
+      callback(err);
+    });
+  }
+
+  fs.realpath(ref, function (err, path) {
+    if (err && err.code === 'ENOENT') {
+      err = new Error('Image not found: ' + name);
+    }
+
+    callback(err, path);
+  });
+};
+
+/**
+ * Lists all images as `{name, digest}` objects.
+ *
+ * @param {Function} callback
+ */
+ImageStore.prototype.list = function (callback) {
+  var refs = pathModule.join(this.root, 'refs');
+
+  fs.readdir(refs, function (err, names) {
+    if (err) {
+      return callback(err.code === 'ENOENT' ? null : err, []);
+    }
+
+    var images = [];
+
+    names = names.filter(function (name) {
+      return NAME_PATTERN.test(name) && !_.endsWith(name, '.tmp');
+    });
+
+    var next = function (i) {
+      if (i === names.length) {
+        return callback(null, images);
+      }
+
+      fs.readlink(pathModule.join(refs, names[i]), function (err, target) {
+        if (!err) {
+          images.push({
+            name: names[i],
+            digest: pathModule.basename(target).replace(/^sha256-/, '')
+          });
+        }
+
+        next(i + 1);
+      });
+    };
+
+    next(0);
+  });
+};
+
+/**
+ * Removes the name of an image. Its files are kept, since containers might
+ * still use them.
+ *
+ * @param {String} name
+ * @param {Function} callback
+ */
+ImageStore.prototype.remove = function (name, callback) {
+  var ref;
+
+  try {
+    ref = this._ref(name);
+  } catch (err) {
+    return process.nextTick(function () {
+      callback(err);
+    });
+  }
+
+  fs.unlink(ref, callback);
+};
+
+module.exports = ImageStore;
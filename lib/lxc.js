@@ -1,6 +1,8 @@
 'use strict';
 
+var events = require('events');
 var fs = require('fs');
+var util = require('util');
 
 var constants = process.binding('constants');
 var pathModule = require('path');
@@ -11,6 +13,11 @@ var concat = require('concat-stream');
 var fsUtils = require('./fsUtils');
 var binding = require('bindings')('lxc.node');
 var AttachedProcess = require('./attach.js');
+var ImageStore = require('./images.js');
+var metricsUtils = require('./metrics.js');
+var Sampler = require('./sampler.js');
+var ShmChannel = require('./shm.js');
+var Watcher = require('./watch.js');
 var common = require('./common.js');
 
 /**
@@ -18,12 +25,47 @@ var common = require('./common.js');
  * @protected
  */
 function Container(name, container) {
+  Container.super_.call(this);
+
   this._name = name;
   this._container = container;
   this._container.owner = this;
+
+  // memory watcher, see watchMemory()
+  this._memoryWatcher = null;
+  this._oomKills = 0;
 }
 
+util.inherits(Container, events.EventEmitter);
+
+/**
+ * Creates the container, either by running an LXC template or from an image
+ * of an `ImageStore`:
+ *
+ *     container.create('download', 'dir', ['-d', 'debian'], callback);
+ *     container.create({image: 'py311-v4'}, callback);
+ *
+ * Containers created from an image get an overlay rootfs with the image as
+ * its read-only lower layer, no template script is run.
+ *
+ * Like all asynchronous container operations, it returns an operation handle
+ * whose `cancel()` method drops the operation if it has not started yet. The
+ * callback then receives an error.
+ *
+ * @param {String|Object} template Template name or image options
+ * @param {String} template.image Image name
+ * @param {ImageStore|String} [template.store] Image store or its root path
+ * @param {AbortSignal} [template.signal] Cancels the operation
+ * @param {String} [backingstore] Backing store type (template only)
+ * @param {String[]} [args] Template arguments
+ * @param {Function} callback
+ * @returns {Operation}
+ */
 Container.prototype.create = function (template, backingstore, args, callback) {
+  if (_.isPlainObject(template)) {
+    return this._createFromImage(template, backingstore);
+  }
+
   if (!_.isString(template)) {
     throw new TypeError('template argument must be a string');
   }
@@ -37,32 +79,237 @@ Container.prototype.create = function (template, backingstore, args, callback) {
     args = [];
   }
 
-  this._container.create(template, backingstore, args, callback);
+  return this._container.create(template, backingstore, args, '', callback);
+};
+
+Container.prototype._createFromImage = function (options, callback) {
+  if (!_.isString(options.image)) {
+    throw new TypeError('image option must be a string');
+  }
+
+  var store = options.store;
+
+  if (!(store instanceof ImageStore)) {
+    store = new ImageStore(store);
+  }
+
+  var container = this._container;
+
+  return common.cancellable(options.signal, callback, function (callback) {
+    // the native operation only exists once the image is resolved
+    var operation = null;
+    var cancelled = false;
+
+    store.resolve(options.image, function (err, rootfs) {
+      if (err) {
+        return callback(err);
+      }
+
+      if (cancelled) {
+        return callback(new Error('Operation cancelled'));
+      }
+
+      operation = container.create('', '', [], rootfs, callback);
+    });
+
+    return {
+      cancel: function () {
+        if (operation) {
+          return operation.cancel();
+        }
+
+        cancelled = true;
+        return true;
+      }
+    };
+  });
 };
 
-Container.prototype.start = function (command, args, callback) {
+/**
+ * Starts the container, running `command` as its init process.
+ *
+ * With `options.init` set to `'lxc-init'`, the container is started as an
+ * application container: `lxc-init` is used as a minimal init process that
+ * runs `command` and reaps orphaned processes, instead of booting the
+ * container's own init system.
+ *
+ * With `options.ready`, the callback is only called once the container is
+ * RUNNING and the given readiness probes succeed. The probes are retried every
+ * 50 ms, each attempt runs on the threadpool, and waiting for them does not
+ * count against the scheduler's `concurrency`. The callback then receives the
+ * time in milliseconds it took until the container was running and until it
+ * was ready.
+ *
+ * @param {String} command
+ * @param {String[]} [args]
+ * @param {Object} [options]
+ * @param {String} [options.init] `'lxc-init'` to start an application container
+ * @param {Object} [options.ready] Readiness probes
+ * @param {String|Number|Boolean} [options.ready.runlevel] Wait for this
+ *   runlevel (`0` to `6` or `'S'`), or any runlevel if `true`. Can not be
+ *   combined with `command`.
+ * @param {String} [options.ready.file] Wait until this file exists
+ * @param {String} [options.ready.unixSocket] Wait until this socket accepts
+ *   connections
+ * @param {String|String[]} [options.ready.command] Wait until this command
+ *   exits with 0, strings are run with `/bin/sh -c`. A command that is still
+ *   running after 5 seconds or at the timeout is killed and tried again.
+ * @param {Number} [options.timeoutMs=30000] Time to wait for readiness
+ * @param {AbortSignal} [options.signal] Cancels the operation, a container
+ *   that is waited for keeps running
+ * @param {String} [options.key] Scheduler key, see `lxc.scheduler`
+ * @param {Boolean|Object} [options.placement] Place the container on a NUMA
+ *   node, see `lxc.placement`. `{cpus}` limits it to that many cores of the
+ *   node, `{reserved: true}` uses the reserved cores.
+ * @param {Function} callback
+ * @returns {Operation}
+ */
+Container.prototype.start = function (command, args, options, callback) {
   if (!_.isString(command)) {
     throw new TypeError('command argument must be a string');
   }
 
   if (!_.isArray(args)) {
-    if (!_.isFunction(args)) {
-      throw new TypeError('args argument must be an array');
+    callback = options;
+    options = args;
+    args = [];
+  }
+
+  if (!_.isPlainObject(options)) {
+    callback = options;
+    options = {};
+  }
+
+  if (!_.isFunction(callback)) {
+    throw new TypeError('callback argument must be a function');
+  }
+
+  if (options.init !== undefined && options.init !== 'lxc-init') {
+    throw new TypeError('init option must be \'lxc-init\'');
+  }
+
+  if (options.ready !== undefined && !_.isPlainObject(options.ready)) {
+    throw new TypeError('ready option must be an object');
+  }
+
+  if (options.ready && options.ready.runlevel !== undefined) {
+    if (options.ready.runlevel !== true &&
+        !/^[0-6Ss]$/.test(String(options.ready.runlevel))) {
+      throw new TypeError('ready.runlevel option must be true or a runlevel');
     }
 
-    callback = args;
-    args = [];
+    if (options.ready.command !== undefined) {
+      throw new TypeError('ready.runlevel and ready.command options can not be combined');
+    }
+  }
+
+  if (options.placement !== undefined && !_.isBoolean(options.placement) &&
+      !_.isPlainObject(options.placement)) {
+    throw new TypeError('placement option must be a boolean or an object');
   }
 
-  this._container.start([].concat(command, args), callback);
+  var container = this._container;
+
+  return common.cancellable(options.signal, callback, function (callback) {
+    return container.start([].concat(command, args), options, callback);
+  });
+};
+
+/**
+ * Returns the placement of the container, `{node, cpus, reserved, load}`, or
+ * `null` if it was not started with the `placement` option.
+ */
+Container.prototype.getPlacement = function () {
+  return this._container.getPlacement();
+};
+
+/**
+ * Watches the memory cgroup of the running container. Emits `'oom'` with
+ * `{kills, total, high, max}` whenever the OOM killer killed a process in the
+ * container, and `'memoryPressure'` with the contents of `memory.pressure`
+ * (`{some: {avg10, avg60, avg300, total}, full: {...}}`) whenever tasks
+ * stalled on memory for longer than `stallMs` within `windowMs`. The watcher
+ * stops on its own once the container stops, `'memoryWatchEnd'` is emitted
+ * then.
+ *
+ * While the container is watched, attached processes that were killed by the
+ * OOM killer exit with `reason` set to `'oom'`. This is a heuristic on the
+ * container level: a process that dies from `SIGKILL` while the container's
+ * OOM kill counter goes up is labeled, unless it was killed through `kill()`
+ * or `cancel()`.
+ *
+ * @param {Object} [options]
+ * @param {Object} [options.pressure] PSI trigger, no pressure events if unset
+ * @param {String} [options.pressure.type='some'] `'some'` or `'full'`
+ * @param {Number} [options.pressure.stallMs=100]
+ * @param {Number} [options.pressure.windowMs=1000] Between 500 and 10000
+ */
+Container.prototype.watchMemory = function (options) {
+  options = options || {};
+
+  var pressure = options.pressure;
+
+  if (pressure !== undefined) {
+    pressure = _.defaults({}, pressure, {
+      type: 'some',
+      stallMs: 100,
+      windowMs: 1000
+    });
+
+    if (pressure.type !== 'some' && pressure.type !== 'full') {
+      throw new TypeError('pressure type must be \'some\' or \'full\'');
+    }
+
+    if (!_.isInteger(pressure.stallMs) || !_.isInteger(pressure.windowMs) ||
+        pressure.windowMs < 500 || pressure.windowMs > 10000 ||
+        pressure.stallMs <= 0 || pressure.stallMs > pressure.windowMs) {
+      throw new TypeError('Invalid pressure stallMs or windowMs');
+    }
+
+    pressure.full = pressure.type === 'full';
+  }
+
+  this.unwatchMemory();
+
+  var self = this;
+
+  this._memoryWatcher = binding.watchMemory(this._container, {
+    pressure: pressure
+  }, function (event, info) {
+    if (event === 'oom') {
+      self._oomKills = info.total;
+      self.emit('oom', info);
+    } else if (event === 'pressure') {
+      self.emit('memoryPressure', info);
+    } else {
+      self._memoryWatcher = null;
+      self.emit('memoryWatchEnd');
+    }
+  });
+
+  this._oomKills = this._memoryWatcher.refresh();
+
+  return this;
+};
+
+/**
+ * Stops watching the memory cgroup, see watchMemory().
+ */
+Container.prototype.unwatchMemory = function () {
+  if (this._memoryWatcher) {
+    this._memoryWatcher.close();
+    this._memoryWatcher = null;
+  }
+
+  return this;
 };
 
 Container.prototype.stop = function (callback) {
-  this._container.stop(callback);
+  return this._container.stop(callback);
 };
 
 Container.prototype.destroy = function (callback) {
-  this._container.destroy(callback);
+  return this._container.destroy(callback);
 };
 
 Container.prototype.clone = function (name, options, callback) {
@@ -81,19 +328,105 @@ Container.prototype.clone = function (name, options, callback) {
     keepmac: false
   });
 
-  this._container.clone(name, options, function (err, container) {
-    if (err) {
-      return callback(err);
-    }
+  var container = this._container;
+
+  return common.cancellable(options.signal, callback, function (callback) {
+    return container.clone(name, options, function (err, container) {
+      if (err) {
+        return callback(err);
+      }
 
-    callback(null, new Container(name, container));
+      callback(null, new Container(name, container));
+    });
   });
 };
 
-/**
- * @returns {AttachedProcess}
- */
-Container.prototype.attach = function (command, args, options) {
+// node.js child_process style stdio: 'pipe', 'ignore' (/dev/null of the
+// container), 'null' (/dev/null of the host), 'inherit', a host fd that is
+// passed through or a buffer the child reads from. `streams` adds that many
+// extra pipes.
+function normalizeStdio(stdio, streams) {
+  if (_.isString(stdio)) {
+    stdio = [stdio, stdio, stdio];
+  }
+
+  if (!_.isArray(stdio)) {
+    throw new TypeError('stdio must be a string or an array');
+  }
+
+  stdio = stdio.slice();
+
+  while (stdio.length < 3) {
+    stdio.push('pipe');
+  }
+
+  stdio = stdio.concat(_.times(streams, _.constant('pipe')));
+
+  return stdio.map(function (mode, i) {
+    if (mode === null || mode === undefined) {
+      return i < 3 ? 'pipe' : 'ignore';
+    }
+
+    if (mode === 'inherit') {
+      if (i > 2) {
+        throw new TypeError('Only stdin, stdout and stderr can be inherited');
+      }
+
+      mode = i;
+    }
+
+    if (Buffer.isBuffer(mode)) {
+      return mode;
+    }
+
+    if (_.isNumber(mode)) {
+      // throws EBADF right away instead of failing in the child
+      fs.fstatSync(mode);
+      return mode;
+    }
+
+    if (mode === 'pipe' || mode === 'ignore' || mode === 'null') {
+      return mode;
+    }
+
+    throw new TypeError('Invalid stdio mode: ' + mode);
+  });
+}
+
+function toBuffer(data) {
+  if (Buffer.isBuffer(data)) {
+    return data;
+  }
+
+  if (!_.isString(data)) {
+    throw new TypeError('input must be a buffer or a string');
+  }
+
+  // Buffer.from() is not available on old node versions
+  return Buffer.from && Buffer.from !== Uint8Array.from ? Buffer.from(data) : new Buffer(data);
+}
+
+// Normalizes the options that can be part of an attach profile
+function normalizeProfileOptions(options) {
+  options.env = _.map(options.env, function (value, key) {
+    if (value === null || value === undefined) {
+      return;
+    }
+
+    return key + '=' + value;
+  });
+
+  if (_.isArray(options.namespaces)) {
+    options.namespaces = options.namespaces.map(function (ns) {
+      return ns.toLowerCase();
+    });
+  }
+
+  return options;
+}
+
+// Normalizes the arguments of attach(), also used for every attachMany() spec
+function attachSpec(command, args, options) {
   if (!_.isArray(args)) {
     if (args !== undefined && !_.isObject(args)) {
       throw new TypeError('args argument must be an array');
@@ -107,40 +440,386 @@ Container.prototype.attach = function (command, args, options) {
     throw new TypeError('options argument must be an object');
   }
 
-  // node.js child_process compatibility
-  if (options && options.streams === undefined &&
-      options.stdio && options.stdio !== 'pipe') {
-    if (_.isArray(options.stdio) &&
-        options.stdio.length >= 3 && _.every(options.stdio, _.matches('pipe'))) {
-      options.streams = options.stdio.length - 3;
-    } else {
-      throw new TypeError('Only \'pipe\' stdio configurations are supported');
-    }
-  }
-
   options = _.defaults({}, options, {
     cwd: '/',
     env: {},
     term: false,
     cgroup: true,
+    stdio: 'pipe',
     streams: 0
   });
 
-  options.env = _.map(options.env, function (value, key) {
-    if (value === null || value === undefined) {
-      return;
+  options.stdio = normalizeStdio(options.stdio, options.streams);
+  delete options.streams;
+
+  // inputs are passed as read only in-memory files
+  if (options.stdinBuffer !== undefined) {
+    options.stdio[0] = toBuffer(options.stdinBuffer);
+  }
+
+  _.forEach(options.files, function (data, fd) {
+    fd = Number(fd);
+
+    if (!(fd > 2 && fd % 1 === 0)) {
+      throw new TypeError('files keys must be fds greater than 2');
     }
 
-    return key + '=' + value;
+    while (options.stdio.length <= fd) {
+      options.stdio.push('ignore');
+    }
+
+    options.stdio[fd] = toBuffer(data);
   });
 
-  if (_.isArray(options.namespaces)) {
-    options.namespaces = options.namespaces.map(function (ns) {
-      return ns.toLowerCase();
+  if (options.term && !_.every(options.stdio.slice(0, 3), _.matches('pipe'))) {
+    throw new TypeError('term requires piped stdin, stdout and stderr');
+  }
+
+  normalizeProfileOptions(options);
+
+  var shm = options.shm;
+  delete options.shm;
+
+  return {command: command, args: args, options: options, shm: shm};
+}
+
+// Creates the shm channels of the specs and passes their fds to the
+// processes. The channels are closed if attaching throws.
+function attachShm(specs, attach) {
+  var names = ['SOURCEBOX_SHM_FD', 'SOURCEBOX_SHM_DATA_FD', 'SOURCEBOX_SHM_SPACE_FD'];
+  var attachedProcesses;
+
+  try {
+    specs.forEach(function (spec) {
+      if (!spec.shm) {
+        spec.shm = null;
+        return;
+      }
+
+      spec.shm = new ShmChannel(spec.shm.size || 65536);
+
+      // the variables go into the env, which is fixed in a profile
+      delete spec.options.profile;
+
+      spec.shm.fds.forEach(function (fd, i) {
+        spec.options.env.push(names[i] + '=' + spec.options.stdio.length);
+        spec.options.stdio.push(fd);
+      });
+    });
+
+    attachedProcesses = attach();
+  } catch (err) {
+    specs.forEach(function (spec) {
+      if (spec.shm instanceof ShmChannel) {
+        spec.shm.close();
+      }
     });
+
+    throw err;
+  }
+
+  specs.forEach(function (spec, i) {
+    attachedProcesses[i].shm = spec.shm;
+  });
+
+  return attachedProcesses;
+}
+
+function cancelOnAbort(signal, attachedProcess) {
+  if (!signal) {
+    return;
+  }
+
+  var onAbort = function () {
+    attachedProcess.cancel();
+  };
+
+  var removeListener = function () {
+    signal.removeEventListener('abort', onAbort);
+  };
+
+  if (signal.aborted) {
+    onAbort();
+  } else {
+    signal.addEventListener('abort', onAbort);
+    attachedProcess.on('close', removeListener);
+    // failed to attach, there will be no 'close'
+    attachedProcess.on('_attachError', removeListener);
+  }
+}
+
+var defaultSupervisorSocket = process.env.SOURCEBOX_SUPERVISOR_SOCKET ||
+  '/run/sourcebox-supervisor.sock';
+
+// The supervisor attaches with the cwd, env and credentials of the options
+// only, everything else is refused instead of silently ignored.
+function normalizeSuperviseOptions(spec) {
+  var options = spec.options;
+  var supervise = options.supervise;
+
+  if (supervise === undefined) {
+    return;
+  }
+
+  if (!_.isObject(supervise) || !_.isString(supervise.id) || supervise.id === '') {
+    throw new TypeError('supervise.id must be a non-empty string');
+  }
+
+  var unsupported = _.find(['profile', 'limits', 'nice', 'schedPolicy', 'ioPriority',
+                            'oomScoreAdj', 'cpus', 'namespaces'], function (name) {
+    return options[name] !== undefined;
+  });
+
+  if (spec.shm) {
+    unsupported = 'shm';
+  } else if (options.cgroup === false) {
+    unsupported = 'cgroup';
+  }
+
+  if (unsupported) {
+    throw new TypeError(unsupported + ' option can not be combined with supervise');
+  }
+
+  options.supervise = {
+    id: supervise.id,
+    socket: supervise.socket || defaultSupervisorSocket
+  };
+}
+
+function refuseSupervise(spec) {
+  if (spec.options.supervise !== undefined) {
+    throw new TypeError('supervise option is only supported by attach()');
+  }
+}
+
+/**
+ * Attaches a process to the running container. Besides the options below,
+ * `options.key` selects the scheduler queue (see `lxc.scheduler`) and
+ * `options.signal` cancels attaching.
+ *
+ * With `options.supervise = {id, socket}` the process is attached by
+ * `sourcebox-supervisor` (see `lxc.supervisor`) instead of this process. It
+ * keeps running if node exits and can be adopted again with the same `id`,
+ * see adopt(). Only `cwd`, `env`, `uid`, `gid`, `term`, `stdio` and `key`
+ * are supported along with it.
+ *
+ * @returns {AttachedProcess}
+ */
+Container.prototype.attach = function (command, args, options) {
+  var spec = attachSpec(command, args, options);
+
+  normalizeSuperviseOptions(spec);
+
+  var attachedProcess = attachShm([spec], function () {
+    return [this._container.attach(AttachedProcess, spec.command, spec.args,
+                                   spec.options)];
+  }.bind(this))[0];
+
+  cancelOnAbort(spec.options.signal, attachedProcess);
+
+  return attachedProcess;
+};
+
+/**
+ * Executes a binary that is not part of the container, e.g. a program that
+ * was compiled on the host. The binary is passed to the child as an fd and
+ * executed with `execveat()`, nothing is written to the container's file
+ * system. Takes the same options as attach(), `options.argv0` (default
+ * `'a.out'`) is passed as argv[0]. Scripts can not be executed this way.
+ *
+ * @param {Buffer|Number} binary Contents of the binary, or a host fd to it
+ * @param {Array} [args]
+ * @param {Object} [options]
+ * @returns {AttachedProcess}
+ */
+Container.prototype.attachBinary = function (binary, args, options) {
+  if (!Buffer.isBuffer(binary) && !(_.isNumber(binary) && binary >= 0 && binary % 1 === 0)) {
+    throw new TypeError('binary argument must be a buffer or an fd');
+  }
+
+  var spec = attachSpec(binary, args, options);
+
+  refuseSupervise(spec);
+
+  spec.options.argv0 = _.isString(spec.options.argv0) ? spec.options.argv0 : 'a.out';
+
+  var attachedProcess = attachShm([spec], function () {
+    return [this._container.attachBinary(AttachedProcess, binary, spec.args,
+                                         spec.options)];
+  }.bind(this))[0];
+
+  cancelOnAbort(spec.options.signal, attachedProcess);
+
+  return attachedProcess;
+};
+
+/**
+ * Attaches several processes at once. Every spec is {command, args, options}
+ * with the same arguments as attach(). The container is checked once and all
+ * processes are started by a single operation, cancelling one process before
+ * it started cancels the rest of the batch. `options.key` and
+ * `options.signal` apply to the whole batch.
+ *
+ * @returns {AttachedProcess[]}
+ */
+Container.prototype.attachMany = function (specs, options) {
+  if (!_.isArray(specs)) {
+    throw new TypeError('specs argument must be an array');
+  }
+
+  if (options !== undefined && !_.isObject(options)) {
+    throw new TypeError('options argument must be an object');
+  }
+
+  options = options || {};
+
+  specs = specs.map(function (spec) {
+    if (!_.isObject(spec) || !_.isString(spec.command)) {
+      throw new TypeError('spec must be an object with a command');
+    }
+
+    spec = attachSpec(spec.command, spec.args || [], spec.options);
+    refuseSupervise(spec);
+
+    return spec;
+  });
+
+  if (specs.length === 0) {
+    return [];
+  }
+
+  var attachedProcesses = attachShm(specs, function () {
+    return this._container.attachMany(AttachedProcess, specs, options);
+  }.bind(this));
+
+  attachedProcesses.forEach(function (attachedProcess, i) {
+    cancelOnAbort(specs[i].options.signal || options.signal, attachedProcess);
+  });
+
+  return attachedProcesses;
+};
+
+/**
+ * Adopts a process that was attached with `options.supervise`, usually by
+ * an earlier instance of the application that exited or crashed. The
+ * callback receives a new AttachedProcess with the pipes the supervisor held
+ * on to, output written in the meantime is still buffered in them. A process
+ * that exited while nobody owned it emits 'exit' right after it is adopted.
+ *
+ * @param {String} id Id the process was attached with
+ * @param {Object} [options]
+ * @param {String} [options.socket] Socket of the supervisor
+ * @param {AbortSignal} [options.signal] Cancels the operation
+ * @param {Function} callback
+ * @returns {Operation}
+ */
+Container.prototype.adopt = function (id, options, callback) {
+  if (_.isFunction(options)) {
+    callback = options;
+    options = {};
+  }
+
+  if (!_.isString(id)) {
+    throw new TypeError('id argument must be a string');
+  }
+
+  options = _.defaults({}, options, {
+    socket: defaultSupervisorSocket
+  });
+
+  var container = this._container;
+
+  return common.cancellable(options.signal, callback, function (callback) {
+    return container.adopt(AttachedProcess, options.socket, id, callback);
+  });
+};
+
+/**
+ * Attach options that are parsed once and reused for every process, see
+ * Container#createAttachProfile().
+ *
+ * @class
+ */
+function AttachProfile(container, options) {
+  this._container = container;
+  this._options = options;
+  this._profile = binding.createAttachProfile(normalizeProfileOptions(_.clone(options)));
+
+  // passed as is if attach() gets no options
+  this._defaults = {
+    profile: this._profile,
+    stdio: ['pipe', 'pipe', 'pipe'],
+    term: false
+  };
+}
+
+/**
+ * Attaches a process with the options of the profile. `options` takes the
+ * per process options of attach(), e.g. `stdio`, `term` or `key`, the options
+ * of the profile can not be overridden.
+ *
+ * @param {String} command
+ * @param {Array} [args]
+ * @param {Object} [options]
+ * @returns {AttachedProcess}
+ */
+AttachProfile.prototype.attach = function (command, args, options) {
+  if (!_.isArray(args)) {
+    options = args;
+    args = [];
+  }
+
+  if (options !== undefined) {
+    options = _.assign({}, options, this._options, {profile: this._profile});
+    return this._container.attach(command, args, options);
+  }
+
+  if (!_.isString(command)) {
+    throw new TypeError('command argument must be a string');
   }
 
-  return this._container.attach(AttachedProcess, command, args, options);
+  return this._container._container.attach(AttachedProcess, command, args,
+                                           this._defaults);
+};
+
+/**
+ * Creates a profile for processes that are attached with the same options
+ * over and over again. The options are validated and prepared once, attaching
+ * a process with `profile.attach(command, args)` only passes its arguments.
+ *
+ * @param {Object} options
+ * @param {String} [options.cwd='/']
+ * @param {Object} [options.env]
+ * @param {Number} [options.uid]
+ * @param {Number} [options.gid]
+ * @param {String[]} [options.namespaces]
+ * @param {Boolean} [options.cgroup=true]
+ * @param {Object} [options.limits] Resource limits by name without the
+ *   `RLIMIT_` prefix, e.g. `{nofile: 256, cpu: [10, 15]}`, as a number or a
+ *   `[soft, hard]` pair. `Infinity` is unlimited.
+ * @param {Number} [options.nice] Niceness, -20 to 19
+ * @param {String} [options.schedPolicy] `'other'`, `'batch'` or `'idle'`
+ * @param {Number|String} [options.ioPriority] Best effort I/O priority level
+ *   from 0 (highest) to 7, or `'idle'`
+ * @param {Number} [options.oomScoreAdj] -1000 to 1000, higher values make
+ *   the process a more likely victim of the OOM killer
+ * @param {Number[]|String} [options.cpus] CPU affinity, e.g. `[2, 3]` or
+ *   `'2-3'`
+ * @returns {AttachProfile}
+ */
+Container.prototype.createAttachProfile = function (options) {
+  if (!_.isObject(options)) {
+    throw new TypeError('options argument must be an object');
+  }
+
+  options = _.pick(options, ['cwd', 'env', 'uid', 'gid', 'namespaces', 'cgroup', 'limits',
+                             'nice', 'schedPolicy', 'ioPriority', 'oomScoreAdj', 'cpus']);
+
+  return new AttachProfile(this, _.defaults(options, {
+    cwd: '/',
+    env: {},
+    cgroup: true
+  }));
 };
 
 function configFile(container, save, file, callback) {
@@ -149,15 +828,15 @@ function configFile(container, save, file, callback) {
     file = '';
   }
 
-  container.configFile(file, save, callback);
+  return container.configFile(file, save, callback);
 }
 
 Container.prototype.loadConfig = function (file, callback) {
-  configFile(this._container, false, file, callback);
+  return configFile(this._container, false, file, callback);
 };
 
 Container.prototype.saveConfig = function (file, callback) {
-  configFile(this._container, true, file, callback);
+  return configFile(this._container, true, file, callback);
 };
 
 Container.prototype.getKeys = function () {
@@ -176,16 +855,18 @@ function normalizeConfigKey(key) {
   return _.startsWith(key, prefix) ? key : prefix + key;
 }
 
-Container.prototype.getConfigItem = function (key) {
-  key = normalizeConfigKey(key);
-  var value = this._container.getConfigItem(key);
-
+function parseConfigValue(value) {
   if (_.endsWith(value, '\n')) {
     value = value.split('\n');
     value.pop();
   }
 
   return value;
+}
+
+Container.prototype.getConfigItem = function (key) {
+  key = normalizeConfigKey(key);
+  return parseConfigValue(this._container.getConfigItem(key));
 };
 
 Container.prototype.setConfigItem = function (key, value) {
@@ -285,6 +966,8 @@ Container.prototype.openFile = function (path, flags, options, callback) {
   var helper = this._container.openFile(AttachedProcess, path, flags,
                                         options.mode, options.uid, options.gid);
 
+  cancelOnAbort(options.signal, helper);
+
   helper.on('error', callback);
   helper.on('exit', function (code, signal) {
     if (signal) {
@@ -332,16 +1015,526 @@ function getContainer(name, options, callback) {
     defined: true
   });
 
-  binding.getContainer(name, options.path, options.defined, function (err, container) {
-    if (err) {
-      return callback(err);
+  return common.cancellable(options.signal, callback, function (callback) {
+    return binding.getContainer(name, options.path, options.defined, function (err, container) {
+      if (err) {
+        return callback(err);
+      }
+
+      callback(null, new Container(name, container));
+    });
+  });
+}
+
+/**
+ * Lists the containers under a path together with their state, init pid, IP
+ * addresses and selected configuration and cgroup values. All containers are
+ * queried in parallel on background threads.
+ *
+ * Every entry has a `container` property, the `Container` instance is only
+ * created when it is accessed.
+ *
+ * @param {String} [path] LXC path, defaults to the system path
+ * @param {Object} [options]
+ * @param {Boolean} [options.active=true] Include running containers
+ * @param {Boolean} [options.defined=true] Include defined containers
+ * @param {String[]} [options.fields] Subset of `'state'`, `'pid'` and `'ips'`
+ * @param {String[]} [options.config] Configuration keys to read
+ * @param {String[]} [options.cgroup] Cgroup keys to read (running only)
+ * @param {Number} [options.concurrency=8] Number of threads
+ * @param {AbortSignal} [options.signal] Cancels the operation
+ * @param {Function} callback
+ * @returns {Operation}
+ */
+function list(path, options, callback) {
+  if (_.isFunction(path)) {
+    callback = path;
+    path = '';
+    options = {};
+  } else if (_.isFunction(options)) {
+    callback = options;
+
+    if (_.isPlainObject(path)) {
+      options = path;
+      path = '';
+    } else {
+      options = {};
+    }
+  }
+
+  options = _.defaults({}, options, {
+    active: true,
+    defined: true,
+    fields: ['state', 'pid', 'ips'],
+    config: [],
+    cgroup: [],
+    concurrency: 8
+  });
+
+  options.config = options.config.map(normalizeConfigKey);
+
+  return common.cancellable(options.signal, callback, function (callback) {
+    return binding.list(path || '', options, function (err, entries) {
+      if (err) {
+        return callback(err);
+      }
+
+      entries.forEach(function (entry) {
+        var wrap = entry.container;
+        var container = null;
+
+        _.forEach(entry.config, function (value, key) {
+          entry.config[key] = value === null ? null : parseConfigValue(value);
+        });
+
+        _.forEach(entry.cgroup, function (value, key) {
+          entry.cgroup[key] = value === null ? null : _.trimRight(value, '\n');
+        });
+
+        Object.defineProperty(entry, 'container', {
+          enumerable: true,
+          get: function () {
+            if (container === null) {
+              container = new Container(entry.name, wrap);
+            }
+
+            return container;
+          }
+        });
+      });
+
+      callback(null, entries);
+    });
+  });
+}
+
+function bulk(operation, names, options, callback) {
+  if (!_.isArray(names)) {
+    throw new TypeError('names argument must be an array');
+  }
+
+  if (_.isFunction(options)) {
+    callback = options;
+    options = {};
+  }
+
+  options = _.defaults({}, options, {
+    path: '',
+    concurrency: 8,
+    timeoutMs: 0,
+    force: false,
+    fast: false
+  });
+
+  names = names.map(function (name) {
+    return name instanceof Container ? name._name : name;
+  });
+
+  return common.cancellable(options.signal, callback, function (callback) {
+    return binding[operation](names, options.path, options, function (err, errors) {
+      if (err) {
+        return callback(err);
+      }
+
+      callback(null, names.map(function (name, i) {
+        return {name: name, error: errors[i]};
+      }));
+    });
+  });
+}
+
+/**
+ * Stops multiple containers in parallel. The callback receives an array of
+ * `{name, error}` objects.
+ *
+ * @param {Array<String|Container>} names
+ * @param {Object} [options]
+ * @param {String} [options.path] LXC path, defaults to the system path
+ * @param {Number} [options.concurrency=8] Containers to stop at once
+ * @param {Number} [options.timeoutMs=0] Time to wait for a clean shutdown
+ *   before killing the container, 0 kills it right away
+ * @param {Boolean} [options.force=false] Always kill the container
+ * @param {AbortSignal} [options.signal] Cancels the containers that were not
+ *   stopped yet
+ * @param {Function} callback
+ * @returns {Operation}
+ */
+function stopAll(names, options, callback) {
+  return bulk('stopAll', names, options, callback);
+}
+
+/**
+ * Destroys multiple containers in parallel. The callback receives an array of
+ * `{name, error}` objects.
+ *
+ * In fast mode, the rootfs of dir backed containers is moved into a trash
+ * directory inside the LXC path and deleted by a background thread with idle
+ * I/O priority, so the containers are gone almost immediately. If destroying
+ * a container fails, its rootfs is moved back.
+ *
+ * @param {Array<String|Container>} names
+ * @param {Object} [options]
+ * @param {String} [options.path] LXC path, defaults to the system path
+ * @param {Number} [options.concurrency=8] Containers to destroy at once
+ * @param {Boolean} [options.force=false] Kill running containers first
+ * @param {Boolean} [options.fast=false] Delete the rootfs in the background
+ * @param {AbortSignal} [options.signal] Cancels the containers that were not
+ *   destroyed yet
+ * @param {Function} callback
+ * @returns {Operation}
+ */
+function destroyAll(names, options, callback) {
+  return bulk('destroyAll', names, options, callback);
+}
+
+/**
+ * Runs a command in multiple running containers in parallel and collects the
+ * results. The callback receives an array of
+ * `{name, exitCode, signal, stdout, stderr, truncated, timedOut, durationMs, error}`
+ * objects in the order of `names`, `error` is set if the command could not be
+ * run at all. The processes read from /dev/null and their output is
+ * collected natively, no streams are created.
+ *
+ * @param {Array<String|Container>} names
+ * @param {String} command
+ * @param {Array} [args]
+ * @param {Object} [options]
+ * @param {String} [options.path] LXC path, defaults to the system path
+ * @param {Number} [options.concurrency=8] Commands to run at once
+ * @param {Number} [options.timeoutMs=0] Kills a command after this time, 0
+ *   waits forever
+ * @param {Number} [options.maxOutputBytes=1048576] Output kept per stream,
+ *   the rest is discarded and `truncated` is set
+ * @param {String} [options.encoding='utf8'] Encoding of stdout and stderr,
+ *   'buffer' returns buffers
+ * @param {String} [options.cwd='/']
+ * @param {Object} [options.env]
+ * @param {Number} [options.uid]
+ * @param {Number} [options.gid]
+ * @param {String} [options.key] Scheduler key, see `lxc.scheduler`
+ * @param {Function} [options.onResult] Called with every result as soon as
+ *   the command completed in that container
+ * @param {AbortSignal} [options.signal] Kills the running commands and skips
+ *   the containers that were not started yet
+ * @param {Function} callback
+ * @returns {Operation}
+ */
+function execAcross(names, command, args, options, callback) {
+  if (!_.isArray(names)) {
+    throw new TypeError('names argument must be an array');
+  }
+
+  if (!_.isArray(args)) {
+    callback = options;
+    options = args;
+    args = [];
+  }
+
+  if (_.isFunction(options)) {
+    callback = options;
+    options = {};
+  }
+
+  options = _.defaults({}, options, {
+    path: '',
+    concurrency: 8,
+    timeoutMs: 0,
+    maxOutputBytes: 1024 * 1024,
+    encoding: 'utf8',
+    cwd: '/',
+    env: {}
+  });
+
+  options.env = _.compact(_.map(options.env, function (value, key) {
+    if (value === null || value === undefined) {
+      return;
+    }
+
+    return key + '=' + value;
+  }));
+
+  names = names.map(function (name) {
+    return name instanceof Container ? name._name : name;
+  });
+
+  var convert = function (result) {
+    if (options.encoding !== 'buffer') {
+      result.stdout = result.stdout.toString(options.encoding);
+      result.stderr = result.stderr.toString(options.encoding);
+    }
+
+    if (result.execErrno) {
+      result.error = common.errnoException(result.execErrno, 'spawn', command);
     }
 
-    callback(null, new Container(name, container));
+    delete result.execErrno;
+
+    return result;
+  };
+
+  var onResult = options.onResult && function (result) {
+    options.onResult(convert(result));
+  };
+
+  return common.cancellable(options.signal, callback, function (callback) {
+    return binding.execAcross(names, options.path, command, args, options, onResult,
+                              function (err, results) {
+      if (err) {
+        return callback(err);
+      }
+
+      // streamed results were converted already
+      callback(null, results.map(function (result) {
+        return 'execErrno' in result ? convert(result) : result;
+      }));
+    });
   });
 }
 
+/**
+ * Container operations are queued by key before they run on the threadpool.
+ * `attach()`, `clone()` and `start()` take the key from `options.key`, all
+ * other operations use the default key `''`. Keys are dispatched in weighted
+ * fair order, so a key with many queued operations does not delay the others.
+ *
+ *     lxc.scheduler.configure({
+ *       concurrency: 8,
+ *       maxQueue: 1000,
+ *       keys: {'course-101': {weight: 0.5, limit: 2}}
+ *     });
+ *
+ * Operations submitted while their key already has `maxQueue` queued
+ * operations fail with `'Queue is full'`.
+ *
+ * `stats()` returns the number of queued and running operations per key, and
+ * a histogram of the time operations waited, where `wait[i]` counts waits
+ * shorter than 2^i microseconds. Keys that are not configured are only listed
+ * while they have queued or running operations.
+ *
+ * With `pressure`, heavy operations are shed while the host is under
+ * pressure. The kernel reports (PSI) when tasks stalled on a resource for
+ * longer than `stallMs` within `windowMs`, the gate then stays closed for
+ * `holdMs` after the last report:
+ *
+ *     lxc.scheduler.configure({
+ *       pressure: {
+ *         memory: {stallMs: 150, windowMs: 1000},
+ *         io: {type: 'full', stallMs: 300, windowMs: 1000},
+ *         holdMs: 3000
+ *       }
+ *     });
+ *
+ * While the gate is closed, gated operations are held back in their queue,
+ * or fail with `'Host is under pressure'` if `reject` is set. Other
+ * operations are dispatched as usual, unless they are queued behind a held
+ * back operation of the same key. `stats().pressure` reports the state of the
+ * gate and the number of delayed and rejected operations.
+ */
+function normalizePressureOptions(pressure) {
+  if (!_.isPlainObject(pressure)) {
+    throw new TypeError('pressure option must be an object');
+  }
+
+  pressure = _.clone(pressure);
+
+  ['cpu', 'memory', 'io'].forEach(function (resource) {
+    var trigger = pressure[resource];
+
+    if (trigger === undefined) {
+      return;
+    }
+
+    trigger = _.defaults({}, trigger, {
+      type: 'some',
+      windowMs: 1000
+    });
+
+    if (trigger.type !== 'some' && trigger.type !== 'full') {
+      throw new TypeError('pressure type must be \'some\' or \'full\'');
+    }
+
+    if (!_.isInteger(trigger.stallMs) || !_.isInteger(trigger.windowMs) ||
+        trigger.windowMs < 500 || trigger.windowMs > 10000 ||
+        trigger.stallMs <= 0 || trigger.stallMs > trigger.windowMs) {
+      throw new TypeError('Invalid ' + resource + ' pressure stallMs or windowMs');
+    }
+
+    trigger.full = trigger.type === 'full';
+    pressure[resource] = trigger;
+  });
+
+  if (pressure.holdMs !== undefined && !(_.isInteger(pressure.holdMs) && pressure.holdMs >= 0)) {
+    throw new TypeError('pressure holdMs must be a positive integer');
+  }
+
+  if (pressure.operations !== undefined && !_.isArray(pressure.operations)) {
+    throw new TypeError('pressure operations must be an array');
+  }
+
+  return pressure;
+}
+
+var scheduler = {
+  /**
+   * @param {Object} options
+   * @param {Number} [options.concurrency] Operations running at once, 0 for
+   *   no limit, defaults to the threadpool size
+   * @param {Number} [options.limit] Default per key limit, 0 for no limit
+   * @param {Number} [options.maxQueue] Queued operations per key, 0 for no
+   *   limit
+   * @param {Object} [options.keys] `{weight, limit}` for individual keys
+   * @param {Object|null} [options.pressure] Pressure gate, `null` disables it
+   * @param {Object} [options.pressure.cpu] `{type, stallMs, windowMs}`
+   *   trigger, `type` is `'some'` (default) or `'full'`
+   * @param {Object} [options.pressure.memory]
+   * @param {Object} [options.pressure.io]
+   * @param {Number} [options.pressure.holdMs=2000]
+   * @param {Boolean} [options.pressure.reject=false] Reject instead of delay
+   * @param {String[]} [options.pressure.operations] Gated operations,
+   *   defaults to `['create', 'clone', 'start']`
+   */
+  configure: function (options) {
+    if (!_.isPlainObject(options)) {
+      throw new TypeError('options argument must be an object');
+    }
+
+    if (options.pressure) {
+      options = _.assign({}, options, {
+        pressure: normalizePressureOptions(options.pressure)
+      });
+    }
+
+    binding.configureScheduler(options);
+  },
+
+  stats: function () {
+    return binding.schedulerStats();
+  }
+};
+
+// Parses a cpu list such as '0-3,8'
+function parseCpuList(list) {
+  return _.flatMap(String(list).split(','), function (range) {
+    var bounds = range.split('-').map(Number);
+    var last = bounds.length > 1 ? bounds[1] : bounds[0];
+
+    if (bounds.length > 2 || !_.every(bounds, _.isInteger) || bounds[0] < 0 || last < bounds[0]) {
+      throw new TypeError('Invalid cpu list: ' + list);
+    }
+
+    return _.range(bounds[0], last + 1);
+  });
+}
+
+/**
+ * Containers started with the `placement` option are assigned to a NUMA node
+ * and get its cores and memory as their cpuset. New containers go to the node
+ * with the lowest CPU load per core, measured from the cgroup statistics of
+ * the containers already placed there.
+ *
+ *     lxc.placement.configure({reserved: '0-1'});
+ *     container.start('sleep', ['infinity'], {placement: {cpus: 2}}, callback);
+ *     session.start('sleep', ['infinity'], {placement: {reserved: true}}, callback);
+ *
+ * Reserved cores are only used by containers that ask for them, e.g. for
+ * latency critical sessions. `stats()` returns the nodes with their cores,
+ * load and number of containers, and the assignments of all containers.
+ */
+var placement = {
+  /**
+   * @param {Object} options
+   * @param {Number[]|String} [options.reserved] Reserved cores, e.g. `'0-1'`
+   */
+  configure: function (options) {
+    if (!_.isPlainObject(options)) {
+      throw new TypeError('options argument must be an object');
+    }
+
+    options = _.clone(options);
+
+    if (_.isString(options.reserved)) {
+      options.reserved = parseCpuList(options.reserved);
+    }
+
+    binding.configurePlacement(options);
+  },
+
+  stats: function () {
+    return binding.placementStats();
+  }
+};
+
+var supervisor = {
+  // Path of the sourcebox-supervisor executable
+  path: pathModule.join(__dirname, '..', 'build', 'Release', 'sourcebox-supervisor'),
+
+  socket: defaultSupervisorSocket,
+
+  /**
+   * Lists the processes of the supervisor, `{id, container, pid, running}`.
+   * Processes that exited stay listed until they are adopted.
+   *
+   * @param {Object} [options]
+   * @param {String} [options.socket] Socket of the supervisor
+   * @param {Function} callback
+   * @returns {Operation}
+   */
+  list: function (options, callback) {
+    if (_.isFunction(options)) {
+      callback = options;
+      options = {};
+    }
+
+    options = _.defaults({}, options, {
+      socket: defaultSupervisorSocket
+    });
+
+    return binding.listSupervised(options.socket, callback);
+  }
+};
+
+/**
+ * Returns timing statistics of all container operations since the module was
+ * loaded, per operation type: how long operations were queued, how long they
+ * ran on the threadpool and how long their callbacks took, as well as how
+ * long attach waited for the event loop's cloexec lock.
+ *
+ * Histograms are `{count, sum, max, p50, p90, p99, p999, buckets}` with all
+ * durations in milliseconds; `buckets` are `[upperBound, count]` pairs.
+ *
+ * @param {String} [format] `'prometheus'` for the Prometheus text format
+ * @returns {Object|String}
+ */
+function metrics(format) {
+  var snapshot = binding.metrics();
+
+  if (format === 'prometheus') {
+    return metricsUtils.toPrometheus(snapshot);
+  } else if (format !== undefined) {
+    throw new TypeError('Unknown format: ' + format);
+  }
+
+  return metricsUtils.summarize(snapshot);
+}
+
 module.exports = exports = getContainer;
 exports.getContainer = getContainer;
+exports.list = list;
+exports.stopAll = stopAll;
+exports.destroyAll = destroyAll;
+exports.execAcross = execAcross;
 exports.version = binding.version;
+exports.scheduler = scheduler;
+exports.placement = placement;
+exports.supervisor = supervisor;
+exports.metrics = metrics;
+exports.ImageStore = ImageStore;
+exports.Sampler = Sampler;
+exports.createSampler = function (options) {
+  return new Sampler(options);
+};
+exports.Watcher = Watcher;
+exports.watch = function (path, options) {
+  return new Watcher(path, options);
+};
 exports._Container = Container; // export container for auto promisification
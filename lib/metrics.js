@@ -0,0 +1,143 @@
+'use strict';
+
+var _ = require('lodash');
+
+// bucket boundaries in seconds for the Prometheus export
+var BOUNDS = [
+  0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05,
+  0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30, 60
+];
+
+var PREFIX = 'sourcebox_lxc_';
+
+/**
+ * Returns the value below which the fraction `q` of the recorded durations
+ * lies, in milliseconds. The result is the upper bound of the bucket, so it
+ * overestimates by at most 12.5%.
+ */
+function percentile(histogram, q) {
+  if (histogram.count === 0) {
+    return 0;
+  }
+
+  var rank = q * histogram.count;
+  var seen = 0;
+
+  for (var i = 0; i < histogram.buckets.length; i++) {
+    seen += histogram.buckets[i][1];
+
+    if (seen >= rank) {
+      return Math.min(histogram.buckets[i][0], histogram.max);
+    }
+  }
+
+  return histogram.max;
+}
+
+function summarize(histogram) {
+  histogram.p50 = percentile(histogram, 0.5);
+  histogram.p90 = percentile(histogram, 0.9);
+  histogram.p99 = percentile(histogram, 0.99);
+  histogram.p999 = percentile(histogram, 0.999);
+
+  return histogram;
+}
+
+function labels(object) {
+  var pairs = _.map(object, function (value, key) {
+    return key + '="' + String(value).replace(/["\\\n]/g, '\\$&') + '"';
+  });
+
+  return pairs.length ? '{' + pairs.join(',') + '}' : '';
+}
+
+function writeHistogram(lines, name, labelObject, histogram) {
+  var seen = 0;
+  var i = 0;
+
+  // a native bucket is counted for the first bound that is not below its
+  // upper bound
+  BOUNDS.forEach(function (bound) {
+    while (i < histogram.buckets.length && histogram.buckets[i][0] / 1e3 <= bound) {
+      seen += histogram.buckets[i][1];
+      i++;
+    }
+
+    lines.push(name + '_bucket' + labels(_.assign({}, labelObject, {le: bound})) +
+               ' ' + seen);
+  });
+
+  lines.push(name + '_bucket' + labels(_.assign({}, labelObject, {le: '+Inf'})) +
+             ' ' + histogram.count);
+  lines.push(name + '_sum' + labels(labelObject) + ' ' + histogram.sum / 1e3);
+  lines.push(name + '_count' + labels(labelObject) + ' ' + histogram.count);
+}
+
+function header(lines, name, type, help) {
+  lines.push('# HELP ' + name + ' ' + help);
+  lines.push('# TYPE ' + name + ' ' + type);
+}
+
+function toPrometheus(metrics) {
+  var lines = [];
+
+  var counters = {
+    completed: 'Completed operations',
+    errors: 'Operations that failed',
+    cancelled: 'Operations that were cancelled'
+  };
+
+  _.forEach(counters, function (help, counter) {
+    var name = PREFIX + 'operations_' + counter + '_total';
+    header(lines, name, 'counter', help);
+
+    _.forEach(metrics.operations, function (operation, type) {
+      lines.push(name + labels({operation: type}) + ' ' + operation[counter]);
+    });
+  });
+
+  var histograms = {
+    queue: 'Time from submitting an operation until it started running',
+    execute: 'Time an operation ran on the threadpool',
+    callback: 'Time spent in the callback of an operation'
+  };
+
+  _.forEach(histograms, function (help, histogram) {
+    var name = PREFIX + 'operation_' + histogram + '_seconds';
+    header(lines, name, 'histogram', help);
+
+    _.forEach(metrics.operations, function (operation, type) {
+      writeHistogram(lines, name, {operation: type}, operation[histogram]);
+    });
+  });
+
+  header(lines, PREFIX + 'attach_cloexec_lock_wait_seconds', 'histogram',
+         'Time attach waited for the cloexec lock of the event loop');
+  writeHistogram(lines, PREFIX + 'attach_cloexec_lock_wait_seconds', {},
+                 metrics.attach.cloexecLockWait);
+
+  header(lines, PREFIX + 'attach_call_seconds', 'histogram',
+         'Time spent in lxc_container::attach');
+  writeHistogram(lines, PREFIX + 'attach_call_seconds', {},
+                 metrics.attach.attach);
+
+  return lines.join('\n') + '\n';
+}
+
+/**
+ * Adds `p50`, `p90`, `p99` and `p999` to all histograms of a metrics snapshot.
+ */
+exports.summarize = function (metrics) {
+  _.forEach(metrics.operations, function (operation) {
+    summarize(operation.queue);
+    summarize(operation.execute);
+    summarize(operation.callback);
+  });
+
+  summarize(metrics.attach.cloexecLockWait);
+  summarize(metrics.attach.attach);
+
+  return metrics;
+};
+
+exports.toPrometheus = toPrometheus;
@@ -0,0 +1,139 @@
+'use strict';
+
+var events = require('events');
+var util = require('util');
+
+var _ = require('lodash');
+
+var binding = require('bindings')('lxc.node');
+
+// Layout of a slot, must match Sampler::Field in src/sampler.h
+var FIELDS = [
+  'running',     // 1 if the container is running, 0 otherwise
+  'cpu',         // CPU usage in cores (1 = one core fully used)
+  'cpuSeconds',  // total CPU time in seconds
+  'memory',      // memory usage in bytes
+  'pids',        // number of tasks
+  'ioRead',      // bytes read per second
+  'ioWrite',     // bytes written per second
+  'timestamp'    // monotonic time of the sample in milliseconds
+];
+
+/**
+ * Samples cgroup statistics (CPU, memory, pids and I/O) of a set of
+ * containers on a native background thread. After every interval, the values
+ * of all containers are copied into `stats` and a `'sample'` event is emitted.
+ *
+ * Slot `i` of a container occupies `stats[i * Sampler.FIELDS.length]` and the
+ * following values, in the order given by `Sampler.FIELDS`.
+ *
+ * @class
+ * @param {Object} [options]
+ * @param {Number} [options.capacity=1024] Maximum number of containers
+ * @param {Number} [options.interval=1000] Sampling interval in milliseconds
+ */
+function Sampler(options) {
+  Sampler.super_.call(this);
+
+  options = _.defaults({}, options, {
+    capacity: 1024,
+    interval: 1000
+  });
+
+  if (binding.samplerFields !== FIELDS.length) {
+    throw new Error('Sampler layout mismatch');
+  }
+
+  this.interval = options.interval;
+  this.stats = new Float64Array(options.capacity * FIELDS.length);
+
+  this._slots = new Map();
+  this._sampler = binding.createSampler(this.stats,
+                                        this.emit.bind(this, 'sample'));
+}
+
+util.inherits(Sampler, events.EventEmitter);
+
+Sampler.FIELDS = FIELDS;
+
+/**
+ * Starts sampling.
+ */
+Sampler.prototype.start = function () {
+  this._sampler.start(this.interval);
+  return this;
+};
+
+/**
+ * Stops sampling, registered containers are kept.
+ */
+Sampler.prototype.stop = function () {
+  this._sampler.stop();
+  return this;
+};
+
+/**
+ * Registers a container and returns its slot.
+ *
+ * @param {Container} container
+ * @returns {Number}
+ */
+Sampler.prototype.add = function (container) {
+  var slot = this._slots.get(container);
+
+  if (slot === undefined) {
+    slot = this._sampler.add(container._container);
+    this._slots.set(container, slot);
+  }
+
+  return slot;
+};
+
+/**
+ * Unregisters a container. Its slot will be reused.
+ *
+ * @param {Container} container
+ */
+Sampler.prototype.remove = function (container) {
+  var slot = this._slots.get(container);
+
+  if (slot !== undefined) {
+    this._sampler.remove(slot);
+    this._slots.delete(container);
+  }
+};
+
+/**
+ * Returns the last sample of a container as an object, or `null` if the
+ * container is not registered. Reading `stats` directly avoids the
+ * allocation.
+ *
+ * @param {Container} container
+ * @returns {Object}
+ */
+Sampler.prototype.get = function (container) {
+  var slot = this._slots.get(container);
+
+  if (slot === undefined) {
+    return null;
+  }
+
+  var offset = slot * FIELDS.length;
+  var sample = {};
+
+  FIELDS.forEach(function (field, i) {
+    sample[field] = this.stats[offset + i];
+  }, this);
+
+  return sample;
+};
+
+/**
+ * Stops sampling and releases all containers.
+ */
+Sampler.prototype.close = function () {
+  this._sampler.close();
+  this._slots.clear();
+};
+
+module.exports = Sampler;
@@ -0,0 +1,63 @@
+'use strict';
+
+var events = require('events');
+var util = require('util');
+
+var binding = require('bindings')('lxc.node');
+
+/**
+ * Receives messages an attached process writes to a shared memory ring (see
+ * `include/sourcebox/shm_ring.h`). Emits a `'message'` event with a buffer
+ * for every message. The buffer is a view into the ring and is only valid
+ * until the handler returns, copy it to keep it.
+ *
+ * `'end'` is emitted once the producer closed the ring or the process exited
+ * and all messages were read, `'error'` if the producer corrupted the ring.
+ *
+ * @class
+ * @param {Number} size Size of the ring in bytes, rounded up to a power of two
+ */
+function ShmChannel(size) {
+  ShmChannel.super_.call(this);
+
+  this._channel = binding.createShmChannel(size, this._onMessage.bind(this),
+                                           this._onEnd.bind(this));
+  this._buffer = this._channel.buffer;
+
+  this.size = this._channel.capacity;
+  this.fds = this._channel.fds;
+}
+
+util.inherits(ShmChannel, events.EventEmitter);
+
+ShmChannel.prototype._onMessage = function (offset, length) {
+  var view = Buffer.from && Buffer.from !== Uint8Array.from
+    ? Buffer.from(this._buffer, offset, length)
+    : new Buffer(this._buffer, offset, length);
+
+  this.emit('message', view);
+};
+
+ShmChannel.prototype._onEnd = function (err) {
+  if (err) {
+    this.emit('error', err);
+  } else {
+    this.emit('end');
+  }
+};
+
+/**
+ * Reads the remaining messages and ends the channel.
+ */
+ShmChannel.prototype.end = function () {
+  this._channel.end();
+};
+
+/**
+ * Closes the channel right away, no more events will be emitted.
+ */
+ShmChannel.prototype.close = function () {
+  this._channel.close();
+};
+
+module.exports = ShmChannel;
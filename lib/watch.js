@@ -0,0 +1,65 @@
+'use strict';
+
+var events = require('events');
+var util = require('util');
+
+var _ = require('lodash');
+
+var binding = require('bindings')('lxc.node');
+
+/**
+ * Emits a `'state'` event with the container name and its new state
+ * (`'STOPPED'`, `'STARTING'`, `'RUNNING'`, `'STOPPING'`, `'ABORTING'`,
+ * `'FREEZING'`, `'FROZEN'` or `'THAWED'`) whenever a container under `path`
+ * changes its state, and a `'remove'` event when a container is destroyed.
+ * The current state of every container is reported once when it is
+ * discovered.
+ *
+ * A single thread watches the LXC path and the containers' cgroups with
+ * inotify, a container's state is only queried when its files change. Starts
+ * are noticed through the cgroups LXC creates, next to the host's cgroup root
+ * or next to containers that were seen running before.
+ *
+ * The LXC path is scanned again when inotify lost events, and every
+ * `interval` milliseconds as a safety net. A scan only lists the directory,
+ * it does not query the containers.
+ *
+ * @class
+ * @param {String} [path] LXC path, defaults to the system path
+ * @param {Object} [options]
+ * @param {Number} [options.interval=300000] Time between safety scans
+ */
+function Watcher(path, options) {
+  Watcher.super_.call(this);
+
+  if (_.isPlainObject(path)) {
+    options = path;
+    path = '';
+  }
+
+  options = _.defaults({}, options, {
+    interval: 300000
+  });
+
+  this._watcher = binding.watch(path || '', options.interval,
+                                this._onEvent.bind(this));
+}
+
+util.inherits(Watcher, events.EventEmitter);
+
+Watcher.prototype._onEvent = function (name, state) {
+  if (state === null) {
+    this.emit('remove', name);
+  } else {
+    this.emit('state', name, state);
+  }
+};
+
+/**
+ * Stops watching. No events will be emitted afterwards.
+ */
+Watcher.prototype.close = function () {
+  this._watcher.close();
+};
+
+module.exports = Watcher;
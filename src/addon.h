@@ -0,0 +1,95 @@
+#ifndef SOURCEBOX_ADDON_H
+#define SOURCEBOX_ADDON_H
+
+#include <atomic>
+#include <set>
+
+#include <node.h>
+#include <nan.h>
+
+class MemoryWatcher;
+class Metrics;
+class Placement;
+class Sampler;
+class Scheduler;
+class ShmChannel;
+class StartWorker;
+class SupervisedProcess;
+class Watcher;
+
+/**
+ * State of one instance of the addon. Every context that loads the addon (the
+ * main thread and each worker thread) gets its own instance, bound to the
+ * event loop of that context. It is passed as the data of all functions the
+ * addon exports.
+ */
+struct AddonData {
+    uv_loop_t *loop;
+
+    // async.cc
+    Nan::Persistent<v8::Function> operationConstructor;
+
+    // lxc.cc
+    Nan::Persistent<v8::Function> containerConstructor;
+
+    // attach.cc
+    Nan::Callback exitCallback;
+    Nan::Persistent<v8::Object> attachedProcesses;
+    uv_signal_t *sigchldHandle;
+
+    // scheduler.cc
+    Scheduler *scheduler;
+
+    // metrics.cc
+    Metrics *metrics;
+
+    // start.cc, workers that are waiting for readiness
+    std::set<StartWorker*> startWorkers;
+
+    // placement.cc
+    Placement *placement;
+
+    // sampler.cc
+    Nan::Persistent<v8::Function> samplerConstructor;
+    std::set<Sampler*> samplers;
+
+    // watch.cc
+    Nan::Persistent<v8::Function> watcherConstructor;
+    std::set<Watcher*> watchers;
+
+    // profile.cc
+    Nan::Persistent<v8::FunctionTemplate> profileTemplate;
+
+    // shm.cc
+    Nan::Persistent<v8::Function> shmChannelConstructor;
+    std::set<ShmChannel*> shmChannels;
+
+    // memory.cc
+    Nan::Persistent<v8::Function> memoryWatcherConstructor;
+    std::set<MemoryWatcher*> memoryWatchers;
+
+    // supervise.cc
+    Nan::Persistent<v8::Function> supervisedConstructor;
+    std::set<SupervisedProcess*> supervisedProcesses;
+
+    // Held by the cleanup hook and by every worker, which still run on the
+    // threadpool after the context is gone. The last reference frees the
+    // instance, see lxc.cc.
+    std::atomic<unsigned int> refs{1};
+
+    void Ref() {
+        refs.fetch_add(1);
+    }
+
+    void Unref();
+
+    v8::Local<v8::External> External() {
+        return Nan::New<v8::External>(this);
+    }
+};
+
+NAN_INLINE AddonData *GetAddonData(const Nan::FunctionCallbackInfo<v8::Value>& info) {
+    return static_cast<AddonData*>(info.Data().As<v8::External>()->Value());
+}
+
+#endif
@@ -1,11 +1,133 @@
 #include "async.h"
 
+#include "probes.h"
+
 using namespace v8;
 
-AsyncWorker::AsyncWorker(lxc_container *container, Nan::Callback *callback)
-    : Nan::AsyncWorker(callback), container_(container) { }
+static const char *cancelledMessage = "Operation cancelled";
+
+#ifdef HAVE_UV_CLOEXEC_LOCK
+static uv_once_t cloexecLockOnce = UV_ONCE_INIT;
+static uv_rwlock_t cloexecLock;
+
+static void InitCloexecLock() {
+    uv_rwlock_init(&cloexecLock);
+}
+
+// The process wide lock is always taken first.
+void CloexecReadLock(uv_loop_t *loop) {
+    uv_once(&cloexecLockOnce, InitCloexecLock);
+    uv_rwlock_rdlock(&cloexecLock);
+    uv_rwlock_rdlock(&loop->cloexec_lock);
+}
+
+void CloexecReadUnlock(uv_loop_t *loop) {
+    uv_rwlock_rdunlock(&loop->cloexec_lock);
+    uv_rwlock_rdunlock(&cloexecLock);
+}
+
+void CloexecWriteLock(uv_loop_t *loop) {
+    uv_once(&cloexecLockOnce, InitCloexecLock);
+    uv_rwlock_wrlock(&cloexecLock);
+    uv_rwlock_wrlock(&loop->cloexec_lock);
+}
+
+void CloexecWriteUnlock(uv_loop_t *loop) {
+    uv_rwlock_wrunlock(&loop->cloexec_lock);
+    uv_rwlock_wrunlock(&cloexecLock);
+}
+#endif
+
+AsyncWorker::AsyncWorker(AddonData *data, lxc_container *container,
+        Nan::Callback *callback)
+    : Nan::AsyncWorker(callback), data_(data), container_(container),
+    created_(uv_hrtime()) {
+    data_->Ref();
+}
+
+AsyncWorker::~AsyncWorker() {
+    if (!operation_.IsEmpty()) {
+        Nan::HandleScope scope;
+
+        // the handle may outlive the worker
+        Nan::SetInternalFieldPointer(Nan::New(operation_), 0, nullptr);
+        operation_.Reset();
+    }
+
+    // might free the instance if its context is already gone
+    data_->Unref();
+}
+
+void AsyncWorker::Execute() {
+    Metrics::OperationMetrics& metrics = data_->metrics->operations[OperationType()];
+    uint64_t start = uv_hrtime();
+
+    metrics.queue.Record(start - created_);
+
+    PROBE2(worker__start, Metrics::OperationName(OperationType()), key_.c_str());
+
+    // cancelled after the threadpool picked up the request
+    if (Cancelled()) {
+        SetErrorMessage(cancelledMessage);
+    } else {
+        AsyncExecute();
+    }
+
+    PROBE2(worker__done, Metrics::OperationName(OperationType()), ErrorMessage());
+
+    metrics.execute.Record(uv_hrtime() - start);
+}
+
+void AsyncWorker::WorkComplete() {
+    Metrics::OperationMetrics& metrics = data_->metrics->operations[OperationType()];
+
+    // let the next worker start before running the callback
+    data_->scheduler->Done(this);
+
+    metrics.completed.fetch_add(1, std::memory_order_relaxed);
+
+    if (ErrorMessage()) {
+        metrics.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (Cancelled()) {
+        metrics.cancelled.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t start = uv_hrtime();
+    Nan::AsyncWorker::WorkComplete();
+    metrics.callback.Record(uv_hrtime() - start);
+}
+
+void AsyncWorker::Cancel() {
+    if (cancelled_.exchange(true)) {
+        return;
+    }
+
+    // still waiting in the scheduler
+    if (data_->scheduler->Cancel(this)) {
+        return;
+    }
+
+    // on success the request completes without running Execute()
+    if (state_ == kDispatched && uv_cancel(reinterpret_cast<uv_req_t*>(&request)) == 0) {
+        SetErrorMessage(cancelledMessage);
+    }
+}
+
+Local<Object> AsyncWorker::OperationHandle() {
+    Nan::EscapableHandleScope scope;
 
-void LxcWorker::Execute() {
+    if (operation_.IsEmpty()) {
+        Local<Object> operation = Nan::New(data_->operationConstructor)->NewInstance();
+        Nan::SetInternalFieldPointer(operation, 0, this);
+        operation_.Reset(operation);
+    }
+
+    return scope.Escape(Nan::New(operation_));
+}
+
+void LxcWorker::AsyncExecute() {
     if (!lxc_container_get(container_)) {
         SetErrorMessage("Invalid container reference");
         return;
@@ -21,3 +143,49 @@ void LxcWorker::Execute() {
 
     lxc_container_put(container_);
 }
+
+void QueueWorker(const Nan::FunctionCallbackInfo<Value>& info, AsyncWorker *worker,
+        Local<Value> key) {
+    info.GetReturnValue().Set(worker->OperationHandle());
+
+    std::string name;
+
+    if (!key.IsEmpty() && key->IsString()) {
+        name = *String::Utf8Value(key);
+    }
+
+    GetAddonData(info)->scheduler->Submit(worker, name);
+}
+
+Local<Value> SchedulerKey(Local<Object> options) {
+    return options->Get(Nan::New("key").ToLocalChecked());
+}
+
+// Javascript Functions
+
+NAN_METHOD(OperationCancel) {
+    AsyncWorker *worker = static_cast<AsyncWorker*>(
+            Nan::GetInternalFieldPointer(info.Holder(), 0));
+
+    // false if the operation already completed
+    info.GetReturnValue().Set(worker != nullptr);
+
+    if (worker) {
+        worker->Cancel();
+    }
+}
+
+// Initialization
+
+void AsyncInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> constructorTemplate = Nan::New<FunctionTemplate>();
+
+    constructorTemplate->SetClassName(Nan::New("Operation").ToLocalChecked());
+    constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(constructorTemplate, "cancel", OperationCancel);
+
+    data->operationConstructor.Reset(constructorTemplate->GetFunction());
+}
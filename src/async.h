@@ -1,18 +1,85 @@
 #ifndef SOURCEBOX_ASYNC_H
 #define SOURCEBOX_ASYNC_H
 
+#include <atomic>
+#include <string>
+
 #include <node.h>
 #include <nan.h>
 #include <lxc/lxccontainer.h>
 
+#include "addon.h"
+#include "metrics.h"
+#include "scheduler.h"
+
+#if NAUV_UVVERSION >= 0x000b14
+#define HAVE_UV_CLOEXEC_LOCK
+#endif
+
+#ifdef HAVE_UV_CLOEXEC_LOCK
+/**
+ * Fds that are created without O_CLOEXEC must not leak into a process that is
+ * forked meanwhile. The read side is held while creating them, the write side
+ * while forking. Every context has its own loop, whose lock only excludes the
+ * spawns of that loop, so these also take a lock shared by the whole process.
+ */
+void CloexecReadLock(uv_loop_t *loop);
+void CloexecReadUnlock(uv_loop_t *loop);
+void CloexecWriteLock(uv_loop_t *loop);
+void CloexecWriteUnlock(uv_loop_t *loop);
+#endif
+
 class AsyncWorker : public Nan::AsyncWorker {
 public:
-    AsyncWorker(lxc_container *container, Nan::Callback *callback);
+    AsyncWorker(AddonData *data, lxc_container *container, Nan::Callback *callback);
+    ~AsyncWorker();
+
+    void Execute() final override;
+    void WorkComplete() override;
+
+    /**
+     * Removes the worker from the threadpool queue if it has not started yet,
+     * otherwise it is up to the worker to stop early. Either way, the callback
+     * receives an error unless the work was already done.
+     */
+    virtual void Cancel();
+
+    // Returns an object whose cancel() method cancels this worker.
+    v8::Local<v8::Object> OperationHandle();
+
+    // Operation type the worker's timings are recorded under.
+    virtual Metrics::Operation OperationType() const = 0;
 
 protected:
+    virtual void AsyncExecute() = 0;
+
+    bool Cancelled() const {
+        return cancelled_;
+    }
+
+    AddonData *data_;
     lxc_container *container_;
 
     bool requireDefined_ = true;
+
+private:
+    friend class Scheduler;
+
+    enum State {
+        kNew,
+        kQueued,
+        kDispatched,
+        kDone
+    };
+
+    std::atomic<bool> cancelled_{false};
+    Nan::Persistent<v8::Object> operation_;
+
+    uint64_t created_;
+
+    // set by the scheduler
+    State state_ = kNew;
+    std::string key_;
 };
 
 /**
@@ -23,10 +90,19 @@ class LxcWorker : public AsyncWorker {
 public:
     using AsyncWorker::AsyncWorker;
 
-    void Execute() final override;
-
 protected:
+    void AsyncExecute() final override;
     virtual void LxcExecute() = 0;
 };
 
+// Submits the worker to the scheduler and returns its operation handle from
+// the method. Workers without a key share the default queue.
+void QueueWorker(const Nan::FunctionCallbackInfo<v8::Value>& info, AsyncWorker *worker,
+        v8::Local<v8::Value> key = v8::Local<v8::Value>());
+
+// Reads the scheduler key from an options object.
+v8::Local<v8::Value> SchedulerKey(v8::Local<v8::Object> options);
+
+void AsyncInit(v8::Handle<v8::Object> exports, AddonData *data);
+
 #endif
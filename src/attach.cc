@@ -1,22 +1,23 @@
 #include "attach.h"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <pty.h>
 #include <sys/capability.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <utmp.h>
 
-#if NAUV_UVVERSION >= 0x000b14
-#define HAVE_UV_CLOEXEC_LOCK
-#endif
+#include <set>
 
-using namespace v8;
+#include "child_fds.h"
+#include "memfd.h"
+#include "probes.h"
 
-Nan::Callback *exitCallback = new Nan::Callback();
-static Nan::Persistent<Object> attachedProcesses;
-static uv_signal_t sigchldHandle;
+using namespace v8;
 
 static inline int SetFdFlags(int fd, int flags) {
     int oldFlags = fcntl(fd, F_GETFD);
@@ -34,10 +35,81 @@ static inline int SetFlFlags(int fd, int flags) {
     return fcntl(fd, F_SETFL, oldFlags | flags);
 }
 
-static void MaybeUnref() {
+static bool WriteAll(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t ret = write(fd, data, length);
+
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        data += ret;
+        length -= ret;
+    }
+
+    return true;
+}
+
+// Uses a sealed memfd, positioned at the start, or an unlinked file in
+// /dev/shm on kernels without memfd_create().
+int CreateInputFd(const char *data, size_t length, bool executable) {
+    int fd = MemfdCreate("sourcebox-input", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd != -1) {
+        if (!WriteAll(fd, data, length) ||
+                fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+                        F_SEAL_WRITE | F_SEAL_SEAL) == -1) {
+            close(fd);
+            return -1;
+        }
+
+        lseek(fd, 0, SEEK_SET);
+
+        return fd;
+    }
+
+#ifdef O_TMPFILE
+    fd = open("/dev/shm", O_TMPFILE | O_RDWR | O_CLOEXEC, executable ? 0700 : 0600);
+#endif
+
+    if (fd == -1) {
+        return -1;
+    }
+
+    if (!WriteAll(fd, data, length)) {
+        close(fd);
+        return -1;
+    }
+
+    // the child only gets to read
+    std::string path = "/proc/self/fd/" + std::to_string(fd);
+    int readFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    close(fd);
+
+    return readFd;
+}
+
+// Writes errno back to the parent and closes `errorFd`.
+static void WriteErrno(int errorFd) {
+    int error = errno;
+    ssize_t ret;
+
+    do {
+        ret = write(errorFd, &error, sizeof(error));
+    } while (ret == -1 && errno == EINTR);
+
+    close(errorFd);
+}
+
+static void MaybeUnref(AddonData *data) {
     Nan::HandleScope scope;
 
-    Local<Object> processes = Nan::New(attachedProcesses);
+    Local<Object> processes = Nan::New(data->attachedProcesses);
     Local<Array> pids = processes->GetOwnPropertyNames();
     int length = pids->Length();
 
@@ -49,13 +121,14 @@ static void MaybeUnref() {
         }
     }
 
-    uv_unref(reinterpret_cast<uv_handle_t*>(&sigchldHandle));
+    uv_unref(reinterpret_cast<uv_handle_t*>(data->sigchldHandle));
 }
 
 static void ReapChildren(uv_signal_t* handle, int signal) {
     Nan::HandleScope scope;
 
-    Local<Object> processes = Nan::New(attachedProcesses);
+    AddonData *data = static_cast<AddonData*>(handle->data);
+    Local<Object> processes = Nan::New(data->attachedProcesses);
     Local<Array> pids = processes->GetOwnPropertyNames();
     int length = pids->Length();
 
@@ -84,6 +157,8 @@ static void ReapChildren(uv_signal_t* handle, int signal) {
             abort();
         }
 
+        PROBE2(reap, pid, status);
+
         reaped.push_back(std::make_pair(pid, status));
     }
 
@@ -120,47 +195,105 @@ static void ReapChildren(uv_signal_t* handle, int signal) {
         };
 
         processes->Delete(pid);
-        exitCallback->Call(argc, argv);
+        data->exitCallback.Call(argc, argv);
     }
 
     if (!reaped.empty()) {
-        MaybeUnref();
+        MaybeUnref(data);
     }
 }
 
-AttachWorker::AttachWorker(lxc_container *container, Local<Object> attachedProcess,
-        AttachCommand *command, const std::string& cwd,
-        const std::vector<std::string>& env,
-        const std::vector<int>& fds, bool term, int namespaces,
-        bool cgroup, int uid, int gid)
-        : LxcWorker(container, nullptr), command_(command), cwd_(cwd),
-        fds_(fds), term_(term), cgroup_(cgroup),
-        namespaces_(namespaces), uid_(uid), gid_(gid) {
-    Nan::HandleScope scope;
+void Emit(Local<Object> attachedProcess, int argc, Local<Value> argv[]) {
+    Local<Function> emit = attachedProcess->Get(Nan::New("emit").ToLocalChecked()).As<Function>();
+    Nan::MakeCallback(attachedProcess, emit, argc, argv);
+    // ToDo: replace with 
+    /*
+        Nan::AsyncResource* async_resource;
+        async_resource = new Nan::AsyncResource("sourcebox-lxc:HandleOKCallback");
+        async_resource.runInAsyncScope(attachedProcess, emit, argc, argv);
+        delete async_resource;
+
+    */
+}
 
-    SaveToPersistent("attachedProcess", attachedProcess);
+void EmitError(Local<Object> attachedProcess, const char *message) {
+    const int argc = 2;
+    Local<Value> argv[argc] = {
+        Nan::New("error").ToLocalChecked(),
+        Nan::Error(message)
+    };
 
-    env_.resize(env.size() + 1);
-    env_.back() = nullptr;
+    Emit(attachedProcess, argc, argv);
+}
+
+AttachTask::AttachTask(AttachCommand *command,
+        const std::shared_ptr<const AttachProfile>& profile, bool term)
+        : command(command), profile(profile), term(term) {}
 
-    for (unsigned int i = 0; i < env_.size() - 1; i++) {
-        env_[i] = strdup(env[i].c_str());
+AttachTask::~AttachTask() {
+    // stdio
+    for (int fd: fds) {
+        if (fd != -1) {
+            close(fd);
+        }
     }
+
+    // command
+    delete command;
 }
 
-AttachWorker::~AttachWorker() {
-    // env
-    for (char *p: env_) {
-        free(p);
+lxc_attach_options_t AttachTask::Options() {
+    lxc_attach_options_t options = LXC_ATTACH_OPTIONS_DEFAULT;
+
+    options.initial_cwd = const_cast<char*>(profile->cwd.c_str());
+
+    options.env_policy = LXC_ATTACH_CLEAR_ENV;
+    options.extra_env_vars = const_cast<char**>(profile->env.data());
+
+    options.uid = profile->uid;
+    options.gid = profile->gid;
+
+    options.stdin_fd = fds[0];
+    options.stdout_fd = fds[1];
+    options.stderr_fd = fds[2];
+
+    if (!profile->cgroup) {
+        options.attach_flags &= ~LXC_ATTACH_MOVE_TO_CGROUP; //FIXME i think thats wrong
     }
 
-    // stdio
-    for (int fd: fds_) {
-        close(fd);
+    options.namespaces = profile->namespaces;
+
+    return options;
+}
+
+void AttachTask::ReadExecResult(int fd) {
+    int ret;
+
+    do {
+        ret = read(fd, &execErrno, sizeof(execErrno));
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret != 0) {
+        // exec failed, reap child process
+
+        do {
+            ret = waitpid(pid, nullptr, 0);
+        } while (ret == -1 && errno == EINTR);
     }
+}
 
-    // command
-    delete command_;
+AttachWorker::AttachWorker(AddonData *data, lxc_container *container,
+        Local<Array> attachedProcesses, const std::vector<AttachTask*>& tasks)
+        : LxcWorker(data, container, nullptr), tasks_(tasks) {
+    Nan::HandleScope scope;
+
+    SaveToPersistent("attachedProcesses", attachedProcesses);
+}
+
+AttachWorker::~AttachWorker() {
+    for (AttachTask *task: tasks_) {
+        delete task;
+    }
 }
 
 void AttachWorker::LxcExecute() {
@@ -169,145 +302,185 @@ void AttachWorker::LxcExecute() {
         return;
     }
 
-    lxc_attach_options_t options = LXC_ATTACH_OPTIONS_DEFAULT;
+    std::vector<lxc_attach_options_t> options;
+    std::vector<int> errorFds(tasks_.size());
 
-    options.initial_cwd = const_cast<char*>(cwd_.c_str());
+    for (unsigned int i = 0; i < tasks_.size(); i++) {
+        AttachTask *task = tasks_[i];
 
-    options.env_policy = LXC_ATTACH_CLEAR_ENV;
-    options.extra_env_vars = env_.data();
+        options.push_back(task->Options());
 
-    options.uid = uid_;
-    options.gid = gid_;
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+        errorFds[i] = fds[0];
+        task->errorFd = fds[1];
+    }
 
-    options.stdin_fd = fds_[0];
-    options.stdout_fd = fds_[1];
-    options.stderr_fd = fds_[2];
+#ifdef HAVE_UV_CLOEXEC_LOCK
+    // Acquire write lock to prevent opening new FDs in other threads. A batch
+    // takes it once for all of its processes.
+    uv_loop_t *loop = data_->loop;
+    uint64_t lockStart = uv_hrtime();
+    PROBE1(attach__lock__acquire, container_->name);
+    CloexecWriteLock(loop);
+    PROBE1(attach__lock__acquired, container_->name);
+    data_->metrics->cloexecLockWait.Record(uv_hrtime() - lockStart);
+#endif
 
-    if (!cgroup_) {
-        options.attach_flags &= ~LXC_ATTACH_MOVE_TO_CGROUP; //FIXME i think thats wrong
-    }
+    for (unsigned int i = 0; i < tasks_.size(); i++) {
+        AttachTask *task = tasks_[i];
 
-    options.namespaces = namespaces_;
+        if (Cancelled()) {
+            // do not start the rest of the batch
+            task->error = "Operation cancelled";
+            continue;
+        }
 
-    int errorFds[2];
-    socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, errorFds);
-    errorFd_ = errorFds[1];
+        uint64_t attachStart = uv_hrtime();
+        PROBE2(attach__start, container_->name, task->command->Name());
+        int ret = container_->attach(container_, AttachTask::Main, task, &options[i], &task->pid);
+        PROBE3(attach__done, container_->name, ret, task->pid);
+        data_->metrics->attach.Record(uv_hrtime() - attachStart);
+
+        if (ret == -1) {
+            task->error = "Could not attach to container";
+        }
+    }
 
 #ifdef HAVE_UV_CLOEXEC_LOCK
-    // Acquire write lock to prevent opening new FDs in other threads.
-    uv_loop_t *loop = uv_default_loop();
-    uv_rwlock_wrlock(&loop->cloexec_lock);
+    CloexecWriteUnlock(loop);
+    PROBE1(attach__lock__release, container_->name);
 #endif
 
-    int ret = container_->attach(container_, AttachFunction, this, &options, &pid_);
+    for (AttachTask *task: tasks_) {
+        close(task->errorFd);
+    }
 
-#ifdef HAVE_UV_CLOEXEC_LOCK
-    uv_rwlock_wrunlock(&loop->cloexec_lock);
-#endif
+    // the children exec concurrently, collect their results in order
+    for (unsigned int i = 0; i < tasks_.size(); i++) {
+        AttachTask *task = tasks_[i];
 
-    close(errorFds[1]);
+        if (!task->error) {
+            task->ReadExecResult(errorFds[i]);
 
-    if (ret == -1) {
-        SetErrorMessage("Could not attach to container");
-    } else {
-        do {
-            ret = read(errorFds[0], &execErrno_, sizeof(execErrno_));
-        } while (ret == -1 && errno == EINTR);
+            if (task->execErrno == 0 && Cancelled()) {
+                // cancelled while attaching, the process is not registered yet
+                kill(task->pid, SIGKILL);
+
+                int ret;
 
-        if (ret != 0) {
-            // exec failed, reap child process
+                do {
+                    ret = waitpid(task->pid, nullptr, 0);
+                } while (ret == -1 && errno == EINTR);
 
-            do {
-                ret = waitpid(pid_, nullptr, 0);
-            } while (ret == -1 && errno == EINTR);
+                task->error = "Operation cancelled";
+            }
         }
+
+        close(errorFds[i]);
     }
 
-    close(errorFds[0]);
+    // a single process that failed fails the operation
+    if (tasks_.size() == 1 && tasks_[0]->error) {
+        SetErrorMessage(tasks_[0]->error);
+    }
 }
 
 void AttachWorker::HandleOKCallback() {
     Nan::HandleScope scope;
 
-    Local<Object> attachedProcess = GetFromPersistent("attachedProcess")->ToObject();
-    Local<Uint32> pid = Nan::New<Uint32>(pid_);
-
-    attachedProcess->Set(Nan::New("pid").ToLocalChecked(), pid);
+    Local<Object> attachedProcesses = GetFromPersistent("attachedProcesses")->ToObject();
+    Local<Object> processes = Nan::New(data_->attachedProcesses);
+    bool attached = false;
 
-    if (execErrno_ == 0) {
-        Local<Object> processes = Nan::New(attachedProcesses);
-        processes->Set(pid_, attachedProcess);
+    for (unsigned int i = 0; i < tasks_.size(); i++) {
+        AttachTask *task = tasks_[i];
+        Local<Object> attachedProcess = attachedProcesses->Get(i)->ToObject();
 
-        if (attachedProcess->Get(Nan::New("_ref").ToLocalChecked())->BooleanValue()) {
-            uv_ref(reinterpret_cast<uv_handle_t*>(&sigchldHandle));
+        if (task->error) {
+            EmitError(attachedProcess, task->error);
+            continue;
         }
 
-        const int argc = 2;
-        Local<Value> argv[argc] = {
-            Nan::New("attach").ToLocalChecked(),
-            pid
-        };
+        Local<Uint32> pid = Nan::New<Uint32>(task->pid);
 
-        Local<Function> emit = attachedProcess->Get(Nan::New("emit").ToLocalChecked()).As<Function>();
-        Nan::MakeCallback(attachedProcess, emit, argc, argv);
-        // ToDo: replace with 
-        /*
-            Nan::AsyncResource* async_resource;
-            async_resource = new Nan::AsyncResource("sourcebox-lxc:HandleOKCallback");
-            async_resource.runInAsyncScope(attachedProcess, emit, argc, argv);
-            delete async_resource;
-
-        */
-        ReapChildren(nullptr, 0);
-    } else {
-        // Attaching was successful but exec failed
+        attachedProcess->Set(Nan::New("pid").ToLocalChecked(), pid);
 
-        const int argc = 2;
-        Local<Value> argv[argc] = {
-            attachedProcess,
-            Nan::New<Int32>(-execErrno_)
-        };
+        if (task->execErrno == 0) {
+            processes->Set(task->pid, attachedProcess);
+            attached = true;
+
+            if (attachedProcess->Get(Nan::New("_ref").ToLocalChecked())->BooleanValue()) {
+                uv_ref(reinterpret_cast<uv_handle_t*>(data_->sigchldHandle));
+            }
 
-        exitCallback->Call(argc, argv);
+            if (Cancelled()) {
+                // cancelled after the worker finished, reaped as usual
+                kill(task->pid, SIGKILL);
+            }
+
+            const int argc = 2;
+            Local<Value> argv[argc] = {
+                Nan::New("attach").ToLocalChecked(),
+                pid
+            };
+
+            Emit(attachedProcess, argc, argv);
+        } else {
+            // Attaching was successful but exec failed
+
+            const int argc = 2;
+            Local<Value> argv[argc] = {
+                attachedProcess,
+                Nan::New<Int32>(-task->execErrno)
+            };
+
+            data_->exitCallback.Call(argc, argv);
+        }
+    }
+
+    if (attached) {
+        ReapChildren(data_->sigchldHandle, 0);
     }
 }
 
 void AttachWorker::HandleErrorCallback() {
     Nan::HandleScope scope;
 
-    Local<Object> attachedProcess = GetFromPersistent("attachedProcess")->ToObject();
-
-    const int argc = 2;
-    Local<Value> argv[argc] = {
-        Nan::New("error").ToLocalChecked(),
-        Nan::Error(ErrorMessage())
-    };
+    Local<Object> attachedProcesses = GetFromPersistent("attachedProcesses")->ToObject();
 
-    Local<Function> emit = attachedProcess->Get(Nan::New("emit").ToLocalChecked()).As<Function>();
-    Nan::MakeCallback(attachedProcess, emit, argc, argv);
+    for (unsigned int i = 0; i < tasks_.size(); i++) {
+        const char *error = tasks_[i]->error ? tasks_[i]->error : ErrorMessage();
+        EmitError(attachedProcesses->Get(i)->ToObject(), error);
+    }
 }
 
 // This method gets called within the container
-int AttachWorker::AttachFunction(void *payload) {
-    AttachWorker *worker = static_cast<AttachWorker*>(payload);
+int AttachTask::Main(void *payload) {
+    AttachTask *task = static_cast<AttachTask*>(payload);
 
-    auto& fds = worker->fds_;
+    auto& fds = task->fds;
 
-    if (worker->term_) {
+    PROBE1(attach__child, getpid());
+
+    if (task->term) {
         login_tty(0);
     } else {
         setsid();
     }
 
-    for (unsigned int i = 3; i < fds.size(); i++) {
-        unsigned int fd = fds[i];
-        dup2(fd, i);
-        if (fd != i) {
-            close(fd);
-        }
+    // above every fd number the child uses, see SetupChildFds()
+    task->command->MoveFds(fds.size());
+
+    SetupChildFds(fds, { &task->errorFd });
+
+    // reported like a failed exec
+    if (!task->profile->Apply()) {
+        WriteErrno(task->errorFd);
+        return 127;
     }
 
-    return worker->command_->Attach(worker->errorFd_);
+    return task->command->Attach(task->errorFd);
 }
 
 int AttachCommand::Attach(int errorFd) {
@@ -338,23 +511,40 @@ ExecCommand::~ExecCommand() {
     }
 }
 
-int ExecCommand::Attach(int errorFd) {
+void ExecCommand::Exec() {
     execvp(args_.front(), args_.data());
+}
 
-    // at this point execvp has failed
-    int execErrno = errno;
-    ssize_t ret;
-
-    do {
-        // write the exec errno back to the parent
-        ret = write(errorFd, &execErrno, sizeof(execErrno));
-    } while (ret == -1 && errno == EINTR);
+int ExecCommand::Attach(int errorFd) {
+    Exec();
 
-    close(errorFd);
+    // at this point exec has failed
+    WriteErrno(errorFd);
 
     return 127;
 }
 
+FdExecCommand::~FdExecCommand() {
+    close(fd_);
+}
+
+void FdExecCommand::MoveFds(int minFd) {
+    fd_ = fcntl(fd_, F_DUPFD_CLOEXEC, minFd);
+}
+
+void FdExecCommand::Exec() {
+#ifdef SYS_execveat
+    syscall(SYS_execveat, fd_, "", args_.data(), environ, AT_EMPTY_PATH);
+
+    if (errno != ENOSYS) {
+        return;
+    }
+#endif
+
+    // needs /proc within the container
+    fexecve(fd_, args_.data(), environ);
+}
+
 int OpenCommand::Attach() {
     InitialCleanup();
 
@@ -420,19 +610,70 @@ void OpenCommand::InitialCleanup() {
     }
 }
 
-void CreateFds(Local<Value> streams, Local<Value> term,
+bool ValidStdio(Local<Value> stdio) {
+    if (stdio->IsUndefined()) {
+        return true;
+    }
+
+    if (!stdio->IsArray() || stdio.As<Array>()->Length() < 3) {
+        return false;
+    }
+
+    Local<Array> modes = stdio.As<Array>();
+
+    for (unsigned int i = 0; i < modes->Length(); i++) {
+        Local<Value> mode = modes->Get(i);
+
+        if (mode->IsUint32() || node::Buffer::HasInstance(mode)) {
+            continue;
+        }
+
+        std::string name = *String::Utf8Value(mode);
+
+        if (name != "pipe" && name != "ignore" && name != "null") {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void CloseFds(std::vector<int>& fds) {
+    std::set<int> closed;
+
+    for (int fd : fds) {
+        if (fd != -1 && closed.insert(fd).second) {
+            close(fd);
+        }
+    }
+
+    fds.clear();
+}
+
+bool CreateFds(AddonData *data, Local<Value> stdio, Local<Value> term,
         std::vector<int>& childFds, std::vector<int>& parentFds) {
     Nan::HandleScope scope;
 
-    int count = 3;
-    int pos = 0; // TODO iterator?
+    Local<Array> modes;
 
-    if (streams->IsUint32()) {
-        count += streams->Uint32Value();
+    if (stdio->IsArray()) {
+        modes = stdio.As<Array>();
+    } else {
+        modes = Nan::New<Array>(3);
+
+        for (int i = 0; i < 3; i++) {
+            modes->Set(i, Nan::New("pipe").ToLocalChecked());
+        }
     }
 
-    childFds.resize(count);
-    parentFds.resize(count);
+    int count = modes->Length();
+    int pos = 0; // TODO iterator?
+
+    PROBE2(create__fds__start, count, term->BooleanValue());
+
+    // only pipes have a parent end
+    childFds.assign(count, -1);
+    parentFds.assign(count, -1);
 
     if (term->BooleanValue()) {
         int master, slave;
@@ -451,19 +692,27 @@ void CreateFds(Local<Value> streams, Local<Value> term,
 #ifdef HAVE_UV_CLOEXEC_LOCK
         // Acquire read lock to prevent the file descriptor from leaking to
         // other processes before the FD_CLOEXEC flag is set.
-        uv_loop_t *loop = uv_default_loop();
-        uv_rwlock_rdlock(&loop->cloexec_lock);
+        uv_loop_t *loop = data->loop;
+        CloexecReadLock(loop);
 #endif
 
-        openpty(&master, &slave, nullptr, nullptr, &size);
+        int ret = openpty(&master, &slave, nullptr, nullptr, &size);
 
-        SetFdFlags(master, FD_CLOEXEC);
-        SetFdFlags(slave, FD_CLOEXEC);
+        if (ret == 0) {
+            SetFdFlags(master, FD_CLOEXEC);
+            SetFdFlags(slave, FD_CLOEXEC);
+        }
 
 #ifdef HAVE_UV_CLOEXEC_LOCK
-        uv_rwlock_rdunlock(&loop->cloexec_lock);
+        CloexecReadUnlock(loop);
 #endif
 
+        if (ret == -1) {
+            childFds.clear();
+            parentFds.clear();
+            return false;
+        }
+
         SetFlFlags(master, O_NONBLOCK);
 
         for (/* reusing pos */; pos < 3; pos++) {
@@ -473,12 +722,49 @@ void CreateFds(Local<Value> streams, Local<Value> term,
     }
 
     for (/* reusing pos */; pos < count; pos++) {
-        int fds[2];
-        socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
-        SetFlFlags(fds[0], O_NONBLOCK);
-        parentFds[pos] = fds[0];
-        childFds[pos] = fds[1];
+        Local<Value> mode = modes->Get(pos);
+
+        if (node::Buffer::HasInstance(mode)) {
+            // input, read from a copy in memory
+            childFds[pos] = CreateInputFd(node::Buffer::Data(mode),
+                    node::Buffer::Length(mode));
+        } else if (mode->IsUint32()) {
+            // passed through, our duplicate is closed with the task
+            childFds[pos] = fcntl(mode->Uint32Value(), F_DUPFD_CLOEXEC, 3);
+        } else {
+            std::string name = *String::Utf8Value(mode);
+
+            if (name == "ignore") {
+                // opened within the container, see AttachTask::Main()
+                continue;
+            } else if (name == "null") {
+                childFds[pos] = open("/dev/null", O_RDWR | O_CLOEXEC);
+            } else {
+                int fds[2];
+
+                if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0) {
+                    SetFlFlags(fds[0], O_NONBLOCK);
+                    parentFds[pos] = fds[0];
+                    childFds[pos] = fds[1];
+                }
+            }
+        }
+
+        // -1 would be taken for 'ignore'
+        if (childFds[pos] == -1) {
+            int err = errno;
+
+            CloseFds(childFds);
+            CloseFds(parentFds);
+
+            errno = err;
+            return false;
+        }
     }
+
+    PROBE1(create__fds__done, count);
+
+    return true;
 }
 
 // Javascript Functions
@@ -488,10 +774,11 @@ NAN_METHOD(Ref) {
         return Nan::ThrowTypeError("Invalid argument");
     }
 
-    Local<Object> processes = Nan::New(attachedProcesses);
+    AddonData *data = GetAddonData(info);
+    Local<Object> processes = Nan::New(data->attachedProcesses);
 
     if (processes->Has(info[0]->Uint32Value())) {
-        uv_ref(reinterpret_cast<uv_handle_t*>(&sigchldHandle));
+        uv_ref(reinterpret_cast<uv_handle_t*>(data->sigchldHandle));
     }
 }
 
@@ -500,10 +787,11 @@ NAN_METHOD(Unref) {
         return Nan::ThrowTypeError("Invalid argument");
     }
 
-    Local<Object> processes = Nan::New(attachedProcesses);
+    AddonData *data = GetAddonData(info);
+    Local<Object> processes = Nan::New(data->attachedProcesses);
 
     if (processes->Has(info[0]->Uint32Value())) {
-        MaybeUnref();
+        MaybeUnref(data);
     }
 }
 
@@ -530,28 +818,42 @@ NAN_METHOD(SetExitCallback) {
         return Nan::ThrowTypeError("Invalid argument");
     }
 
-    exitCallback->SetFunction(info[0].As<Function>());
+    GetAddonData(info)->exitCallback.SetFunction(info[0].As<Function>());
 }
 
 // Initialization
 
-void AttachInit(Handle<Object> exports) {
+void AttachInit(Handle<Object> exports, AddonData *data) {
     Nan::HandleScope scope;
 
-    attachedProcesses.Reset(Nan::New<Object>());
+    data->attachedProcesses.Reset(Nan::New<Object>());
 
-    // SIGCHLD handling
-    uv_signal_init(uv_default_loop(), &sigchldHandle);
-    uv_signal_start(&sigchldHandle, ReapChildren, SIGCHLD);
-    uv_unref(reinterpret_cast<uv_handle_t*>(&sigchldHandle));
+    // SIGCHLD handling, every loop gets its own handle and only reaps the
+    // processes it attached
+    data->sigchldHandle = new uv_signal_t;
+    data->sigchldHandle->data = data;
+    uv_signal_init(data->loop, data->sigchldHandle);
+    uv_signal_start(data->sigchldHandle, ReapChildren, SIGCHLD);
+    uv_unref(reinterpret_cast<uv_handle_t*>(data->sigchldHandle));
 
     // Exports
+    Local<External> external = data->External();
+
     exports->Set(Nan::New("ref").ToLocalChecked(),
-            Nan::New<FunctionTemplate>(Ref)->GetFunction());
+            Nan::New<FunctionTemplate>(Ref, external)->GetFunction());
     exports->Set(Nan::New("unref").ToLocalChecked(),
-            Nan::New<FunctionTemplate>(Unref)->GetFunction());
+            Nan::New<FunctionTemplate>(Unref, external)->GetFunction());
     exports->Set(Nan::New("resize").ToLocalChecked(),
             Nan::New<FunctionTemplate>(Resize)->GetFunction());
     exports->Set(Nan::New("setExitCallback").ToLocalChecked(),
-            Nan::New<FunctionTemplate>(SetExitCallback)->GetFunction());
+            Nan::New<FunctionTemplate>(SetExitCallback, external)->GetFunction());
+}
+
+void AttachCleanup(AddonData *data) {
+    uv_close(reinterpret_cast<uv_handle_t*>(data->sigchldHandle), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_signal_t*>(handle);
+    });
+
+    data->attachedProcesses.Reset();
+    data->exitCallback.Reset();
 }
@@ -1,9 +1,11 @@
 #ifndef SOURCEBOX_ATTACH_H
 #define SOURCEBOX_ATTACH_H
 
+#include <memory>
 #include <vector>
 
 #include "async.h"
+#include "profile.h"
 
 class AttachCommand {
 public:
@@ -11,38 +13,70 @@ public:
 
     virtual int Attach(int errorFd);
     virtual int Attach();
+
+    // Runs within the container before the stdio is set up. Moves the fds
+    // the command still needs to `minFd` or above.
+    virtual void MoveFds(int minFd) {}
+
+    // Shown in traces
+    virtual const char *Name() const {
+        return "";
+    }
 };
 
+/**
+ * One process to attach. The worker owns its tasks and fills in the results.
+ */
+struct AttachTask {
+    AttachTask(AttachCommand *command,
+            const std::shared_ptr<const AttachProfile>& profile, bool term);
+
+    ~AttachTask();
+
+    // Attach options that refer to this task, valid as long as it lives.
+    lxc_attach_options_t Options();
+
+    // Reads the exec result of the attached child from `fd`, the other end
+    // of `errorFd`. The child is reaped if exec failed.
+    void ReadExecResult(int fd);
+
+    // Runs within the container, the payload is the task.
+    static int Main(void *payload);
+
+    AttachCommand *command;
+    std::shared_ptr<const AttachProfile> profile;
+    std::vector<int> fds;
+    bool term;
+
+    // results
+    int pid = 0;
+    int execErrno = 0;
+    int errorFd = -1;
+    const char *error = nullptr;
+};
+
+/**
+ * Attaches one or more processes to a container. A batch shares the checks
+ * of the container and a single acquisition of the cloexec lock.
+ */
 class AttachWorker : public LxcWorker {
 public:
-    AttachWorker(lxc_container *container, v8::Local<v8::Object> attachedProcess,
-            AttachCommand *command, const std::string& cwd,
-            const std::vector<std::string>& env,
-            const std::vector<int>& fds, bool term,
-            int namespaces, bool cgroup, int uid, int gid);
+    AttachWorker(AddonData *data, lxc_container *container,
+            v8::Local<v8::Array> attachedProcesses,
+            const std::vector<AttachTask*>& tasks);
 
     ~AttachWorker();
 
+    Metrics::Operation OperationType() const override {
+        return Metrics::kAttach;
+    }
+
 private:
     void LxcExecute() override;
     void HandleOKCallback() override;
     void HandleErrorCallback() override;
 
-    static int AttachFunction(void *payload);
-
-    int pid_;
-    int execErrno_ = 0;
-
-    AttachCommand *command_;
-    std::string cwd_;
-    std::vector<char*> env_;
-    std::vector<int> fds_;
-    bool term_;
-    bool cgroup_;
-    int namespaces_;
-    int uid_;
-    int gid_;
-    int errorFd_;
+    std::vector<AttachTask*> tasks_;
 };
 
 class ExecCommand : public AttachCommand {
@@ -54,10 +88,43 @@ public:
 
     int Attach(int errorFd) override;
 
-private:
+    const char *Name() const override {
+        return args_.front();
+    }
+
+    // argv, terminated by nullptr
+    const std::vector<char*>& Arguments() const {
+        return args_;
+    }
+
+protected:
+    // Only returns if exec failed.
+    virtual void Exec();
+
     std::vector<char*> args_;
 };
 
+/**
+ * Executes a binary from a host fd, e.g. a memfd, instead of a path within
+ * the container. `name` becomes argv[0].
+ */
+class FdExecCommand : public ExecCommand {
+public:
+    FdExecCommand(int fd, const std::string& name,
+            const std::vector<std::string>& args)
+        : ExecCommand(name, args), fd_(fd) {}
+
+    ~FdExecCommand();
+
+    void MoveFds(int minFd) override;
+
+protected:
+    void Exec() override;
+
+private:
+    int fd_;
+};
+
 class OpenCommand : public AttachCommand {
 public:
     OpenCommand(const std::string& path, int flags, int mode)
@@ -65,6 +132,10 @@ public:
 
     int Attach() override;
 
+    const char *Name() const override {
+        return path_.c_str();
+    }
+
 private:
     static void InitialCleanup();
 
@@ -73,9 +144,30 @@ private:
     int mode_;
 };
 
-void CreateFds(v8::Local<v8::Value> streams, v8::Local<v8::Value> term,
+// Returns a read only fd with a copy of `data`, -1 on failure.
+int CreateInputFd(const char *data, size_t length, bool executable = false);
+
+// Emits an event on an AttachedProcess, argv[0] is the event name.
+void Emit(v8::Local<v8::Object> attachedProcess, int argc, v8::Local<v8::Value> argv[]);
+
+// Emits an 'error' event on an AttachedProcess.
+void EmitError(v8::Local<v8::Object> attachedProcess, const char *message);
+
+// Checks a stdio array of 'pipe', 'ignore', 'null', host fds or buffers to
+// read from, undefined means three pipes.
+bool ValidStdio(v8::Local<v8::Value> stdio);
+
+// Creates the fds of a stdio array. Only pipes have a parent fd, the others
+// are -1. An ignored fd is -1 on both sides and opened within the container.
+// Returns false with errno set on failure, nothing is left open then.
+bool CreateFds(AddonData *data, v8::Local<v8::Value> stdio, v8::Local<v8::Value> term,
         std::vector<int>& childFds, std::vector<int>& parentFds);
 
-void AttachInit(v8::Handle<v8::Object> exports);
+// Closes fds created by CreateFds(), a terminal shared by several entries is
+// closed once.
+void CloseFds(std::vector<int>& fds);
+
+void AttachInit(v8::Handle<v8::Object> exports, AddonData *data);
+void AttachCleanup(AddonData *data);
 
 #endif
@@ -0,0 +1,313 @@
+#include "bulk.h"
+
+#include <dirent.h>
+#include <ftw.h>
+#include <linux/magic.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <deque>
+#include <set>
+
+#include "parallel.h"
+#include "placement.h"
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+using namespace v8;
+
+// Rootfs reaper
+
+static uv_once_t reaperOnce = UV_ONCE_INIT;
+static uv_mutex_t reaperMutex;
+static uv_cond_t reaperCond;
+static std::deque<std::string> reaperQueue;
+static std::set<std::string> trashDirs;
+
+// suffix of rootfs that are still waiting for destroy(), never reaped
+static const std::string kPending = ".pending";
+
+static bool IsPending(const std::string& name) {
+    return name.size() >= kPending.size() &&
+        name.compare(name.size() - kPending.size(), kPending.size(), kPending) == 0;
+}
+
+static int RemoveEntry(const char *path, const struct stat *, int, FTW *) {
+    remove(path);
+    return 0;
+}
+
+static void Reap(void *) {
+    // Use the lowest CPU and I/O priority. Both only apply to this thread.
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+    uv_mutex_lock(&reaperMutex);
+
+    for (;;) {
+        while (reaperQueue.empty()) {
+            uv_cond_wait(&reaperCond, &reaperMutex);
+        }
+
+        std::string path = reaperQueue.front();
+        reaperQueue.pop_front();
+
+        uv_mutex_unlock(&reaperMutex);
+
+        // do not cross into other file systems, e.g. left over bind mounts
+        nftw(path.c_str(), RemoveEntry, 64, FTW_DEPTH | FTW_PHYS | FTW_MOUNT);
+
+        uv_mutex_lock(&reaperMutex);
+    }
+}
+
+static void StartReaper() {
+    uv_mutex_init(&reaperMutex);
+    uv_cond_init(&reaperCond);
+
+    uv_thread_t thread;
+    uv_thread_create(&thread, Reap, nullptr);
+}
+
+static void ReapLater(const std::string& trash, const std::string& path) {
+    uv_once(&reaperOnce, StartReaper);
+
+    uv_mutex_lock(&reaperMutex);
+
+    DIR *dir;
+
+    if (trashDirs.insert(trash).second && (dir = opendir(trash.c_str()))) {
+        // first use of this trash directory, also pick up whatever was left
+        // over by earlier processes (including `path`)
+        dirent *de;
+
+        while ((de = readdir(dir))) {
+            if (strcmp(de->d_name, ".") != 0 && strcmp(de->d_name, "..") != 0
+                    && !IsPending(de->d_name)) {
+                reaperQueue.push_back(trash + "/" + de->d_name);
+            }
+        }
+
+        closedir(dir);
+
+        if (IsPending(path)) {
+            reaperQueue.push_back(path);
+        }
+    } else {
+        reaperQueue.push_back(path);
+    }
+
+    uv_cond_signal(&reaperCond);
+    uv_mutex_unlock(&reaperMutex);
+}
+
+bool TrashRootfs(lxc_container *container, std::string& rootfs, std::string& trashed) {
+    rootfs.clear();
+
+    // lxc.rootfs was renamed to lxc.rootfs.path in LXC 2.1
+    for (const char *key : { "lxc.rootfs.path", "lxc.rootfs" }) {
+        int len = container->get_config_item(container, key, nullptr, 0);
+
+        if (len > 0) {
+            rootfs.resize(len + 1);
+            container->get_config_item(container, key, &rootfs[0], len + 1);
+            rootfs.resize(len);
+            break;
+        }
+    }
+
+    if (rootfs.compare(0, 4, "dir:") == 0) {
+        rootfs = rootfs.substr(4);
+    }
+
+    // all other backends use a "type:" prefix
+    if (rootfs.empty() || rootfs[0] != '/') {
+        return false;
+    }
+
+    // btrfs subvolumes can not be deleted like directories
+    struct statfs fs;
+
+    if (statfs(rootfs.c_str(), &fs) != 0 || fs.f_type == BTRFS_SUPER_MAGIC) {
+        return false;
+    }
+
+    std::string trash = std::string(container->config_path) + "/.trash";
+
+    if (mkdir(trash.c_str(), 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    std::string target = trash + "/" + container->name + "." +
+        std::to_string(uv_hrtime()) + kPending;
+
+    // fails with EXDEV if the rootfs is on a different file system
+    if (rename(rootfs.c_str(), target.c_str()) != 0) {
+        return false;
+    }
+
+    // destroy() expects the rootfs to exist
+    if (mkdir(rootfs.c_str(), 0755) != 0) {
+        rename(target.c_str(), rootfs.c_str());
+        return false;
+    }
+
+    trashed = target;
+
+    return true;
+}
+
+void ReapRootfs(const std::string& trashed) {
+    std::string path = trashed.substr(0, trashed.size() - kPending.size());
+
+    // a pending rootfs is not picked up by the reaper
+    if (rename(trashed.c_str(), path.c_str()) != 0) {
+        path = trashed;
+    }
+
+    ReapLater(path.substr(0, path.rfind('/')), path);
+}
+
+bool RestoreRootfs(const std::string& rootfs, const std::string& trashed) {
+    // destroy() might have removed the empty rootfs already
+    if (rmdir(rootfs.c_str()) != 0 && errno != ENOENT) {
+        return false;
+    }
+
+    return rename(trashed.c_str(), rootfs.c_str()) == 0;
+}
+
+// Worker
+
+BulkWorker::BulkWorker(AddonData *data, Nan::Callback *callback, Operation operation,
+        const std::vector<std::string>& names, const std::string& path,
+        Local<Object> options)
+        : AsyncWorker(data, nullptr, callback), operation_(operation), names_(names),
+        path_(path), errors_(names.size()) {
+    Nan::HandleScope scope;
+
+    Local<Value> concurrency = options->Get(Nan::New("concurrency").ToLocalChecked());
+    if (concurrency->IsUint32()) {
+        concurrency_ = concurrency->Uint32Value();
+    }
+
+    Local<Value> timeout = options->Get(Nan::New("timeoutMs").ToLocalChecked());
+    if (timeout->IsUint32()) {
+        timeout_ = timeout->Uint32Value();
+    }
+
+    force_ = options->Get(Nan::New("force").ToLocalChecked())->IsTrue();
+    fast_ = options->Get(Nan::New("fast").ToLocalChecked())->IsTrue();
+}
+
+void BulkWorker::AsyncExecute() {
+    const char *path = path_.empty() ? nullptr : path_.c_str();
+
+    ParallelFor(names_.size(), concurrency_, [this, path](size_t i) {
+        // containers that were not touched yet are left alone
+        if (Cancelled()) {
+            errors_[i] = "Operation cancelled";
+            return;
+        }
+
+        lxc_container *container = lxc_container_new(names_[i].c_str(), path);
+
+        if (!container) {
+            errors_[i] = "Failed to create container";
+            return;
+        }
+
+        if (!container->may_control(container)) {
+            errors_[i] = "Insufficient privileges to control container";
+        } else if (!container->is_defined(container)) {
+            errors_[i] = "Container is not defined";
+        } else if (operation_ == kStop) {
+            errors_[i] = Stop(container);
+        } else {
+            errors_[i] = Destroy(container);
+        }
+
+        if (errors_[i].empty()) {
+            data_->placement->Release(container);
+        }
+
+        lxc_container_put(container);
+    });
+}
+
+std::string BulkWorker::Stop(lxc_container *container) {
+    if (!container->is_running(container)) {
+        return "";
+    }
+
+    // shutdown() takes whole seconds, fall back to killing the container
+    if (!force_ && timeout_ > 0 &&
+            container->shutdown(container, (timeout_ + 999) / 1000)) {
+        return "";
+    }
+
+    if (!container->stop(container)) {
+        return "Failed to stop container";
+    }
+
+    return "";
+}
+
+std::string BulkWorker::Destroy(lxc_container *container) {
+    if (container->is_running(container)) {
+        if (!force_) {
+            return "Container is running";
+        }
+
+        if (!container->stop(container)) {
+            return "Failed to stop container";
+        }
+    }
+
+    std::string rootfs, trashed;
+
+    // if the rootfs can not be moved, destroy() deletes it as usual
+    bool trash = fast_ && TrashRootfs(container, rootfs, trashed);
+
+    if (!container->destroy(container)) {
+        if (trash && !RestoreRootfs(rootfs, trashed)) {
+            return "Failed to destroy container, its rootfs was moved to " + trashed;
+        }
+
+        return "Failed to destroy container";
+    }
+
+    if (trash) {
+        ReapRootfs(trashed);
+    }
+
+    return "";
+}
+
+void BulkWorker::HandleOKCallback() {
+    Nan::HandleScope scope;
+
+    Local<Array> errors = Nan::New<Array>(errors_.size());
+
+    for (unsigned int i = 0; i < errors_.size(); i++) {
+        if (errors_[i].empty()) {
+            errors->Set(i, Nan::Null());
+        } else {
+            errors->Set(i, Nan::Error(errors_[i].c_str()));
+        }
+    }
+
+    const int argc = 2;
+    Local<Value> argv[argc] = {
+        Nan::Null(),
+        errors
+    };
+
+    callback->Call(argc, argv);
+}
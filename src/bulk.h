@@ -0,0 +1,66 @@
+#ifndef SOURCEBOX_BULK_H
+#define SOURCEBOX_BULK_H
+
+#include <string>
+#include <vector>
+
+#include "async.h"
+
+/**
+ * Stops or destroys a list of containers with bounded parallelism.
+ */
+class BulkWorker : public AsyncWorker {
+public:
+    enum Operation {
+        kStop,
+        kDestroy
+    };
+
+    BulkWorker(AddonData *data, Nan::Callback *callback, Operation operation,
+            const std::vector<std::string>& names, const std::string& path,
+            v8::Local<v8::Object> options);
+
+    Metrics::Operation OperationType() const override {
+        return operation_ == kStop ? Metrics::kStopAll : Metrics::kDestroyAll;
+    }
+
+private:
+    void AsyncExecute() override;
+    void HandleOKCallback() override;
+
+    std::string Stop(lxc_container *container);
+    std::string Destroy(lxc_container *container);
+
+    Operation operation_;
+    std::vector<std::string> names_;
+    std::string path_;
+
+    unsigned int concurrency_ = 8;
+    unsigned int timeout_ = 0;
+    bool force_ = false;
+    bool fast_ = false;
+
+    // error message per container, empty on success
+    std::vector<std::string> errors_;
+};
+
+/**
+ * Moves the rootfs of a dir backed container into a trash directory next to
+ * the container and leaves an empty directory for destroy(). Returns false if
+ * the rootfs could not be moved. Once destroy() returned, the rootfs is
+ * passed to ReapRootfs() or RestoreRootfs().
+ */
+bool TrashRootfs(lxc_container *container, std::string& rootfs, std::string& trashed);
+
+/**
+ * Deletes a trashed rootfs on a background thread with idle I/O priority.
+ */
+void ReapRootfs(const std::string& trashed);
+
+/**
+ * Moves a trashed rootfs back after destroy() failed. Returns false if that
+ * failed too, the rootfs is then kept in the trash.
+ */
+bool RestoreRootfs(const std::string& rootfs, const std::string& trashed);
+
+#endif
@@ -0,0 +1,132 @@
+#include "cgroup.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <limits>
+#include <sstream>
+
+// Finds the first cgroup2 mount in a mountinfo file and returns its root and
+// mount point.
+static bool FindCgroup2Mount(const std::string& mountinfo, std::string& root,
+        std::string& mountPoint) {
+    std::string content;
+
+    if (!ReadFile(mountinfo, content)) {
+        return false;
+    }
+
+    std::istringstream lines(content);
+    std::string line;
+
+    while (std::getline(lines, line)) {
+        size_t separator = line.find(" - ");
+
+        if (separator == std::string::npos ||
+                line.compare(separator + 3, 8, "cgroup2 ") != 0) {
+            continue;
+        }
+
+        // id parent major:minor root mount-point ...
+        std::istringstream fields(line.substr(0, separator));
+        std::string id, parent, device;
+
+        if (fields >> id >> parent >> device >> root >> mountPoint) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const std::string& HostCgroupMount() {
+    // C++11 guarantees thread safe initialization
+    static const std::string mountPoint = [] {
+        std::string root, mountPoint;
+
+        if (!FindCgroup2Mount("/proc/self/mountinfo", root, mountPoint)) {
+            mountPoint = "/sys/fs/cgroup";
+        }
+
+        return mountPoint;
+    }();
+
+    return mountPoint;
+}
+
+std::string CgroupPath(pid_t initPid) {
+    if (initPid <= 0) {
+        return "";
+    }
+
+    std::string proc = "/proc/" + std::to_string(initPid);
+    std::string root, mountPoint;
+
+    // The root of the container's cgroup2 mount is the root of its cgroup
+    // namespace, as seen from our namespace. Unlike /proc/<pid>/cgroup, this
+    // is not affected by init moving itself into a sub cgroup (init.scope).
+    if (FindCgroup2Mount(proc + "/mountinfo", root, mountPoint)
+            && root.compare(0, 3, "/..") != 0) {
+        return HostCgroupMount() + (root == "/" ? "" : root);
+    }
+
+    std::string content;
+
+    if (!ReadFile(proc + "/cgroup", content)) {
+        return "";
+    }
+
+    std::istringstream lines(content);
+    std::string line;
+
+    while (std::getline(lines, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            std::string path = line.substr(3);
+            return HostCgroupMount() + (path == "/" ? "" : path);
+        }
+    }
+
+    return "";
+}
+
+bool ReadFile(const std::string& path, std::string& content) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    char buffer[4096];
+    ssize_t ret;
+
+    content.clear();
+
+    do {
+        ret = read(fd, buffer, sizeof(buffer));
+
+        if (ret > 0) {
+            content.append(buffer, ret);
+        }
+    } while (ret > 0 || (ret == -1 && errno == EINTR));
+
+    close(fd);
+
+    return ret == 0;
+}
+
+bool ParseKeyedValue(const std::string& content, const std::string& key,
+        uint64_t& value) {
+    std::istringstream lines(content);
+    std::string name;
+
+    while (lines >> name) {
+        if (name == key) {
+            return static_cast<bool>(lines >> value);
+        }
+
+        lines.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+
+    return false;
+}
@@ -0,0 +1,32 @@
+#ifndef SOURCEBOX_CGROUP_H
+#define SOURCEBOX_CGROUP_H
+
+#include <string>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * Returns the host path of the unified (v2) cgroup directory a container's
+ * init process lives in, e.g. /sys/fs/cgroup/lxc.payload.foo. Returns an empty
+ * string if it can not be determined.
+ */
+std::string CgroupPath(pid_t initPid);
+
+/**
+ * Returns the mount point of the host's cgroup2 hierarchy.
+ */
+const std::string& HostCgroupMount();
+
+/**
+ * Reads a (small) file into a string. Returns false on failure.
+ */
+bool ReadFile(const std::string& path, std::string& content);
+
+/**
+ * Looks up `key` in a flat keyed file such as `cpu.stat` ("key value" lines).
+ */
+bool ParseKeyedValue(const std::string& content, const std::string& key,
+        uint64_t& value);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef SOURCEBOX_CHILD_FDS_H
+#define SOURCEBOX_CHILD_FDS_H
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <initializer_list>
+#include <vector>
+
+/**
+ * Fd setup of an attached child, shared by the addon and
+ * sourcebox-supervisor. It must not depend on node or V8.
+ *
+ * Installs fds[i] as fd i for every i >= 3 and gives every ignored (-1) fd
+ * the container's /dev/null, stdio is expected in place already. The fds in
+ * `keep` are still needed afterwards, e.g. the pipe that reports a failed
+ * exec, and are updated to their new numbers.
+ */
+inline void SetupChildFds(std::vector<int>& fds, std::initializer_list<int*> keep) {
+    // move every fd we still need out of the way first, their numbers are
+    // arbitrary and might be the target of a dup2() below
+    int minFd = fds.size();
+
+    for (unsigned int i = 3; i < fds.size(); i++) {
+        if (fds[i] != -1) {
+            fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, minFd);
+        }
+    }
+
+    for (int *fd : keep) {
+        if (*fd != -1) {
+            *fd = fcntl(*fd, F_DUPFD_CLOEXEC, minFd);
+        }
+    }
+
+    for (unsigned int i = 3; i < fds.size(); i++) {
+        if (fds[i] != -1) {
+            dup2(fds[i], i);
+        }
+    }
+
+    // ignored fds get /dev/null, after all other fds are in place so that
+    // open() does not take one of their numbers
+    for (unsigned int i = 0; i < fds.size(); i++) {
+        if (fds[i] != -1) {
+            continue;
+        }
+
+        int fd = open("/dev/null", O_RDWR);
+        if (fd != -1 && fd != static_cast<int>(i)) {
+            dup2(fd, i);
+            close(fd);
+        }
+    }
+}
+
+#endif
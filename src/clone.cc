@@ -3,8 +3,9 @@
 
 using namespace v8;
 
-CloneWorker::CloneWorker(lxc_container *container, Nan::Callback *callback,
-        Local<String> name, Local<Object> options) : LxcWorker(container, callback) {
+CloneWorker::CloneWorker(AddonData *data, lxc_container *container,
+        Nan::Callback *callback, Local<String> name, Local<Object> options)
+        : LxcWorker(data, container, callback) {
     Nan::HandleScope scope;
 
     name_ = *String::Utf8Value(name);
@@ -57,7 +58,7 @@ void CloneWorker::LxcExecute() {
 void CloneWorker::HandleOKCallback() {
     Nan::HandleScope scope;
 
-    Local<Object> wrap = Wrap(clone_);
+    Local<Object> wrap = Wrap(data_, clone_);
 
     const int argc = 2;
     Local<Value> argv[argc] = {
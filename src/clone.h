@@ -5,9 +5,13 @@
 
 class CloneWorker : public LxcWorker {
 public:
-    CloneWorker(lxc_container *container, Nan::Callback *callback,
+    CloneWorker(AddonData *data, lxc_container *container, Nan::Callback *callback,
             v8::Local<v8::String> name, v8::Local<v8::Object> options);
 
+    Metrics::Operation OperationType() const override {
+        return Metrics::kClone;
+    }
+
 private:
     void LxcExecute() override;
     void HandleOKCallback() override;
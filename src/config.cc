@@ -1,8 +1,8 @@
 #include "config.h"
 
-ConfigWorker::ConfigWorker(lxc_container *container, Nan::Callback *callback,
-        const std::string& file, bool save)
-        : LxcWorker(container, callback), file_(file), save_(save) {
+ConfigWorker::ConfigWorker(AddonData *data, lxc_container *container,
+        Nan::Callback *callback, const std::string& file, bool save)
+        : LxcWorker(data, container, callback), file_(file), save_(save) {
     requireDefined_ = false;
 }
 
@@ -5,9 +5,13 @@
 
 class ConfigWorker : public LxcWorker {
 public:
-    ConfigWorker(lxc_container *container, Nan::Callback *callback,
+    ConfigWorker(AddonData *data, lxc_container *container, Nan::Callback *callback,
             const std::string& file, bool save);
 
+    Metrics::Operation OperationType() const override {
+        return Metrics::kConfig;
+    }
+
 private:
     void LxcExecute() override;
 
@@ -1,11 +1,14 @@
 #include "create.h"
 
+#include <sys/stat.h>
+
 using namespace v8;
 
-CreateWorker::CreateWorker(lxc_container *container, Nan::Callback *callback,
-        const std::string& templateName, const std::string bdevtype,
-        const std::vector<std::string>& args)
-        : LxcWorker(container, callback), template_(templateName), bdevtype_(bdevtype) {
+CreateWorker::CreateWorker(AddonData *data, lxc_container *container,
+        Nan::Callback *callback, const std::string& templateName, const std::string bdevtype,
+        const std::vector<std::string>& args, const std::string& image)
+        : LxcWorker(data, container, callback), template_(templateName), bdevtype_(bdevtype),
+        image_(image) {
     requireDefined_ = false;
 
     args_.resize(args.size() + 1);
@@ -28,6 +31,14 @@ void CreateWorker::LxcExecute() {
     }
     // TODO additional checks to provide better error messages
 
+    if (!image_.empty()) {
+        if (!CreateFromImage()) {
+            SetErrorMessage("Failed to create container from image");
+        }
+
+        return;
+    }
+
     bool ret = container_->create(container_,
             template_.empty() ? nullptr : template_.c_str(),
             bdevtype_.empty() ? nullptr : bdevtype_.c_str(),
@@ -37,3 +48,35 @@ void CreateWorker::LxcExecute() {
         SetErrorMessage("Failed to create container");
     }
 }
+
+// Creates the container without running a template, using the image's rootfs
+// as the read-only lower layer of an overlay rootfs.
+bool CreateWorker::CreateFromImage() {
+    if (!container_->create(container_, nullptr, "dir", nullptr,
+                LXC_CREATE_QUIET, args_.data())) {
+        return false;
+    }
+
+    std::string upper = std::string(container_->config_path) + "/"
+        + container_->name + "/delta0";
+
+    bool ret = mkdir(upper.c_str(), 0755) == 0 || errno == EEXIST;
+
+    // lxc.rootfs was renamed to lxc.rootfs.path in LXC 2.1, which also
+    // renamed the overlayfs backend to overlay
+    if (ret && !container_->set_config_item(container_, "lxc.rootfs.path",
+                ("overlay:" + image_ + ":" + upper).c_str())) {
+        ret = container_->set_config_item(container_, "lxc.rootfs",
+                ("overlayfs:" + image_ + ":" + upper).c_str());
+    }
+
+    // only exists in some versions and would still say "dir"
+    container_->clear_config_item(container_, "lxc.rootfs.backend");
+
+    if (!ret || !container_->save_config(container_, nullptr)) {
+        container_->destroy(container_);
+        return false;
+    }
+
+    return true;
+}
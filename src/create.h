@@ -7,16 +7,25 @@
 
 class CreateWorker : public LxcWorker {
 public:
-    CreateWorker(lxc_container *container, Nan::Callback *callback, const std::string& templateName,
-            const std::string bdevtype, const std::vector<std::string>& args);
+    CreateWorker(AddonData *data, lxc_container *container, Nan::Callback *callback,
+            const std::string& templateName,
+            const std::string bdevtype, const std::vector<std::string>& args,
+            const std::string& image);
     ~CreateWorker();
 
+    Metrics::Operation OperationType() const override {
+        return Metrics::kCreate;
+    }
+
 private:
     void LxcExecute() override;
 
+    bool CreateFromImage();
+
     std::string template_;
     std::string bdevtype_;
     std::vector<char*> args_;
+    std::string image_;
 };
 
 #endif
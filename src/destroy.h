@@ -7,6 +7,10 @@ class DestroyWorker : public LxcWorker {
 public:
     using LxcWorker::LxcWorker;
 
+    Metrics::Operation OperationType() const override {
+        return Metrics::kDestroy;
+    }
+
 private:
     void LxcExecute() override;
 };
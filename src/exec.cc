@@ -0,0 +1,413 @@
+#include "exec.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "attach.h"
+#include "parallel.h"
+#include "probes.h"
+
+using namespace v8;
+
+// Cancellation and timeouts are checked at least this often (ms)
+static const int kPollInterval = 100;
+
+ExecAcrossWorker::ExecAcrossWorker(AddonData *data, Nan::Callback *callback,
+        const std::vector<std::string>& names, const std::string& path,
+        const std::string& command, const std::vector<std::string>& args,
+        Local<Object> options, Local<Value> onResult)
+        : AsyncWorker(data, nullptr, callback), names_(names), path_(path),
+        command_(command), args_(args), results_(names.size()) {
+    Nan::HandleScope scope;
+
+    std::vector<std::string> env;
+    std::string cwd = "/";
+    int uid = -1;
+    int gid = -1;
+
+    Local<Value> envValue = options->Get(Nan::New("env").ToLocalChecked());
+    if (envValue->IsArray()) {
+        Local<Array> envArray = envValue.As<Array>();
+
+        for (unsigned int i = 0; i < envArray->Length(); i++) {
+            env.push_back(*String::Utf8Value(envArray->Get(i)));
+        }
+    }
+
+    Local<Value> cwdValue = options->Get(Nan::New("cwd").ToLocalChecked());
+    if (cwdValue->IsString()) {
+        cwd = *String::Utf8Value(cwdValue);
+    }
+
+    Local<Value> uidValue = options->Get(Nan::New("uid").ToLocalChecked());
+    if (uidValue->IsUint32()) {
+        uid = uidValue->Uint32Value();
+    }
+
+    Local<Value> gidValue = options->Get(Nan::New("gid").ToLocalChecked());
+    if (gidValue->IsUint32()) {
+        gid = gidValue->Uint32Value();
+    }
+
+    profile_ = std::make_shared<AttachProfile>(cwd, env, uid, gid, -1, true);
+
+    Local<Value> concurrency = options->Get(Nan::New("concurrency").ToLocalChecked());
+    if (concurrency->IsUint32()) {
+        concurrency_ = concurrency->Uint32Value();
+    }
+
+    Local<Value> timeout = options->Get(Nan::New("timeoutMs").ToLocalChecked());
+    if (timeout->IsUint32()) {
+        timeout_ = timeout->Uint32Value();
+    }
+
+    Local<Value> maxOutput = options->Get(Nan::New("maxOutputBytes").ToLocalChecked());
+    if (maxOutput->IsUint32()) {
+        maxOutput_ = maxOutput->Uint32Value();
+    }
+
+    SaveToPersistent("results", Nan::New<Array>(names.size()));
+
+    if (onResult->IsFunction()) {
+        onResult_.Reset(onResult.As<Function>());
+
+        uv_mutex_init(&mutex_);
+
+        async_ = new uv_async_t;
+        async_->data = this;
+        uv_async_init(data_->loop, async_, OnAsync);
+
+        // the worker itself keeps the loop alive
+        uv_unref(reinterpret_cast<uv_handle_t*>(async_));
+    }
+}
+
+ExecAcrossWorker::~ExecAcrossWorker() {
+    if (async_) {
+        uv_close(reinterpret_cast<uv_handle_t*>(async_), [](uv_handle_t *handle) {
+            delete reinterpret_cast<uv_async_t*>(handle);
+        });
+
+        uv_mutex_destroy(&mutex_);
+    }
+}
+
+void ExecAcrossWorker::AsyncExecute() {
+    ParallelFor(names_.size(), concurrency_, [this](size_t i) {
+        // containers that were not touched yet are left alone
+        if (Cancelled()) {
+            results_[i].error = "Operation cancelled";
+        } else {
+            Run(i);
+        }
+
+        if (async_) {
+            uv_mutex_lock(&mutex_);
+            pending_.push_back(i);
+            uv_mutex_unlock(&mutex_);
+
+            uv_async_send(async_);
+        }
+    });
+}
+
+void ExecAcrossWorker::Run(size_t i) {
+    Result& result = results_[i];
+    uint64_t start = uv_hrtime();
+    uint64_t deadline = timeout_ > 0 ? start + timeout_ * static_cast<uint64_t>(1e6) : 0;
+
+    lxc_container *container = lxc_container_new(names_[i].c_str(),
+            path_.empty() ? nullptr : path_.c_str());
+
+    if (!container) {
+        result.error = "Failed to create container";
+        return;
+    }
+
+    if (!container->may_control(container)) {
+        result.error = "Insufficient privileges to control container";
+    } else if (!container->is_defined(container)) {
+        result.error = "Container is not defined";
+    } else if (!container->is_running(container)) {
+        result.error = "Container is not running";
+    }
+
+    if (!result.error.empty()) {
+        lxc_container_put(container);
+        return;
+    }
+
+    // stdin reads from /dev/null, the output goes through pipes that are
+    // only read on this thread
+    int stdinFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    int stdoutFds[2] = {-1, -1};
+    int stderrFds[2] = {-1, -1};
+    int errorFds[2] = {-1, -1};
+
+    if (stdinFd == -1 || pipe2(stdoutFds, O_CLOEXEC) == -1 ||
+            pipe2(stderrFds, O_CLOEXEC) == -1 ||
+            socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, errorFds) == -1) {
+        result.error = std::string("Could not create stdio: ") + strerror(errno);
+
+        for (int fd : {stdinFd, stdoutFds[0], stdoutFds[1], stderrFds[0], stderrFds[1],
+                errorFds[0], errorFds[1]}) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+
+        lxc_container_put(container);
+        return;
+    }
+
+    AttachTask task(new ExecCommand(command_, args_), profile_, false);
+
+    task.fds = {stdinFd, stdoutFds[1], stderrFds[1]};
+    task.errorFd = errorFds[1];
+
+    lxc_attach_options_t options = task.Options();
+
+#ifdef HAVE_UV_CLOEXEC_LOCK
+    uv_loop_t *loop = data_->loop;
+    uint64_t lockStart = uv_hrtime();
+    PROBE1(attach__lock__acquire, container->name);
+    CloexecWriteLock(loop);
+    PROBE1(attach__lock__acquired, container->name);
+    data_->metrics->cloexecLockWait.Record(uv_hrtime() - lockStart);
+#endif
+
+    uint64_t attachStart = uv_hrtime();
+    PROBE2(attach__start, container->name, task.command->Name());
+    int ret = container->attach(container, AttachTask::Main, &task, &options, &task.pid);
+    PROBE3(attach__done, container->name, ret, task.pid);
+    data_->metrics->attach.Record(uv_hrtime() - attachStart);
+
+#ifdef HAVE_UV_CLOEXEC_LOCK
+    CloexecWriteUnlock(loop);
+    PROBE1(attach__lock__release, container->name);
+#endif
+
+    lxc_container_put(container);
+
+    // only the child keeps the write ends, so the pipes see EOF once it exits
+    for (int fd : task.fds) {
+        close(fd);
+    }
+
+    task.fds.clear();
+    close(errorFds[1]);
+
+    int outputFds[2] = {stdoutFds[0], stderrFds[0]};
+
+    if (ret == -1) {
+        result.error = "Could not attach to container";
+    } else {
+        task.ReadExecResult(errorFds[0]);
+        result.execErrno = task.execErrno;
+
+        if (task.execErrno == 0) {
+            Collect(task.pid, outputFds, deadline, result);
+        } else {
+            result.error = std::string("Could not execute command: ") + strerror(task.execErrno);
+        }
+    }
+
+    close(errorFds[0]);
+
+    for (int fd : outputFds) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    result.duration = uv_hrtime() - start;
+}
+
+bool ExecAcrossWorker::Expired(uint64_t deadline) const {
+    return Cancelled() || (deadline > 0 && uv_hrtime() >= deadline);
+}
+
+// Reads stdout and stderr until both are closed, then waits for the process.
+// Closed descriptors are set to -1.
+void ExecAcrossWorker::Collect(int pid, int fds[2], uint64_t deadline, Result& result) {
+    pollfd pollFds[2] = {
+        {fds[0], POLLIN, 0},
+        {fds[1], POLLIN, 0}
+    };
+
+    int open = 2;
+    bool killed = false;
+    char buffer[16384];
+
+    while (open > 0 && !killed) {
+        if (Expired(deadline)) {
+            kill(pid, SIGKILL);
+            killed = true;
+            break;
+        }
+
+        int wait = kPollInterval;
+
+        if (deadline > 0) {
+            uint64_t remaining = (deadline - uv_hrtime()) / 1000000 + 1;
+            wait = std::min<uint64_t>(wait, remaining);
+        }
+
+        if (poll(pollFds, 2, wait) == -1) {
+            continue;
+        }
+
+        for (int j = 0; j < 2; j++) {
+            if (pollFds[j].fd == -1 || pollFds[j].revents == 0) {
+                continue;
+            }
+
+            ssize_t n = read(pollFds[j].fd, buffer, sizeof(buffer));
+
+            if (n > 0) {
+                std::string& output = result.output[j];
+                size_t keep = std::min<size_t>(n, maxOutput_ - output.size());
+
+                // the rest is drained, so the process does not block on a full pipe
+                output.append(buffer, keep);
+                result.truncated = result.truncated || keep < static_cast<size_t>(n);
+            } else if (n == 0 || errno != EINTR) {
+                close(pollFds[j].fd);
+                pollFds[j].fd = fds[j] = -1;
+                open--;
+            }
+        }
+    }
+
+    // the output may be closed before the process exits
+    int ret;
+
+    for (;;) {
+        do {
+            ret = waitpid(pid, &result.status, killed ? 0 : WNOHANG);
+        } while (ret == -1 && errno == EINTR);
+
+        if (ret != 0) {
+            break;
+        }
+
+        if (Expired(deadline)) {
+            kill(pid, SIGKILL);
+            killed = true;
+        } else {
+            usleep(1000);
+        }
+    }
+
+    if (ret == -1) {
+        result.status = -1;
+        result.error = "Failed to wait for process";
+    }
+
+    result.timedOut = killed && !Cancelled();
+
+    if (killed && Cancelled()) {
+        result.error = "Operation cancelled";
+    }
+}
+
+Local<Object> ExecAcrossWorker::ResultObject(size_t i) {
+    Nan::EscapableHandleScope scope;
+
+    Result& result = results_[i];
+    Local<Object> object = Nan::New<Object>();
+
+    Local<Value> exitCode = Nan::Null();
+    Local<Value> signalCode = Nan::Null();
+
+    if (result.status != -1) {
+        if (WIFEXITED(result.status)) {
+            exitCode = Nan::New<Uint32>(WEXITSTATUS(result.status));
+        } else if (WIFSIGNALED(result.status)) {
+            signalCode = Nan::New(node::signo_string(WTERMSIG(result.status))).ToLocalChecked();
+        }
+    }
+
+    object->Set(Nan::New("name").ToLocalChecked(), Nan::New(names_[i]).ToLocalChecked());
+    object->Set(Nan::New("exitCode").ToLocalChecked(), exitCode);
+    object->Set(Nan::New("signal").ToLocalChecked(), signalCode);
+    object->Set(Nan::New("stdout").ToLocalChecked(), Nan::CopyBuffer(
+            result.output[0].data(), result.output[0].size()).ToLocalChecked());
+    object->Set(Nan::New("stderr").ToLocalChecked(), Nan::CopyBuffer(
+            result.output[1].data(), result.output[1].size()).ToLocalChecked());
+    object->Set(Nan::New("truncated").ToLocalChecked(), Nan::New(result.truncated));
+    object->Set(Nan::New("timedOut").ToLocalChecked(), Nan::New(result.timedOut));
+    object->Set(Nan::New("durationMs").ToLocalChecked(), Nan::New<Number>(result.duration / 1e6));
+    object->Set(Nan::New("execErrno").ToLocalChecked(), Nan::New(result.execErrno));
+    object->Set(Nan::New("error").ToLocalChecked(), result.error.empty()
+            ? Nan::Null().As<Value>()
+            : Nan::Error(result.error.c_str()));
+
+    // the output lives on in the buffers
+    std::string().swap(result.output[0]);
+    std::string().swap(result.output[1]);
+
+    return scope.Escape(object);
+}
+
+void ExecAcrossWorker::Publish() {
+    Nan::HandleScope scope;
+
+    std::vector<size_t> pending;
+
+    uv_mutex_lock(&mutex_);
+    pending.swap(pending_);
+    uv_mutex_unlock(&mutex_);
+
+    Local<Object> results = GetFromPersistent("results")->ToObject();
+
+    for (size_t i : pending) {
+        Local<Object> result = ResultObject(i);
+
+        results->Set(i, result);
+        results_[i].published = true;
+
+        const int argc = 1;
+        Local<Value> argv[argc] = {
+            result
+        };
+
+        onResult_.Call(argc, argv);
+    }
+}
+
+void ExecAcrossWorker::OnAsync(uv_async_t *handle) {
+    static_cast<ExecAcrossWorker*>(handle->data)->Publish();
+}
+
+void ExecAcrossWorker::HandleOKCallback() {
+    Nan::HandleScope scope;
+
+    // report the last completions before the final callback
+    if (async_) {
+        Publish();
+    }
+
+    Local<Object> results = GetFromPersistent("results")->ToObject();
+
+    for (size_t i = 0; i < results_.size(); i++) {
+        if (!results_[i].published) {
+            results->Set(i, ResultObject(i));
+        }
+    }
+
+    const int argc = 2;
+    Local<Value> argv[argc] = {
+        Nan::Null(),
+        results
+    };
+
+    callback->Call(argc, argv);
+}
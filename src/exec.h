@@ -0,0 +1,76 @@
+#ifndef SOURCEBOX_EXEC_H
+#define SOURCEBOX_EXEC_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "async.h"
+#include "profile.h"
+
+/**
+ * Runs one command in a list of containers with bounded parallelism and
+ * collects the exit status and the (capped) output of every run. Results can
+ * be streamed to JS as the runs complete.
+ */
+class ExecAcrossWorker : public AsyncWorker {
+public:
+    ExecAcrossWorker(AddonData *data, Nan::Callback *callback,
+            const std::vector<std::string>& names, const std::string& path,
+            const std::string& command, const std::vector<std::string>& args,
+            v8::Local<v8::Object> options, v8::Local<v8::Value> onResult);
+
+    ~ExecAcrossWorker();
+
+    Metrics::Operation OperationType() const override {
+        return Metrics::kExecAcross;
+    }
+
+private:
+    struct Result {
+        std::string output[2];
+        bool truncated = false;
+        bool timedOut = false;
+        bool published = false;
+
+        // waitpid() status, -1 if the command did not run
+        int status = -1;
+        int execErrno = 0;
+        uint64_t duration = 0;
+        std::string error;
+    };
+
+    void AsyncExecute() override;
+    void HandleOKCallback() override;
+
+    void Run(size_t i);
+    void Collect(int pid, int fds[2], uint64_t deadline, Result& result);
+    bool Expired(uint64_t deadline) const;
+
+    v8::Local<v8::Object> ResultObject(size_t i);
+    void Publish();
+
+    static void OnAsync(uv_async_t *handle);
+
+    std::vector<std::string> names_;
+    std::string path_;
+    std::string command_;
+    std::vector<std::string> args_;
+
+    // shared by all runs, only env, cwd, uid and gid are taken from the options
+    std::shared_ptr<const AttachProfile> profile_;
+
+    unsigned int concurrency_ = 8;
+    unsigned int timeout_ = 0;
+    size_t maxOutput_ = 1024 * 1024;
+
+    std::vector<Result> results_;
+
+    // completed runs that were not published yet, only used when streaming
+    uv_async_t *async_ = nullptr;
+    uv_mutex_t mutex_;
+    std::vector<size_t> pending_;
+    Nan::Callback onResult_;
+};
+
+#endif
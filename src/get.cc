@@ -4,13 +4,13 @@
 
 using namespace v8;
 
-GetWorker::GetWorker(Nan::Callback *callback, const std::string& name,
+GetWorker::GetWorker(AddonData *data, Nan::Callback *callback, const std::string& name,
         const std::string& path, bool requireDefined)
-        : AsyncWorker(nullptr, callback), name_(name), path_(path) {
+        : AsyncWorker(data, nullptr, callback), name_(name), path_(path) {
     requireDefined_ = requireDefined;
 }
 
-void GetWorker::Execute() {
+void GetWorker::AsyncExecute() {
     container_ = lxc_container_new(name_.c_str(),
             path_.empty() ? nullptr : path_.c_str());
 
@@ -25,7 +25,7 @@ void GetWorker::Execute() {
 void GetWorker::HandleOKCallback() {
     Nan::HandleScope scope;
 
-    Local<Object> wrap = Wrap(container_);
+    Local<Object> wrap = Wrap(data_, container_);
 
     const int argc = 2;
     Local<Value> argv[argc] = {
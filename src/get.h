@@ -5,11 +5,15 @@
 
 class GetWorker : public AsyncWorker {
 public:
-    GetWorker(Nan::Callback *callback, const std::string& name,
+    GetWorker(AddonData *data, Nan::Callback *callback, const std::string& name,
             const std::string& path, bool requireDefined);
 
+    Metrics::Operation OperationType() const override {
+        return Metrics::kGet;
+    }
+
 private:
-    void Execute() override;
+    void AsyncExecute() override;
     void HandleOKCallback() override;
 
     std::string name_;
@@ -0,0 +1,238 @@
+#include "list.h"
+
+#include <algorithm>
+
+#include "lxc.h"
+#include "parallel.h"
+
+using namespace v8;
+
+static std::vector<std::string> ToVector(Local<Value> value) {
+    std::vector<std::string> vector;
+
+    if (value->IsArray()) {
+        Local<Array> array = value.As<Array>();
+
+        for (unsigned int i = 0; i < array->Length(); i++) {
+            vector.push_back(*String::Utf8Value(array->Get(i)));
+        }
+    }
+
+    return vector;
+}
+
+// Reads a value through one of the get_*_item functions, which all share the
+// same calling convention.
+template <typename F>
+static std::pair<bool, std::string> GetItem(lxc_container *container,
+        const std::string& key, F get) {
+    int len = get(container, key.c_str(), nullptr, 0);
+
+    if (len < 0) {
+        return std::make_pair(false, std::string());
+    }
+
+    std::string value(len + 1, '\0');
+
+    if (get(container, key.c_str(), &value[0], len + 1) != len) {
+        return std::make_pair(false, std::string());
+    }
+
+    value.resize(len);
+
+    return std::make_pair(true, value);
+}
+
+ListWorker::ListWorker(AddonData *data, Nan::Callback *callback, const std::string& path,
+        Local<Object> options)
+        : AsyncWorker(data, nullptr, callback), path_(path) {
+    Nan::HandleScope scope;
+
+    Local<Value> active = options->Get(Nan::New("active").ToLocalChecked());
+    if (active->IsBoolean()) {
+        active_ = active->BooleanValue();
+    }
+
+    Local<Value> defined = options->Get(Nan::New("defined").ToLocalChecked());
+    if (defined->IsBoolean()) {
+        defined_ = defined->BooleanValue();
+    }
+
+    Local<Value> fields = options->Get(Nan::New("fields").ToLocalChecked());
+    if (fields->IsArray()) {
+        std::vector<std::string> names = ToVector(fields);
+
+        auto has = [&names](const char *field) {
+            return std::find(names.begin(), names.end(), field) != names.end();
+        };
+
+        state_ = has("state");
+        pid_ = has("pid");
+        ips_ = has("ips");
+    }
+
+    Local<Value> concurrency = options->Get(Nan::New("concurrency").ToLocalChecked());
+    if (concurrency->IsUint32()) {
+        concurrency_ = concurrency->Uint32Value();
+    }
+
+    configKeys_ = ToVector(options->Get(Nan::New("config").ToLocalChecked()));
+    cgroupKeys_ = ToVector(options->Get(Nan::New("cgroup").ToLocalChecked()));
+}
+
+ListWorker::~ListWorker() {
+    if (!wrapped_) {
+        for (Entry& entry : entries_) {
+            lxc_container_put(entry.container);
+        }
+    }
+}
+
+void ListWorker::AsyncExecute() {
+    const char *path = path_.empty() ? nullptr : path_.c_str();
+    char **names = nullptr;
+    lxc_container **containers = nullptr;
+    int count;
+
+    if (active_ && defined_) {
+        count = list_all_containers(path, &names, &containers);
+    } else if (active_) {
+        count = list_active_containers(path, &names, &containers);
+    } else if (defined_) {
+        count = list_defined_containers(path, &names, &containers);
+    } else {
+        count = 0;
+    }
+
+    if (count < 0) {
+        return SetErrorMessage("Failed to list containers");
+    }
+
+    entries_.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        entries_[i].container = containers[i];
+        entries_[i].name = names[i];
+        free(names[i]);
+    }
+
+    free(names);
+    free(containers);
+
+    // most of the time is spent waiting for the containers' command sockets,
+    // so query them in parallel
+    ParallelFor(entries_.size(), concurrency_, [this](size_t i) {
+        if (!Cancelled()) {
+            Gather(entries_[i]);
+        }
+    });
+
+    if (Cancelled()) {
+        SetErrorMessage("Operation cancelled");
+    }
+}
+
+// This method gets called on multiple threads at once
+void ListWorker::Gather(Entry& entry) {
+    lxc_container *container = entry.container;
+    bool running = container->is_running(container);
+
+    if (state_) {
+        const char *state = container->state(container);
+        entry.state = state ? state : "";
+    }
+
+    if (pid_ && running) {
+        entry.pid = container->init_pid(container);
+    }
+
+    if (ips_ && running) {
+        char **ips = container->get_ips(container, nullptr, nullptr, 0);
+
+        if (ips) {
+            for (char **ip = ips; *ip; ip++) {
+                entry.ips.push_back(*ip);
+                free(*ip);
+            }
+
+            free(ips);
+        }
+    }
+
+    for (const std::string& key : configKeys_) {
+        entry.config.push_back(GetItem(container, key, container->get_config_item));
+    }
+
+    for (const std::string& key : cgroupKeys_) {
+        if (running) {
+            entry.cgroup.push_back(GetItem(container, key, container->get_cgroup_item));
+        } else {
+            entry.cgroup.push_back(std::make_pair(false, std::string()));
+        }
+    }
+}
+
+void ListWorker::HandleOKCallback() {
+    Nan::HandleScope scope;
+
+    Local<Array> result = Nan::New<Array>(entries_.size());
+
+    for (unsigned int i = 0; i < entries_.size(); i++) {
+        Entry& entry = entries_[i];
+        Local<Object> object = Nan::New<Object>();
+
+        object->Set(Nan::New("name").ToLocalChecked(),
+                Nan::New(entry.name).ToLocalChecked());
+
+        if (state_) {
+            object->Set(Nan::New("state").ToLocalChecked(),
+                    Nan::New(entry.state).ToLocalChecked());
+        }
+
+        if (pid_) {
+            object->Set(Nan::New("pid").ToLocalChecked(), entry.pid > 0 ?
+                    Nan::New<Int32>(entry.pid).As<Value>() : Nan::Null().As<Value>());
+        }
+
+        if (ips_) {
+            Local<Array> ips = Nan::New<Array>(entry.ips.size());
+
+            for (unsigned int j = 0; j < entry.ips.size(); j++) {
+                ips->Set(j, Nan::New(entry.ips[j]).ToLocalChecked());
+            }
+
+            object->Set(Nan::New("ips").ToLocalChecked(), ips);
+        }
+
+        auto items = [](const std::vector<std::string>& keys,
+                const std::vector<std::pair<bool, std::string>>& values) {
+            Local<Object> object = Nan::New<Object>();
+
+            for (unsigned int j = 0; j < keys.size(); j++) {
+                object->Set(Nan::New(keys[j]).ToLocalChecked(), values[j].first ?
+                        Nan::New(values[j].second).ToLocalChecked().As<Value>() :
+                        Nan::Null().As<Value>());
+            }
+
+            return object;
+        };
+
+        object->Set(Nan::New("config").ToLocalChecked(), items(configKeys_, entry.config));
+        object->Set(Nan::New("cgroup").ToLocalChecked(), items(cgroupKeys_, entry.cgroup));
+
+        // takes over the reference
+        object->Set(Nan::New("container").ToLocalChecked(), Wrap(data_, entry.container));
+
+        result->Set(i, object);
+    }
+
+    wrapped_ = true;
+
+    const int argc = 2;
+    Local<Value> argv[argc] = {
+        Nan::Null(),
+        result
+    };
+
+    callback->Call(argc, argv);
+}
@@ -0,0 +1,49 @@
+#ifndef SOURCEBOX_LIST_H
+#define SOURCEBOX_LIST_H
+
+#include <vector>
+
+#include "async.h"
+
+class ListWorker : public AsyncWorker {
+public:
+    ListWorker(AddonData *data, Nan::Callback *callback, const std::string& path,
+            v8::Local<v8::Object> options);
+
+    ~ListWorker();
+
+    Metrics::Operation OperationType() const override {
+        return Metrics::kList;
+    }
+
+private:
+    struct Entry {
+        lxc_container *container;
+        std::string name;
+        std::string state;
+        pid_t pid = -1;
+        std::vector<std::string> ips;
+        std::vector<std::pair<bool, std::string>> config;
+        std::vector<std::pair<bool, std::string>> cgroup;
+    };
+
+    void AsyncExecute() override;
+    void HandleOKCallback() override;
+
+    void Gather(Entry& entry);
+
+    std::string path_;
+    bool active_ = true;
+    bool defined_ = true;
+    bool state_ = true;
+    bool pid_ = true;
+    bool ips_ = true;
+    unsigned int concurrency_ = 8;
+    std::vector<std::string> configKeys_;
+    std::vector<std::string> cgroupKeys_;
+
+    std::vector<Entry> entries_;
+    bool wrapped_ = false;
+};
+
+#endif
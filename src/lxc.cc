@@ -1,15 +1,16 @@
 #include "lxc.h"
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <sched.h>
 
 #include <string>
 #include <vector>
-#include <map>
 
 #include <nan.h>
 
 #include "get.h"
+#include "list.h"
 #include "create.h"
 #include "clone.h"
 #include "config.h"
@@ -17,22 +18,22 @@
 #include "start.h"
 #include "stop.h"
 #include "attach.h"
+#include "bulk.h"
+#include "exec.h"
+#include "memory.h"
+#include "metrics.h"
+#include "placement.h"
+#include "profile.h"
+#include "sampler.h"
+#include "scheduler.h"
+#include "shm.h"
+#include "supervise.h"
+#include "watch.h"
 
 using namespace v8;
 
-static Nan::Persistent<Function> containerConstructor;
 static const pid_t pid = getpid();
 
-static const std::map<std::string, int> nsMap = {
-    {"ns", CLONE_NEWNS},
-    {"mount", CLONE_NEWNS},
-    {"uts", CLONE_NEWUTS},
-    {"ipc", CLONE_NEWIPC},
-    {"user", CLONE_NEWUSER},
-    {"pid", CLONE_NEWPID},
-    {"net", CLONE_NEWNET},
-};
-
 // Helper, Cleanup etc.
 
 static std::vector<std::string> JsArrayToVector(const Local<Array> source) {
@@ -52,14 +53,18 @@ static void ExitHandler(int status, void *) {
     }
 }
 
+static void RegisterExitHandler() {
+    on_exit(ExitHandler, nullptr);
+}
+
 void WeakCallback(const Nan::WeakCallbackInfo<lxc_container> &data) {
     lxc_container_put(data.GetParameter());
 }
 
-Local<Object> Wrap(lxc_container *container) {
+Local<Object> Wrap(AddonData *data, lxc_container *container) {
     Nan::EscapableHandleScope scope;
 
-    Local<Object> wrap = Nan::New(containerConstructor)->NewInstance();
+    Local<Object> wrap = Nan::New(data->containerConstructor)->NewInstance();
     Nan::SetInternalFieldPointer(wrap, 0, container);
 
     Nan::Persistent<Object> persistent(wrap);
@@ -68,7 +73,7 @@ Local<Object> Wrap(lxc_container *container) {
     return scope.Escape(wrap);
 }
 
-NAN_INLINE lxc_container *Unwrap(Local<Object> object) {
+lxc_container *Unwrap(Local<Object> object) {
     void *ptr = Nan::GetInternalFieldPointer(object, 0);
     return static_cast<lxc_container*>(ptr);
 }
@@ -80,39 +85,41 @@ NAN_METHOD(LXCContainer) {
         return info.GetReturnValue().Set(info.Holder());
     }
 
-    info.GetReturnValue().Set(Nan::New(containerConstructor)->NewInstance());
+    info.GetReturnValue().Set(Nan::New(GetAddonData(info)->containerConstructor)->NewInstance());
 }
 
 // Methods
 
 NAN_METHOD(Start) {
-    if (!info[0]->IsArray() || !info[1]->IsFunction()) {
+    if (!info[0]->IsArray() || !info[1]->IsObject() || !info[2]->IsFunction()) {
         return Nan::ThrowTypeError("Invalid argument");
     }
 
     lxc_container *container = Unwrap(info.Holder());
 
     Local<Array> arguments = info[0].As<Array>();
-    Nan::Callback *callback = new Nan::Callback(info[1].As<Function>());
+    Local<Object> options = info[1]->ToObject();
+    Nan::Callback *callback = new Nan::Callback(info[2].As<Function>());
 
-    Nan::AsyncQueueWorker(new StartWorker(container, callback, arguments));
+    QueueWorker(info, new StartWorker(GetAddonData(info), container, callback,
+            arguments, options), SchedulerKey(options));
 }
 
 NAN_METHOD(Create) {
     if (!info[0]->IsString() || !info[1]->IsString() || !info[2]->IsArray()
-            || !info[3]->IsFunction()) {
+            || !info[3]->IsString() || !info[4]->IsFunction()) {
         return Nan::ThrowTypeError("Invalid argument");
     }
 
     lxc_container *container = Unwrap(info.Holder());
 
-    Nan::Callback *callback = new Nan::Callback(info[3].As<Function>());
+    Nan::Callback *callback = new Nan::Callback(info[4].As<Function>());
 
-    CreateWorker *worker = new CreateWorker(container, callback,
+    CreateWorker *worker = new CreateWorker(GetAddonData(info), container, callback,
             *String::Utf8Value(info[0]), *String::Utf8Value(info[1]),
-            JsArrayToVector(info[2].As<Array>()));
+            JsArrayToVector(info[2].As<Array>()), *String::Utf8Value(info[3]));
 
-    Nan::AsyncQueueWorker(worker);
+    QueueWorker(info, worker);
 }
 
 NAN_METHOD(Stop) {
@@ -124,7 +131,7 @@ NAN_METHOD(Stop) {
 
     Nan::Callback *callback = new Nan::Callback(info[0].As<Function>());
 
-    Nan::AsyncQueueWorker(new StopWorker(container, callback));
+    QueueWorker(info, new StopWorker(GetAddonData(info), container, callback));
 }
 
 NAN_METHOD(Destroy) {
@@ -136,7 +143,7 @@ NAN_METHOD(Destroy) {
 
     Nan::Callback *callback = new Nan::Callback(info[0].As<Function>());
 
-    Nan::AsyncQueueWorker(new DestroyWorker(container, callback));
+    QueueWorker(info, new DestroyWorker(GetAddonData(info), container, callback));
 }
 
 NAN_METHOD(Clone) {
@@ -150,7 +157,119 @@ NAN_METHOD(Clone) {
     Local<Object> options = info[1]->ToObject();
     Nan::Callback *callback = new Nan::Callback(info[2].As<Function>());
 
-    Nan::AsyncQueueWorker(new CloneWorker(container, callback, name, options));
+    QueueWorker(info, new CloneWorker(GetAddonData(info), container, callback,
+            name, options), SchedulerKey(options));
+}
+
+// Parses the options of an attach call. Throws and returns nullptr if they are
+// invalid, no file descriptors are created yet except for a binary. The
+// command is a path, or a buffer or host fd with the binary to execute.
+// `options.profile` replaces the options that are part of a profile.
+static AttachTask *NewExecTask(AddonData *data, Local<Value> command,
+        Local<Value> args, Local<Object> options) {
+    std::shared_ptr<AttachProfile> profile = UnwrapProfile(data,
+            options->Get(Nan::New("profile").ToLocalChecked()));
+
+    if (!profile) {
+        profile = AttachProfile::FromOptions(options);
+
+        if (!profile) {
+            return nullptr;
+        }
+    }
+
+    // stdio
+    if (!ValidStdio(options->Get(Nan::New("stdio").ToLocalChecked()))) {
+        Nan::ThrowTypeError("invalid stdio");
+        return nullptr;
+    }
+
+    bool term = options->Get(Nan::New("term").ToLocalChecked())->BooleanValue();
+
+    // command & args
+    std::vector<std::string> arguments = JsArrayToVector(args.As<Array>());
+    AttachCommand *execCommand;
+
+    if (command->IsString()) {
+        execCommand = new ExecCommand(*String::Utf8Value(command), arguments);
+    } else {
+        int fd = node::Buffer::HasInstance(command)
+            ? CreateInputFd(node::Buffer::Data(command), node::Buffer::Length(command), true)
+            : fcntl(command->Uint32Value(), F_DUPFD_CLOEXEC, 3);
+
+        if (fd == -1) {
+            Nan::ThrowError(Nan::ErrnoException(errno, "attachBinary"));
+            return nullptr;
+        }
+
+        std::string argv0 = *String::Utf8Value(
+                options->Get(Nan::New("argv0").ToLocalChecked()));
+
+        execCommand = new FdExecCommand(fd, argv0, arguments);
+    }
+
+    return new AttachTask(execCommand, profile, term);
+}
+
+// Creates the stdio of a task. Throws and returns false on failure.
+static bool CreateTaskFds(const Nan::FunctionCallbackInfo<Value>& info, AttachTask *task,
+        Local<Value> stdio, Local<Value> term, std::vector<int>& parentFds) {
+    if (!CreateFds(GetAddonData(info), stdio, term, task->fds, parentFds)) {
+        Nan::ThrowError(Nan::ErrnoException(errno, "attach"));
+        return false;
+    }
+
+    return true;
+}
+
+// Creates the AttachedProcess instance of a task, which takes over the parent
+// ends of its stdio.
+static Local<Object> NewAttachedProcess(const Nan::FunctionCallbackInfo<Value>& info,
+        AttachTask *task, Local<Value> command, const std::vector<int>& parentFds) {
+    Nan::EscapableHandleScope scope;
+
+    Local<Array> fdArray = Nan::New<Array>(parentFds.size());
+
+    for (unsigned int i = 0; i < parentFds.size(); i++) {
+        fdArray->Set(i, parentFds[i] == -1
+                ? Nan::Null().As<Value>()
+                : Nan::New<Uint32>(parentFds[i]).As<Value>());
+    }
+
+    Local<Function> AttachedProcess = info[0].As<Function>();
+
+    const int argc = 4;
+    Local<Value> argv[argc] = {
+        command,
+        fdArray,
+        Nan::New(task->term),
+        info.Holder()->Get(Nan::New("owner").ToLocalChecked())
+    };
+
+    return scope.Escape(AttachedProcess->NewInstance(argc, argv));
+}
+
+// Queues a single worker that attaches all processes.
+static void QueueAttachWorker(const Nan::FunctionCallbackInfo<Value>& info,
+        Local<Array> attachedProcesses, const std::vector<AttachTask*>& tasks,
+        Local<Value> key) {
+    AddonData *data = GetAddonData(info);
+    std::string name;
+
+    if (key->IsString()) {
+        name = *String::Utf8Value(key);
+    }
+
+    AttachWorker *attachWorker = new AttachWorker(data, Unwrap(info.Holder()),
+            attachedProcesses, tasks);
+    Local<Object> operation = attachWorker->OperationHandle();
+
+    for (unsigned int i = 0; i < attachedProcesses->Length(); i++) {
+        attachedProcesses->Get(i)->ToObject()->Set(
+                Nan::New("_operation").ToLocalChecked(), operation);
+    }
+
+    data->scheduler->Submit(attachWorker, name);
 }
 
 NAN_METHOD(Attach) {
@@ -159,109 +278,142 @@ NAN_METHOD(Attach) {
         return Nan::ThrowTypeError("Invalid argument");
     }
 
-    lxc_container *container = Unwrap(info.Holder());
+    Local<Object> options = info[3]->ToObject();
+    AttachTask *task = NewExecTask(GetAddonData(info), info[1], info[2], options);
 
-    // command
-    std::string command = *String::Utf8Value(info[1]);
+    if (!task) {
+        return;
+    }
 
-    // args
-    std::vector<std::string> arguments = JsArrayToVector(info[2].As<Array>());
+    std::vector<int> parentFds;
 
-    Local<Object> options = info[3]->ToObject();
+    if (!CreateTaskFds(info, task, options->Get(Nan::New("stdio").ToLocalChecked()),
+            options->Get(Nan::New("term").ToLocalChecked()), parentFds)) {
+        delete task;
+        return;
+    }
+
+    Local<Object> attachedProcess = NewAttachedProcess(info, task, info[1], parentFds);
 
-    // env
-    std::vector<std::string> env;
-    Local<Value> envValue = options->Get(Nan::New("env").ToLocalChecked());
+    Local<Value> supervise = options->Get(Nan::New("supervise").ToLocalChecked());
 
-    if (envValue->IsArray()) {
-        env = JsArrayToVector(envValue.As<Array>());
+    if (supervise->IsObject()) {
+        QueueSupervisedAttach(info, task, attachedProcess, supervise->ToObject(),
+                SchedulerKey(options));
+    } else {
+        Local<Array> attachedProcesses = Nan::New<Array>(1);
+        attachedProcesses->Set(0, attachedProcess);
+
+        QueueAttachWorker(info, attachedProcesses, {task}, SchedulerKey(options));
+    }
+
+    info.GetReturnValue().Set(attachedProcess);
+}
+
+NAN_METHOD(AttachBinary) {
+    if (!info[0]->IsFunction() || !(node::Buffer::HasInstance(info[1]) || info[1]->IsUint32())
+            || !info[2]->IsArray() || !info[3]->IsObject()) {
+        return Nan::ThrowTypeError("Invalid argument");
     }
 
-    // cwd
-    std::string cwd = "/";
-    Local<Value> cwdValue = options->Get(Nan::New("cwd").ToLocalChecked());
+    Local<Object> options = info[3]->ToObject();
 
-    if (cwdValue->IsString()) {
-        cwd = *String::Utf8Value(cwdValue);
+    if (!options->Get(Nan::New("argv0").ToLocalChecked())->IsString()) {
+        return Nan::ThrowTypeError("Invalid argument");
     }
 
-    // uid & gid
-    int uid = -1;
-    Local<Value> uidValue = options->Get(Nan::New("uid").ToLocalChecked());
+    AttachTask *task = NewExecTask(GetAddonData(info), info[1], info[2], options);
 
-    if (uidValue->IsUint32()) {
-        uid = uidValue->Uint32Value();
+    if (!task) {
+        return;
     }
 
-    int gid = -1;
-    Local<Value> gidValue = options->Get(Nan::New("gid").ToLocalChecked());
+    std::vector<int> parentFds;
 
-    if (gidValue->IsUint32()) {
-        gid = gidValue->Uint32Value();
+    if (!CreateTaskFds(info, task, options->Get(Nan::New("stdio").ToLocalChecked()),
+            options->Get(Nan::New("term").ToLocalChecked()), parentFds)) {
+        delete task;
+        return;
     }
 
-    // cgroup
-    bool cgroup = true;
-    Local<Value> cgroupValue = options->Get(Nan::New("cgroup").ToLocalChecked());
+    Local<Object> attachedProcess = NewAttachedProcess(info, task,
+            options->Get(Nan::New("argv0").ToLocalChecked()), parentFds);
+
+    Local<Array> attachedProcesses = Nan::New<Array>(1);
+    attachedProcesses->Set(0, attachedProcess);
+
+    QueueAttachWorker(info, attachedProcesses, {task}, SchedulerKey(options));
+
+    info.GetReturnValue().Set(attachedProcess);
+}
 
-    if (cgroupValue->IsBoolean()) {
-        cgroup = cgroupValue->BooleanValue();
+NAN_METHOD(AttachMany) {
+    if (!info[0]->IsFunction() || !info[1]->IsArray() || !info[2]->IsObject()) {
+        return Nan::ThrowTypeError("Invalid argument");
     }
 
-    // namespaces
-    int namespaces = -1;
-    Local<Value> nsValue = options->Get(Nan::New("namespaces").ToLocalChecked());
+    Local<Array> specs = info[1].As<Array>();
+    std::vector<AttachTask*> tasks;
+
+    // validate all specs before creating any file descriptors
+    for (unsigned int i = 0; i < specs->Length(); i++) {
+        Local<Value> spec = specs->Get(i);
+        AttachTask *task = nullptr;
 
-    if (nsValue->IsArray()) {
-        Local<Array> nsArray = nsValue.As<Array>();
-        int length = nsArray->Length();
-        namespaces = 0;
+        if (spec->IsObject()) {
+            Local<Value> command = spec->ToObject()->Get(Nan::New("command").ToLocalChecked());
+            Local<Value> args = spec->ToObject()->Get(Nan::New("args").ToLocalChecked());
+            Local<Value> options = spec->ToObject()->Get(Nan::New("options").ToLocalChecked());
 
-        for (int i = 0; i < length; i++) {
-            std::string ns = *String::Utf8Value(nsArray->Get(i));
-            auto it = nsMap.find(ns);
-            if (it != nsMap.end()) {
-                namespaces |= it->second;
+            if (command->IsString() && args->IsArray() && options->IsObject()) {
+                task = NewExecTask(GetAddonData(info), command, args, options->ToObject());
             } else {
-                return Nan::ThrowTypeError(("invalid namespace: " + ns).c_str());
+                Nan::ThrowTypeError("Invalid argument");
             }
+        } else {
+            Nan::ThrowTypeError("Invalid argument");
         }
-    }
 
-    // stdio
-    std::vector<int> childFds, parentFds;
+        if (!task) {
+            for (AttachTask *t: tasks) {
+                delete t;
+            }
 
-    Local<Value> streams = options->Get(Nan::New("streams").ToLocalChecked());
-    Local<Value> term = options->Get(Nan::New("term").ToLocalChecked());
+            return;
+        }
 
-    CreateFds(streams, term, childFds, parentFds);
+        tasks.push_back(task);
+    }
 
-    Local<Array> fdArray = Nan::New<Array>(parentFds.size());
+    // all fds are created before any AttachedProcess takes them over
+    std::vector<std::vector<int>> parentFds(tasks.size());
 
-    for (unsigned int i = 0; i < parentFds.size(); i++) {
-        fdArray->Set(i, Nan::New<Uint32>(parentFds[i]));
-    }
+    for (unsigned int i = 0; i < tasks.size(); i++) {
+        Local<Object> options = specs->Get(i)->ToObject()
+            ->Get(Nan::New("options").ToLocalChecked())->ToObject();
 
-    // create AttachedProcess instance
-    Local<Function> AttachedProcess = info[0].As<Function>();
+        if (!CreateTaskFds(info, tasks[i], options->Get(Nan::New("stdio").ToLocalChecked()),
+                options->Get(Nan::New("term").ToLocalChecked()), parentFds[i])) {
+            for (unsigned int j = 0; j < tasks.size(); j++) {
+                CloseFds(parentFds[j]);
+                delete tasks[j];
+            }
 
-    const int argc = 4;
-    Local<Value> argv[argc] = {
-        info[1],
-        fdArray,
-        Nan::New(term->BooleanValue()),
-        info.Holder()->Get(Nan::New("owner").ToLocalChecked())
-    };
+            return;
+        }
+    }
+
+    Local<Array> attachedProcesses = Nan::New<Array>(tasks.size());
 
-    Local<Object> attachedProcess = AttachedProcess->NewInstance(argc, argv);
+    for (unsigned int i = 0; i < tasks.size(); i++) {
+        attachedProcesses->Set(i, NewAttachedProcess(info, tasks[i],
+                specs->Get(i)->ToObject()->Get(Nan::New("command").ToLocalChecked()),
+                parentFds[i]));
+    }
 
-    // queue worker
-    AttachWorker* attachWorker = new AttachWorker(container, attachedProcess,
-            new ExecCommand(command, arguments), cwd, env, childFds, term->BooleanValue(),
-            namespaces, cgroup, uid, gid);
-    Nan::AsyncQueueWorker(attachWorker);
+    QueueAttachWorker(info, attachedProcesses, tasks, SchedulerKey(info[2]->ToObject()));
 
-    info.GetReturnValue().Set(attachedProcess);
+    info.GetReturnValue().Set(attachedProcesses);
 }
 
 NAN_METHOD(OpenFile) {
@@ -270,44 +422,31 @@ NAN_METHOD(OpenFile) {
         return Nan::ThrowTypeError("Invalid argument");
     }
 
-    lxc_container *container = Unwrap(info.Holder());
-
     std::string path = *String::Utf8Value(info[1]);
     int flags = info[2]->Uint32Value();
     int mode = info[3]->Uint32Value();
     int uid = info[4]->Uint32Value();
     int gid = info[5]->Uint32Value();
 
-    OpenCommand *openCommand = new OpenCommand(path, flags, mode);
+    auto profile = std::make_shared<AttachProfile>("/", std::vector<std::string>(),
+            uid, gid, CLONE_NEWNS | CLONE_NEWUSER, false);
 
-    // stdio
-    std::vector<int> childFds, parentFds;
-    CreateFds(Nan::New(0), Nan::New(false), childFds, parentFds);
+    AttachTask *task = new AttachTask(new OpenCommand(path, flags, mode), profile, false);
 
-    Local<Array> fdArray = Nan::New<Array>(parentFds.size());
+    std::vector<int> parentFds;
 
-    for (unsigned int i = 0; i < parentFds.size(); i++) {
-        fdArray->Set(i, Nan::New<Uint32>(parentFds[i]));
+    if (!CreateTaskFds(info, task, Nan::Undefined(), Nan::New(false), parentFds)) {
+        delete task;
+        return;
     }
 
-    // create AttachedProcess instance
-    Local<Function> AttachedProcess = info[0].As<Function>();
-
-    const int argc = 4;
-    Local<Value> argv[argc] = {
-        Nan::New("OpenCommand").ToLocalChecked(),
-        fdArray,
-        Nan::New(false),
-        info.Holder()->Get(Nan::New("owner").ToLocalChecked())
-    };
+    Local<Object> attachedProcess = NewAttachedProcess(info, task,
+            Nan::New("OpenCommand").ToLocalChecked(), parentFds);
 
-    Local<Object> attachedProcess = AttachedProcess->NewInstance(argc, argv);
+    Local<Array> attachedProcesses = Nan::New<Array>(1);
+    attachedProcesses->Set(0, attachedProcess);
 
-    // queue worker
-    AttachWorker* attachWorker = new AttachWorker(container, attachedProcess,
-            openCommand, "/", std::vector<std::string>(), childFds, false,
-            CLONE_NEWNS | CLONE_NEWUSER, false, uid, gid);
-    Nan::AsyncQueueWorker(attachWorker);
+    QueueAttachWorker(info, attachedProcesses, {task}, Nan::Undefined());
 
     info.GetReturnValue().Set(attachedProcess);
 }
@@ -325,7 +464,8 @@ NAN_METHOD(ConfigFile) {
     String::Utf8Value file(info[0]);
     bool save = info[1]->BooleanValue();
 
-    Nan::AsyncQueueWorker(new ConfigWorker(container, callback, *file, save));
+    QueueWorker(info, new ConfigWorker(GetAddonData(info), container, callback,
+            *file, save));
 }
 
 NAN_METHOD(GetKeys) {
@@ -474,6 +614,10 @@ NAN_METHOD(SetCgroupItem) {
     }
 }
 
+NAN_METHOD(GetPlacement) {
+    info.GetReturnValue().Set(GetAddonData(info)->placement->Get(Unwrap(info.Holder())));
+}
+
 // Get container
 
 NAN_METHOD(GetContainer) {
@@ -488,52 +632,181 @@ NAN_METHOD(GetContainer) {
 
     Nan::Callback *callback = new Nan::Callback(info[3].As<Function>());
 
-    Nan::AsyncQueueWorker(new GetWorker(callback, *name, *path, defined));
+    QueueWorker(info, new GetWorker(GetAddonData(info), callback, *name, *path, defined));
+}
+
+// List containers
+
+NAN_METHOD(List) {
+    if (!info[0]->IsString() || !info[1]->IsObject() || !info[2]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    String::Utf8Value path(info[0]);
+    Local<Object> options = info[1]->ToObject();
+
+    Nan::Callback *callback = new Nan::Callback(info[2].As<Function>());
+
+    QueueWorker(info, new ListWorker(GetAddonData(info), callback, *path, options));
+}
+
+// Bulk operations
+
+static void QueueBulkWorker(const Nan::FunctionCallbackInfo<Value>& info,
+        BulkWorker::Operation operation) {
+    if (!info[0]->IsArray() || !info[1]->IsString() || !info[2]->IsObject()
+            || !info[3]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    std::vector<std::string> names = JsArrayToVector(info[0].As<Array>());
+    String::Utf8Value path(info[1]);
+    Local<Object> options = info[2]->ToObject();
+
+    Nan::Callback *callback = new Nan::Callback(info[3].As<Function>());
+
+    QueueWorker(info, new BulkWorker(GetAddonData(info), callback, operation,
+            names, *path, options));
+}
+
+NAN_METHOD(StopAll) {
+    QueueBulkWorker(info, BulkWorker::kStop);
+}
+
+NAN_METHOD(DestroyAll) {
+    QueueBulkWorker(info, BulkWorker::kDestroy);
+}
+
+NAN_METHOD(ExecAcross) {
+    if (!info[0]->IsArray() || !info[1]->IsString() || !info[2]->IsString()
+            || !info[3]->IsArray() || !info[4]->IsObject() || !info[6]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    std::vector<std::string> names = JsArrayToVector(info[0].As<Array>());
+    String::Utf8Value path(info[1]);
+    String::Utf8Value command(info[2]);
+    std::vector<std::string> args = JsArrayToVector(info[3].As<Array>());
+    Local<Object> options = info[4]->ToObject();
+
+    Nan::Callback *callback = new Nan::Callback(info[6].As<Function>());
+
+    QueueWorker(info, new ExecAcrossWorker(GetAddonData(info), callback, names,
+            *path, *command, args, options, info[5]), SchedulerKey(options));
 }
 
 // Initialization
 
+void AddonData::Unref() {
+    if (refs.fetch_sub(1) != 1) {
+        return;
+    }
+
+    delete scheduler;
+    delete metrics;
+    delete placement;
+
+    delete this;
+}
+
+// Runs when the context that loaded this instance (e.g. a worker thread) is
+// torn down. Handles are only closed here, node runs the loop once more
+// afterwards so that their close callbacks still fire. Workers that are still
+// on the threadpool keep the instance alive until they are destroyed.
+static void Cleanup(void *arg) {
+    AddonData *data = static_cast<AddonData*>(arg);
+
+    AttachCleanup(data);
+    SamplerCleanup(data);
+    WatchCleanup(data);
+    ShmCleanup(data);
+    MemoryCleanup(data);
+    SuperviseCleanup(data);
+    StartCleanup(data);
+
+    data->scheduler->Shutdown();
+
+    data->containerConstructor.Reset();
+    data->profileTemplate.Reset();
+    data->operationConstructor.Reset();
+
+    data->Unref();
+}
+
 void Init(Handle<Object> exports) {
     Nan::HandleScope scope;
 
-    on_exit(ExitHandler, nullptr);
+    // the handler is process wide, only register it for the first instance
+    static uv_once_t exitHandlerOnce = UV_ONCE_INIT;
+    uv_once(&exitHandlerOnce, RegisterExitHandler);
+
+    AddonData *data = new AddonData();
+    data->loop = Nan::GetCurrentEventLoop();
 
-    AttachInit(exports);
+    Local<External> external = data->External();
 
-    Local<FunctionTemplate>constructorTemplate = Nan::New<FunctionTemplate>(LXCContainer);
+    AsyncInit(exports, data);
+    SchedulerInit(exports, data);
+    MetricsInit(exports, data);
+    PlacementInit(exports, data);
+    AttachInit(exports, data);
+    SamplerInit(exports, data);
+    WatchInit(exports, data);
+    ShmInit(exports, data);
+    MemoryInit(exports, data);
+    SuperviseInit(exports, data);
+    ProfileInit(exports, data);
+
+    Local<FunctionTemplate>constructorTemplate = Nan::New<FunctionTemplate>(LXCContainer, external);
 
     constructorTemplate->SetClassName(Nan::New("LXCContainer").ToLocalChecked());
     constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
 
     // Methods
-    Nan::SetPrototypeMethod(constructorTemplate, "create", Create);
-    Nan::SetPrototypeMethod(constructorTemplate, "destroy", Destroy);
-    Nan::SetPrototypeMethod(constructorTemplate, "clone", Clone);
+    Nan::SetPrototypeMethod(constructorTemplate, "create", Create, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "destroy", Destroy, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "clone", Clone, external);
 
-    Nan::SetPrototypeMethod(constructorTemplate, "start", Start);
-    Nan::SetPrototypeMethod(constructorTemplate, "stop", Stop);
+    Nan::SetPrototypeMethod(constructorTemplate, "start", Start, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "stop", Stop, external);
 
-    Nan::SetPrototypeMethod(constructorTemplate, "attach", Attach);
+    Nan::SetPrototypeMethod(constructorTemplate, "attach", Attach, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "attachMany", AttachMany, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "attachBinary", AttachBinary, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "adopt", Adopt, external);
 
-    Nan::SetPrototypeMethod(constructorTemplate, "configFile", ConfigFile);
-    Nan::SetPrototypeMethod(constructorTemplate, "getKeys", GetKeys);
-    Nan::SetPrototypeMethod(constructorTemplate, "getConfigItem", GetConfigItem);
-    Nan::SetPrototypeMethod(constructorTemplate, "setConfigItem", SetConfigItem);
-    Nan::SetPrototypeMethod(constructorTemplate, "clearConfigItem", ClearConfigItem);
-    Nan::SetPrototypeMethod(constructorTemplate, "getRunningConfigItem", GetRunningConfigItem);
+    Nan::SetPrototypeMethod(constructorTemplate, "configFile", ConfigFile, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "getKeys", GetKeys, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "getConfigItem", GetConfigItem, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "setConfigItem", SetConfigItem, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "clearConfigItem", ClearConfigItem, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "getRunningConfigItem", GetRunningConfigItem, external);
 
-    Nan::SetPrototypeMethod(constructorTemplate, "getCgroupItem", GetCgroupItem);
-    Nan::SetPrototypeMethod(constructorTemplate, "setCgroupItem", SetCgroupItem);
+    Nan::SetPrototypeMethod(constructorTemplate, "getCgroupItem", GetCgroupItem, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "setCgroupItem", SetCgroupItem, external);
+    Nan::SetPrototypeMethod(constructorTemplate, "getPlacement", GetPlacement, external);
 
-    Nan::SetPrototypeMethod(constructorTemplate, "openFile", OpenFile);
+    Nan::SetPrototypeMethod(constructorTemplate, "openFile", OpenFile, external);
 
-    containerConstructor.Reset(constructorTemplate->GetFunction());
+    data->containerConstructor.Reset(constructorTemplate->GetFunction());
 
     // Exports
     exports->Set(Nan::New("getContainer").ToLocalChecked(),
-            Nan::New<FunctionTemplate>(GetContainer)->GetFunction());
+            Nan::New<FunctionTemplate>(GetContainer, external)->GetFunction());
+    exports->Set(Nan::New("list").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(List, external)->GetFunction());
+    exports->Set(Nan::New("stopAll").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(StopAll, external)->GetFunction());
+    exports->Set(Nan::New("destroyAll").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(DestroyAll, external)->GetFunction());
+    exports->Set(Nan::New("execAcross").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(ExecAcross, external)->GetFunction());
     exports->Set(Nan::New("version").ToLocalChecked(),
             Nan::New(lxc_get_version()).ToLocalChecked());
+
+#if NODE_MODULE_VERSION >= NODE_10_0_MODULE_VERSION
+    node::AddEnvironmentCleanupHook(Isolate::GetCurrent(), Cleanup, data);
+#endif
 }
 
-NODE_MODULE(lxc, Init)
+NAN_MODULE_WORKER_ENABLED(lxc, Init)
@@ -4,6 +4,9 @@
 #include <node.h>
 #include <lxc/lxccontainer.h>
 
-v8::Local<v8::Object> Wrap(lxc_container *container);
+#include "addon.h"
+
+v8::Local<v8::Object> Wrap(AddonData *data, lxc_container *container);
+lxc_container *Unwrap(v8::Local<v8::Object> object);
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef SOURCEBOX_MEMFD_H
+#define SOURCEBOX_MEMFD_H
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+// Not defined by older libc headers
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+// memfd_create(), fails with ENOSYS on kernels before 3.17.
+inline int MemfdCreate(const char *name, unsigned int flags) {
+#ifdef SYS_memfd_create
+    return syscall(SYS_memfd_create, name, flags);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#endif
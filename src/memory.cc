@@ -0,0 +1,353 @@
+#include "memory.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sstream>
+
+#include "cgroup.h"
+#include "lxc.h"
+
+using namespace v8;
+
+// Parses "some avg10=0.12 avg60=0.05 avg300=0.01 total=1234" lines.
+static Local<Object> ParsePressure(const std::string& content) {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> pressure = Nan::New<Object>();
+    std::istringstream lines(content);
+    std::string line;
+
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        std::string type, field;
+
+        if (!(fields >> type)) {
+            continue;
+        }
+
+        Local<Object> values = Nan::New<Object>();
+
+        while (fields >> field) {
+            size_t separator = field.find('=');
+
+            if (separator != std::string::npos) {
+                values->Set(Nan::New(field.substr(0, separator)).ToLocalChecked(),
+                        Nan::New(strtod(field.c_str() + separator + 1, nullptr)));
+            }
+        }
+
+        pressure->Set(Nan::New(type).ToLocalChecked(), values);
+    }
+
+    return scope.Escape(pressure);
+}
+
+MemoryWatcher *MemoryWatcher::Create(AddonData *data, const std::string& cgroup,
+        const Trigger& trigger, Local<Function> callback) {
+    int pressureFd = -1;
+
+    if (trigger.enabled) {
+        pressureFd = open((cgroup + "/memory.pressure").c_str(),
+                O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+        if (pressureFd == -1) {
+            return nullptr;
+        }
+
+        // the trigger lives as long as the fd
+        std::string spec = std::string(trigger.full ? "full " : "some ") +
+            std::to_string(trigger.stallUs) + " " + std::to_string(trigger.windowUs);
+
+        if (write(pressureFd, spec.c_str(), spec.size() + 1) == -1) {
+            int err = errno;
+            close(pressureFd);
+            errno = err;
+            return nullptr;
+        }
+    }
+
+    MemoryWatcher *watcher = new MemoryWatcher(data, cgroup, pressureFd, callback);
+
+    // only new OOM kills are reported
+    if (!watcher->ReadEvents(watcher->counters_)) {
+        int err = errno;
+        watcher->Close();
+        errno = err;
+        return nullptr;
+    }
+
+    return watcher;
+}
+
+MemoryWatcher::MemoryWatcher(AddonData *data, const std::string& cgroup,
+        int pressureFd, Local<Function> callback)
+        : data_(data), cgroup_(cgroup), pressureFd_(pressureFd), callback_(callback) {
+    events_ = new uv_fs_event_t;
+    events_->data = this;
+    uv_fs_event_init(data_->loop, events_);
+    uv_fs_event_start(events_, OnEvents, (cgroup_ + "/memory.events").c_str(), 0);
+    handles_++;
+
+    if (pressureFd_ != -1) {
+        pressure_ = new uv_poll_t;
+        pressure_->data = this;
+        uv_poll_init(data_->loop, pressure_, pressureFd_);
+        uv_poll_start(pressure_, UV_PRIORITIZED, OnPressure);
+        handles_++;
+    }
+
+    data_->memoryWatchers.insert(this);
+}
+
+MemoryWatcher::~MemoryWatcher() {
+    if (pressureFd_ != -1) {
+        close(pressureFd_);
+    }
+}
+
+Local<Object> MemoryWatcher::Wrap() {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> wrap = Nan::New(data_->memoryWatcherConstructor)->NewInstance();
+    Nan::SetInternalFieldPointer(wrap, 0, this);
+
+    wrap_.Reset(wrap);
+
+    return scope.Escape(wrap);
+}
+
+bool MemoryWatcher::ReadEvents(Counters& counters) {
+    std::string content;
+
+    if (!ReadFile(cgroup_ + "/memory.events", content)) {
+        return false;
+    }
+
+    ParseKeyedValue(content, "high", counters.high);
+    ParseKeyedValue(content, "max", counters.max);
+    ParseKeyedValue(content, "oom", counters.oom);
+    ParseKeyedValue(content, "oom_kill", counters.oomKill);
+
+    return true;
+}
+
+double MemoryWatcher::Refresh() {
+    Nan::HandleScope scope;
+
+    Counters counters;
+
+    if (closed_) {
+        return counters_.oomKill;
+    }
+
+    if (!ReadEvents(counters)) {
+        End();
+        return counters_.oomKill;
+    }
+
+    Counters previous = counters_;
+    counters_ = counters;
+
+    if (counters.oomKill > previous.oomKill) {
+        Local<Object> info = Nan::New<Object>();
+        info->Set(Nan::New("kills").ToLocalChecked(),
+                Nan::New<Number>(counters.oomKill - previous.oomKill));
+        info->Set(Nan::New("total").ToLocalChecked(), Nan::New<Number>(counters.oomKill));
+        info->Set(Nan::New("high").ToLocalChecked(), Nan::New<Number>(counters.high));
+        info->Set(Nan::New("max").ToLocalChecked(), Nan::New<Number>(counters.max));
+
+        Emit("oom", info);
+    }
+
+    return counters_.oomKill;
+}
+
+void MemoryWatcher::Emit(const char *event, Local<Value> info) {
+    const int argc = 2;
+    Local<Value> argv[argc] = {
+        Nan::New(event).ToLocalChecked(),
+        info
+    };
+
+    callback_.Call(argc, argv);
+}
+
+// The cgroup was removed, i.e. the container stopped.
+void MemoryWatcher::End() {
+    if (closed_) {
+        return;
+    }
+
+    Nan::HandleScope scope;
+    Nan::Callback callback(callback_.GetFunction());
+
+    Close();
+
+    const int argc = 2;
+    Local<Value> argv[argc] = {
+        Nan::New("end").ToLocalChecked(),
+        Nan::Null()
+    };
+
+    callback.Call(argc, argv);
+}
+
+void MemoryWatcher::Close() {
+    if (closed_) {
+        return;
+    }
+
+    Nan::HandleScope scope;
+
+    closed_ = true;
+    data_->memoryWatchers.erase(this);
+
+    if (!wrap_.IsEmpty()) {
+        Nan::SetInternalFieldPointer(Nan::New(wrap_), 0, nullptr);
+        wrap_.Reset();
+    }
+
+    callback_.Reset();
+
+    uv_close(reinterpret_cast<uv_handle_t*>(events_), OnClose);
+
+    if (pressure_) {
+        uv_close(reinterpret_cast<uv_handle_t*>(pressure_), OnClose);
+    }
+}
+
+void MemoryWatcher::OnClose(uv_handle_t *handle) {
+    MemoryWatcher *watcher = static_cast<MemoryWatcher*>(handle->data);
+
+    if (handle == reinterpret_cast<uv_handle_t*>(watcher->events_)) {
+        delete watcher->events_;
+    } else {
+        delete watcher->pressure_;
+    }
+
+    if (--watcher->handles_ == 0) {
+        delete watcher;
+    }
+}
+
+void MemoryWatcher::OnEvents(uv_fs_event_t *handle, const char *filename,
+        int events, int status) {
+    MemoryWatcher *watcher = static_cast<MemoryWatcher*>(handle->data);
+
+    if (status < 0) {
+        return watcher->End();
+    }
+
+    watcher->Refresh();
+}
+
+void MemoryWatcher::OnPressure(uv_poll_t *handle, int status, int events) {
+    MemoryWatcher *watcher = static_cast<MemoryWatcher*>(handle->data);
+    std::string content;
+
+    // POLLERR once the cgroup is removed
+    if (status < 0 || (events & UV_PRIORITIZED) == 0 ||
+            !ReadFile(watcher->cgroup_ + "/memory.pressure", content)) {
+        return watcher->End();
+    }
+
+    Nan::HandleScope scope;
+    watcher->Emit("pressure", ParsePressure(content));
+}
+
+// Javascript Functions
+
+NAN_METHOD(WatchMemory) {
+    if (!info[0]->IsObject() || !info[1]->IsObject() || !info[2]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    AddonData *data = GetAddonData(info);
+    lxc_container *container = Unwrap(info[0]->ToObject());
+    Local<Object> options = info[1]->ToObject();
+
+    std::string cgroup = CgroupPath(container->init_pid(container));
+
+    if (cgroup.empty()) {
+        return Nan::ThrowError("Container is not running");
+    }
+
+    MemoryWatcher::Trigger trigger;
+    Local<Value> pressure = options->Get(Nan::New("pressure").ToLocalChecked());
+
+    if (pressure->IsObject()) {
+        Local<Object> pressureOptions = pressure->ToObject();
+
+        trigger.enabled = true;
+        trigger.full = pressureOptions->Get(Nan::New("full").ToLocalChecked())->BooleanValue();
+
+        Local<Value> stall = pressureOptions->Get(Nan::New("stallMs").ToLocalChecked());
+        if (stall->IsUint32()) {
+            trigger.stallUs = stall->Uint32Value() * 1000;
+        }
+
+        Local<Value> window = pressureOptions->Get(Nan::New("windowMs").ToLocalChecked());
+        if (window->IsUint32()) {
+            trigger.windowUs = window->Uint32Value() * 1000;
+        }
+    }
+
+    MemoryWatcher *watcher = MemoryWatcher::Create(data, cgroup, trigger,
+            info[2].As<Function>());
+
+    if (!watcher) {
+        return Nan::ThrowError(Nan::ErrnoException(errno, "watchMemory", nullptr,
+                (cgroup + "/memory.pressure").c_str()));
+    }
+
+    info.GetReturnValue().Set(watcher->Wrap());
+}
+
+NAN_INLINE MemoryWatcher *UnwrapMemoryWatcher(Local<Object> object) {
+    return static_cast<MemoryWatcher*>(Nan::GetInternalFieldPointer(object, 0));
+}
+
+NAN_METHOD(MemoryWatcherRefresh) {
+    MemoryWatcher *watcher = UnwrapMemoryWatcher(info.Holder());
+
+    if (watcher) {
+        info.GetReturnValue().Set(watcher->Refresh());
+    }
+}
+
+NAN_METHOD(MemoryWatcherClose) {
+    MemoryWatcher *watcher = UnwrapMemoryWatcher(info.Holder());
+
+    if (watcher) {
+        watcher->Close();
+    }
+}
+
+// Initialization
+
+void MemoryInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> constructorTemplate = Nan::New<FunctionTemplate>();
+
+    constructorTemplate->SetClassName(Nan::New("MemoryWatcher").ToLocalChecked());
+    constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(constructorTemplate, "refresh", MemoryWatcherRefresh);
+    Nan::SetPrototypeMethod(constructorTemplate, "close", MemoryWatcherClose);
+
+    data->memoryWatcherConstructor.Reset(constructorTemplate->GetFunction());
+
+    // Exports
+    exports->Set(Nan::New("watchMemory").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(WatchMemory, data->External())->GetFunction());
+}
+
+void MemoryCleanup(AddonData *data) {
+    while (!data->memoryWatchers.empty()) {
+        (*data->memoryWatchers.begin())->Close();
+    }
+
+    data->memoryWatcherConstructor.Reset();
+}
@@ -0,0 +1,80 @@
+#ifndef SOURCEBOX_MEMORY_H
+#define SOURCEBOX_MEMORY_H
+
+#include <string>
+
+#include <node.h>
+#include <nan.h>
+
+#include "addon.h"
+
+/**
+ * Watches the memory events of a container's cgroup on the event loop.
+ * `memory.events` is watched with inotify and OOM kills are reported as
+ * `'oom'`. If a pressure trigger is set, the kernel wakes us through
+ * `memory.pressure` (PSI) once tasks stalled on memory for longer than the
+ * threshold within the window, which is reported as `'pressure'`. `'end'` is
+ * reported once the cgroup is gone.
+ */
+class MemoryWatcher {
+public:
+    struct Trigger {
+        bool enabled = false;
+        bool full = false;
+        unsigned int stallUs = 100000;
+        unsigned int windowUs = 1000000;
+    };
+
+    // Returns nullptr and sets errno on failure.
+    static MemoryWatcher *Create(AddonData *data, const std::string& cgroup,
+            const Trigger& trigger, v8::Local<v8::Function> callback);
+
+    v8::Local<v8::Object> Wrap();
+
+    // Reads memory.events right away, e.g. before the inotify event arrived,
+    // and reports new OOM kills. Returns the number of OOM kills so far.
+    double Refresh();
+
+    // Stops watching, the watcher is deleted once its handles are closed.
+    void Close();
+
+private:
+    struct Counters {
+        uint64_t high = 0;
+        uint64_t max = 0;
+        uint64_t oom = 0;
+        uint64_t oomKill = 0;
+    };
+
+    MemoryWatcher(AddonData *data, const std::string& cgroup, int pressureFd,
+            v8::Local<v8::Function> callback);
+    ~MemoryWatcher();
+
+    bool ReadEvents(Counters& counters);
+    void Emit(const char *event, v8::Local<v8::Value> info);
+    void End();
+
+    static void OnEvents(uv_fs_event_t *handle, const char *filename, int events,
+            int status);
+    static void OnPressure(uv_poll_t *handle, int status, int events);
+    static void OnClose(uv_handle_t *handle);
+
+    AddonData *data_;
+    std::string cgroup_;
+    int pressureFd_;
+
+    uv_fs_event_t *events_;
+    uv_poll_t *pressure_ = nullptr;
+    int handles_ = 0;
+
+    Counters counters_;
+    bool closed_ = false;
+
+    Nan::Callback callback_;
+    Nan::Persistent<v8::Object> wrap_;
+};
+
+void MemoryInit(v8::Handle<v8::Object> exports, AddonData *data);
+void MemoryCleanup(AddonData *data);
+
+#endif
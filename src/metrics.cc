@@ -0,0 +1,138 @@
+#include "metrics.h"
+
+using namespace v8;
+
+static const char *operationNames[] = {
+    "get", "list", "create", "destroy", "clone", "config",
+    "start", "stop", "attach", "stopAll", "destroyAll",
+    "execAcross"
+};
+
+static_assert(sizeof(operationNames) / sizeof(*operationNames) == Metrics::kOperationCount,
+        "operationNames does not match Metrics::Operation");
+
+const char *Metrics::OperationName(Operation operation) {
+    return operationNames[operation];
+}
+
+int Histogram::Bucket(uint64_t value) {
+    if (value < kSubBuckets) {
+        return value;
+    }
+
+    int exponent = 63 - __builtin_clzll(value);
+
+    if (exponent > kMaxExponent) {
+        return kBuckets - 1;
+    }
+
+    int sub = (value >> (exponent - kSubBits)) & (kSubBuckets - 1);
+
+    return (exponent - kSubBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t Histogram::UpperBound(int bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket + 1;
+    }
+
+    int exponent = bucket / kSubBuckets + kSubBits - 1;
+    int sub = bucket % kSubBuckets;
+
+    return static_cast<uint64_t>(kSubBuckets + sub + 1) << (exponent - kSubBits);
+}
+
+void Histogram::Record(uint64_t value) {
+    buckets_[Bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+
+    uint64_t max = max_.load(std::memory_order_relaxed);
+
+    while (value > max && !max_.compare_exchange_weak(max, value,
+            std::memory_order_relaxed)) { }
+}
+
+// Durations are reported in milliseconds, like everywhere else in the API.
+Local<Object> Histogram::Snapshot() const {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> snapshot = Nan::New<Object>();
+    Local<Array> buckets = Nan::New<Array>();
+
+    // the counters are read one by one, so they may be slightly inconsistent
+    for (int i = 0, n = 0; i < kBuckets; i++) {
+        uint64_t count = buckets_[i].load(std::memory_order_relaxed);
+
+        if (count == 0) {
+            continue;
+        }
+
+        Local<Array> bucket = Nan::New<Array>(2);
+        bucket->Set(0, Nan::New<Number>(UpperBound(i) / 1e6));
+        bucket->Set(1, Nan::New<Number>(static_cast<double>(count)));
+        buckets->Set(n++, bucket);
+    }
+
+    snapshot->Set(Nan::New("count").ToLocalChecked(), Nan::New<Number>(
+            static_cast<double>(count_.load(std::memory_order_relaxed))));
+    snapshot->Set(Nan::New("sum").ToLocalChecked(), Nan::New<Number>(
+            sum_.load(std::memory_order_relaxed) / 1e6));
+    snapshot->Set(Nan::New("max").ToLocalChecked(), Nan::New<Number>(
+            max_.load(std::memory_order_relaxed) / 1e6));
+    snapshot->Set(Nan::New("buckets").ToLocalChecked(), buckets);
+
+    return scope.Escape(snapshot);
+}
+
+Local<Object> Metrics::Snapshot() const {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> snapshot = Nan::New<Object>();
+    Local<Object> operationsObject = Nan::New<Object>();
+
+    for (int i = 0; i < kOperationCount; i++) {
+        const OperationMetrics& metrics = operations[i];
+        Local<Object> operation = Nan::New<Object>();
+
+        operation->Set(Nan::New("completed").ToLocalChecked(), Nan::New<Number>(
+                static_cast<double>(metrics.completed.load(std::memory_order_relaxed))));
+        operation->Set(Nan::New("errors").ToLocalChecked(), Nan::New<Number>(
+                static_cast<double>(metrics.errors.load(std::memory_order_relaxed))));
+        operation->Set(Nan::New("cancelled").ToLocalChecked(), Nan::New<Number>(
+                static_cast<double>(metrics.cancelled.load(std::memory_order_relaxed))));
+
+        operation->Set(Nan::New("queue").ToLocalChecked(), metrics.queue.Snapshot());
+        operation->Set(Nan::New("execute").ToLocalChecked(), metrics.execute.Snapshot());
+        operation->Set(Nan::New("callback").ToLocalChecked(), metrics.callback.Snapshot());
+
+        operationsObject->Set(Nan::New(operationNames[i]).ToLocalChecked(), operation);
+    }
+
+    Local<Object> attachObject = Nan::New<Object>();
+    attachObject->Set(Nan::New("cloexecLockWait").ToLocalChecked(), cloexecLockWait.Snapshot());
+    attachObject->Set(Nan::New("attach").ToLocalChecked(), attach.Snapshot());
+
+    snapshot->Set(Nan::New("operations").ToLocalChecked(), operationsObject);
+    snapshot->Set(Nan::New("attach").ToLocalChecked(), attachObject);
+
+    return scope.Escape(snapshot);
+}
+
+// Javascript Functions
+
+NAN_METHOD(GetMetrics) {
+    info.GetReturnValue().Set(GetAddonData(info)->metrics->Snapshot());
+}
+
+// Initialization
+
+void MetricsInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    data->metrics = new Metrics();
+
+    // Exports
+    exports->Set(Nan::New("metrics").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(GetMetrics, data->External())->GetFunction());
+}
@@ -0,0 +1,83 @@
+#ifndef SOURCEBOX_METRICS_H
+#define SOURCEBOX_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+
+#include <node.h>
+#include <nan.h>
+
+#include "addon.h"
+
+/**
+ * Histogram of durations in nanoseconds with log-linear buckets: every power
+ * of two is split into 8 buckets, which keeps the relative error below 12.5%.
+ * Recording only takes a few relaxed atomic operations and may happen on any
+ * thread.
+ */
+class Histogram {
+public:
+    static const int kSubBits = 3;
+    static const int kSubBuckets = 1 << kSubBits;
+    static const int kMaxExponent = 43; // ~2.4 hours
+    static const int kBuckets = (kMaxExponent - kSubBits + 2) * kSubBuckets;
+
+    void Record(uint64_t value);
+
+    // Exclusive upper bound of a bucket.
+    static uint64_t UpperBound(int bucket);
+
+    v8::Local<v8::Object> Snapshot() const;
+
+private:
+    static int Bucket(uint64_t value);
+
+    std::atomic<uint64_t> buckets_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+class Metrics {
+public:
+    enum Operation {
+        kGet,
+        kList,
+        kCreate,
+        kDestroy,
+        kClone,
+        kConfig,
+        kStart,
+        kStop,
+        kAttach,
+        kStopAll,
+        kDestroyAll,
+        kExecAcross,
+        kOperationCount
+    };
+
+    struct OperationMetrics {
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> errors{0};
+        std::atomic<uint64_t> cancelled{0};
+
+        // submitted until Execute(), including the time in the scheduler
+        Histogram queue;
+        Histogram execute;
+        Histogram callback;
+    };
+
+    static const char *OperationName(Operation operation);
+
+    OperationMetrics operations[kOperationCount];
+
+    // AttachWorker only
+    Histogram cloexecLockWait;
+    Histogram attach;
+
+    v8::Local<v8::Object> Snapshot() const;
+};
+
+void MetricsInit(v8::Handle<v8::Object> exports, AddonData *data);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SOURCEBOX_PARALLEL_H
+#define SOURCEBOX_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * Calls `fn(i)` for every `i` in `[0, count)`, using up to `concurrency`
+ * threads including the calling one. Returns once all calls have finished.
+ */
+template <typename F>
+void ParallelFor(size_t count, unsigned int concurrency, F fn) {
+    std::atomic<size_t> next(0);
+
+    auto run = [&] {
+        size_t i;
+
+        while ((i = next++) < count) {
+            fn(i);
+        }
+    };
+
+    size_t threads = std::min<size_t>(std::max(concurrency, 1u), count);
+    std::vector<std::thread> pool;
+
+    for (size_t i = 1; i < threads; i++) {
+        pool.emplace_back(run);
+    }
+
+    run();
+
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+#endif
@@ -0,0 +1,407 @@
+#include "placement.h"
+
+#include <dirent.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "cgroup.h"
+
+using namespace v8;
+
+// Counted as load for every container, so that idle containers are spread too
+static const double kContainerWeight = 0.05;
+
+bool ParseCpuList(const std::string& list, std::vector<int>& cpus) {
+    std::istringstream ranges(list);
+    std::string range;
+
+    cpus.clear();
+
+    while (std::getline(ranges, range, ',')) {
+        // sysfs files end with a newline
+        range.erase(range.find_last_not_of(" \n") + 1);
+
+        if (range.empty()) {
+            continue;
+        }
+
+        char *end;
+        long first = strtol(range.c_str(), &end, 10);
+        long last = first;
+
+        if (*end == '-') {
+            last = strtol(end + 1, &end, 10);
+        }
+
+        if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+    return true;
+}
+
+std::string FormatCpuList(const std::vector<int>& cpus) {
+    std::string list;
+
+    for (size_t i = 0; i < cpus.size(); i++) {
+        size_t j = i;
+
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            j++;
+        }
+
+        if (!list.empty()) {
+            list += ",";
+        }
+
+        list += std::to_string(cpus[i]);
+
+        if (j > i) {
+            list += "-" + std::to_string(cpus[j]);
+        }
+
+        i = j;
+    }
+
+    return list;
+}
+
+static Local<Array> CpuArray(const std::vector<int>& cpus) {
+    Nan::EscapableHandleScope scope;
+
+    Local<Array> array = Nan::New<Array>(cpus.size());
+
+    for (unsigned int i = 0; i < cpus.size(); i++) {
+        array->Set(i, Nan::New(cpus[i]));
+    }
+
+    return scope.Escape(array);
+}
+
+Placement::Placement() {
+    uv_mutex_init(&mutex_);
+
+    const std::string base = "/sys/devices/system/node";
+    DIR *dir = opendir(base.c_str());
+
+    if (dir) {
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            std::string content;
+            Node node;
+
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+                    name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+
+            node.id = std::stoi(name.substr(4));
+
+            // memory only nodes have no cpus
+            if (ReadFile(base + "/" + name + "/cpulist", content) &&
+                    ParseCpuList(content, node.cpus) && !node.cpus.empty()) {
+                nodes_.push_back(node);
+            }
+        }
+
+        closedir(dir);
+    }
+
+    std::sort(nodes_.begin(), nodes_.end(), [](const Node& a, const Node& b) {
+        return a.id < b.id;
+    });
+
+    // kernels without NUMA support
+    if (nodes_.empty()) {
+        std::string content;
+        Node node;
+
+        node.id = 0;
+
+        if (ReadFile("/sys/devices/system/cpu/online", content)) {
+            ParseCpuList(content, node.cpus);
+        }
+
+        nodes_.push_back(node);
+    }
+}
+
+Placement::~Placement() {
+    uv_mutex_destroy(&mutex_);
+}
+
+std::string Placement::Key(lxc_container *container) {
+    return std::string(container->config_path) + "/" + container->name;
+}
+
+// Samples the CPU usage of all placed containers. Containers whose cgroup is
+// gone were stopped without being released.
+void Placement::UpdateLoad() {
+    uint64_t now = uv_hrtime();
+
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        Entry& entry = it->second;
+        std::string content;
+        uint64_t usage;
+
+        if (entry.cgroup.empty()) {
+            ++it;
+            continue;
+        }
+
+        if (!ReadFile(entry.cgroup + "/cpu.stat", content)) {
+            it = entries_.erase(it);
+            continue;
+        }
+
+        if (ParseKeyedValue(content, "usage_usec", usage)) {
+            if (entry.time > 0 && now > entry.time && usage >= entry.usage) {
+                entry.load = (usage - entry.usage) * 1e3 / (now - entry.time);
+            }
+
+            entry.usage = usage;
+            entry.time = now;
+        }
+
+        ++it;
+    }
+}
+
+std::vector<int> Placement::Candidates(const Node& node, bool reserved) const {
+    std::vector<int> cpus;
+
+    for (int cpu : node.cpus) {
+        if ((reserved_.count(cpu) > 0) == reserved) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+bool Placement::Assign(lxc_container *container, const Request& request,
+        std::string& error) {
+    std::string key = Key(container);
+    Entry entry;
+
+    uv_mutex_lock(&mutex_);
+
+    // a restarted container is placed again
+    entries_.erase(key);
+    UpdateLoad();
+
+    std::map<int, double> nodeLoad;
+    std::map<int, unsigned int> cpuUsers;
+
+    for (auto& pair : entries_) {
+        nodeLoad[pair.second.node] += pair.second.load + kContainerWeight;
+
+        for (int cpu : pair.second.cpus) {
+            cpuUsers[cpu]++;
+        }
+    }
+
+    const Node *best = nullptr;
+    std::vector<int> cpus;
+    double bestScore = 0;
+
+    for (const Node& node : nodes_) {
+        std::vector<int> candidates = Candidates(node, request.reserved);
+
+        if (candidates.empty()) {
+            continue;
+        }
+
+        double score = nodeLoad[node.id] / candidates.size();
+
+        if (!best || score < bestScore) {
+            best = &node;
+            bestScore = score;
+            cpus = candidates;
+        }
+    }
+
+    if (!best) {
+        uv_mutex_unlock(&mutex_);
+        error = request.reserved ? "No reserved cpus" : "No cpus available for placement";
+        return false;
+    }
+
+    // the least shared cores of the node
+    if (request.cpus > 0 && request.cpus < cpus.size()) {
+        std::stable_sort(cpus.begin(), cpus.end(), [&cpuUsers](int a, int b) {
+            return cpuUsers[a] < cpuUsers[b];
+        });
+
+        cpus.resize(request.cpus);
+        std::sort(cpus.begin(), cpus.end());
+    }
+
+    entry.node = best->id;
+    entry.cpus = cpus;
+    entry.reserved = request.reserved;
+    entry.cgroup = CgroupPath(container->init_pid(container));
+
+    entries_[key] = entry;
+
+    uv_mutex_unlock(&mutex_);
+
+    // mems first, the cpus of a node are only valid together with its memory
+    std::string mems = std::to_string(entry.node);
+    std::string cpuList = FormatCpuList(entry.cpus);
+
+    if (!container->set_cgroup_item(container, "cpuset.mems", mems.c_str()) ||
+            !container->set_cgroup_item(container, "cpuset.cpus", cpuList.c_str())) {
+        uv_mutex_lock(&mutex_);
+        entries_.erase(key);
+        uv_mutex_unlock(&mutex_);
+
+        error = "Failed to set cpuset of container";
+        return false;
+    }
+
+    return true;
+}
+
+void Placement::Release(lxc_container *container) {
+    uv_mutex_lock(&mutex_);
+    entries_.erase(Key(container));
+    uv_mutex_unlock(&mutex_);
+}
+
+void Placement::Configure(Local<Object> options) {
+    Local<Value> reserved = options->Get(Nan::New("reserved").ToLocalChecked());
+
+    if (!reserved->IsArray()) {
+        return;
+    }
+
+    Local<Array> array = reserved.As<Array>();
+
+    uv_mutex_lock(&mutex_);
+
+    // existing assignments keep their cores
+    reserved_.clear();
+
+    for (unsigned int i = 0; i < array->Length(); i++) {
+        reserved_.insert(array->Get(i)->Int32Value());
+    }
+
+    uv_mutex_unlock(&mutex_);
+}
+
+Local<Object> Placement::EntryObject(const Entry& entry) {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> object = Nan::New<Object>();
+    object->Set(Nan::New("node").ToLocalChecked(), Nan::New(entry.node));
+    object->Set(Nan::New("cpus").ToLocalChecked(), CpuArray(entry.cpus));
+    object->Set(Nan::New("reserved").ToLocalChecked(), Nan::New(entry.reserved));
+    object->Set(Nan::New("load").ToLocalChecked(), Nan::New(entry.load));
+
+    return scope.Escape(object);
+}
+
+Local<Object> Placement::Stats() {
+    Nan::EscapableHandleScope scope;
+
+    uv_mutex_lock(&mutex_);
+
+    UpdateLoad();
+
+    Local<Array> nodes = Nan::New<Array>(nodes_.size());
+
+    for (unsigned int i = 0; i < nodes_.size(); i++) {
+        const Node& node = nodes_[i];
+        unsigned int containers = 0;
+        double load = 0;
+
+        for (auto& pair : entries_) {
+            if (pair.second.node == node.id) {
+                containers++;
+                load += pair.second.load;
+            }
+        }
+
+        Local<Object> object = Nan::New<Object>();
+        object->Set(Nan::New("id").ToLocalChecked(), Nan::New(node.id));
+        object->Set(Nan::New("cpus").ToLocalChecked(), CpuArray(node.cpus));
+        object->Set(Nan::New("reserved").ToLocalChecked(), CpuArray(Candidates(node, true)));
+        object->Set(Nan::New("containers").ToLocalChecked(), Nan::New(containers));
+        object->Set(Nan::New("load").ToLocalChecked(), Nan::New(load));
+
+        nodes->Set(i, object);
+    }
+
+    Local<Object> assignments = Nan::New<Object>();
+
+    for (auto& pair : entries_) {
+        assignments->Set(Nan::New(pair.first).ToLocalChecked(), EntryObject(pair.second));
+    }
+
+    uv_mutex_unlock(&mutex_);
+
+    Local<Object> stats = Nan::New<Object>();
+    stats->Set(Nan::New("nodes").ToLocalChecked(), nodes);
+    stats->Set(Nan::New("assignments").ToLocalChecked(), assignments);
+
+    return scope.Escape(stats);
+}
+
+Local<Value> Placement::Get(lxc_container *container) {
+    Nan::EscapableHandleScope scope;
+    Local<Value> value = Nan::Null();
+
+    uv_mutex_lock(&mutex_);
+
+    auto it = entries_.find(Key(container));
+
+    if (it != entries_.end()) {
+        value = EntryObject(it->second);
+    }
+
+    uv_mutex_unlock(&mutex_);
+
+    return scope.Escape(value);
+}
+
+// Javascript Functions
+
+NAN_METHOD(ConfigurePlacement) {
+    if (!info[0]->IsObject()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    GetAddonData(info)->placement->Configure(info[0]->ToObject());
+}
+
+NAN_METHOD(PlacementStats) {
+    info.GetReturnValue().Set(GetAddonData(info)->placement->Stats());
+}
+
+// Initialization
+
+void PlacementInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    data->placement = new Placement();
+
+    Local<External> external = data->External();
+
+    // Exports
+    exports->Set(Nan::New("configurePlacement").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(ConfigurePlacement, external)->GetFunction());
+    exports->Set(Nan::New("placementStats").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(PlacementStats, external)->GetFunction());
+}
@@ -0,0 +1,86 @@
+#ifndef SOURCEBOX_PLACEMENT_H
+#define SOURCEBOX_PLACEMENT_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <node.h>
+#include <nan.h>
+#include <lxc/lxccontainer.h>
+
+#include "addon.h"
+
+/**
+ * Assigns started containers to a NUMA node and writes the node's cores and
+ * memory to their cpuset. New containers go to the node with the lowest CPU
+ * load per core, measured from the cgroup statistics of the containers that
+ * are already placed there. Reserved cores are left out, unless a container
+ * asks for them, e.g. for latency critical sessions.
+ *
+ * Assign() runs on the threadpool, everything else on the loop thread.
+ */
+class Placement {
+public:
+    struct Request {
+        // use the reserved cores instead of the shared ones
+        bool reserved = false;
+
+        // number of cores, 0 for all cores of the node
+        unsigned int cpus = 0;
+    };
+
+    Placement();
+    ~Placement();
+
+    // Returns false and sets `error` if the cpuset could not be written.
+    bool Assign(lxc_container *container, const Request& request, std::string& error);
+
+    void Release(lxc_container *container);
+
+    void Configure(v8::Local<v8::Object> options);
+    v8::Local<v8::Object> Stats();
+
+    // The assignment of a container, null if it was not placed.
+    v8::Local<v8::Value> Get(lxc_container *container);
+
+private:
+    struct Node {
+        int id;
+        std::vector<int> cpus;
+    };
+
+    struct Entry {
+        int node;
+        std::vector<int> cpus;
+        bool reserved;
+        std::string cgroup;
+
+        // CPU time used per second, from the last two samples
+        double load = 0;
+        uint64_t usage = 0;
+        uint64_t time = 0;
+    };
+
+    static std::string Key(lxc_container *container);
+
+    void UpdateLoad();
+    std::vector<int> Candidates(const Node& node, bool reserved) const;
+    v8::Local<v8::Object> EntryObject(const Entry& entry);
+
+    std::vector<Node> nodes_;
+    std::set<int> reserved_;
+    std::map<std::string, Entry> entries_;
+
+    uv_mutex_t mutex_;
+};
+
+// Parses a cpu list such as "0-3,8,10-11". Returns false if it is invalid.
+bool ParseCpuList(const std::string& list, std::vector<int>& cpus);
+
+std::string FormatCpuList(const std::vector<int>& cpus);
+
+void PlacementInit(v8::Handle<v8::Object> exports, AddonData *data);
+
+#endif
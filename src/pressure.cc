@@ -0,0 +1,245 @@
+#include "pressure.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+using namespace v8;
+
+static const char *resourceNames[] = {
+    "cpu", "memory", "io"
+};
+
+static_assert(sizeof(resourceNames) / sizeof(*resourceNames) == PressureGate::kResourceCount,
+        "resourceNames does not match PressureGate::Resource");
+
+// Heavy operations gated by default
+static const Metrics::Operation defaultGated[] = {
+    Metrics::kCreate, Metrics::kClone, Metrics::kStart
+};
+
+PressureGate::PressureGate(uv_loop_t *loop, std::function<void()> onOpen)
+        : loop_(loop), onOpen_(onOpen) {
+    timer_ = new uv_timer_t;
+    timer_->data = this;
+    uv_timer_init(loop_, timer_);
+    uv_unref(reinterpret_cast<uv_handle_t*>(timer_));
+
+    for (Metrics::Operation operation : defaultGated) {
+        gated_[operation] = true;
+    }
+}
+
+PressureGate::~PressureGate() {
+    for (Trigger& trigger : triggers_) {
+        Unregister(trigger);
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(timer_), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_timer_t*>(handle);
+    });
+}
+
+bool PressureGate::Configure(Local<Value> value, std::string& error) {
+    for (Trigger& trigger : triggers_) {
+        Unregister(trigger);
+    }
+
+    if (closed_) {
+        uv_timer_stop(timer_);
+        closed_ = false;
+        closedTotal_ += uv_hrtime() - closedSince_;
+    }
+
+    if (!value->IsObject()) {
+        return true;
+    }
+
+    Local<Object> options = value->ToObject();
+
+    reject_ = options->Get(Nan::New("reject").ToLocalChecked())->BooleanValue();
+
+    Local<Value> hold = options->Get(Nan::New("holdMs").ToLocalChecked());
+    if (hold->IsUint32()) {
+        holdMs_ = hold->Uint32Value();
+    }
+
+    Local<Value> operations = options->Get(Nan::New("operations").ToLocalChecked());
+
+    if (operations->IsArray()) {
+        Local<Array> array = operations.As<Array>();
+
+        std::fill(gated_, gated_ + Metrics::kOperationCount, false);
+
+        for (unsigned int i = 0; i < array->Length(); i++) {
+            std::string name = *String::Utf8Value(array->Get(i));
+
+            for (int operation = 0; operation < Metrics::kOperationCount; operation++) {
+                if (name == Metrics::OperationName(static_cast<Metrics::Operation>(operation))) {
+                    gated_[operation] = true;
+                }
+            }
+        }
+    }
+
+    for (int resource = 0; resource < kResourceCount; resource++) {
+        Local<Value> trigger = options->Get(Nan::New(resourceNames[resource]).ToLocalChecked());
+
+        if (!trigger->IsObject()) {
+            continue;
+        }
+
+        if (!Register(static_cast<Resource>(resource), trigger->ToObject(), error)) {
+            for (Trigger& trigger : triggers_) {
+                Unregister(trigger);
+            }
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool PressureGate::Register(Resource resource, Local<Object> options, std::string& error) {
+    Trigger& trigger = triggers_[resource];
+    std::string path = std::string("/proc/pressure/") + resourceNames[resource];
+
+    trigger.full = options->Get(Nan::New("full").ToLocalChecked())->BooleanValue();
+    trigger.stallUs = options->Get(Nan::New("stallMs").ToLocalChecked())->Uint32Value() * 1000;
+    trigger.windowUs = options->Get(Nan::New("windowMs").ToLocalChecked())->Uint32Value() * 1000;
+    trigger.fired = 0;
+
+    trigger.fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+
+    if (trigger.fd == -1) {
+        error = "Failed to open " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    // the trigger lives as long as the fd
+    std::string spec = std::string(trigger.full ? "full " : "some ") +
+        std::to_string(trigger.stallUs) + " " + std::to_string(trigger.windowUs);
+
+    if (write(trigger.fd, spec.c_str(), spec.size() + 1) == -1) {
+        error = "Failed to set trigger on " + path + ": " + strerror(errno);
+        close(trigger.fd);
+        trigger.fd = -1;
+        return false;
+    }
+
+    trigger.poll = new uv_poll_t;
+    trigger.poll->data = this;
+    uv_poll_init(loop_, trigger.poll, trigger.fd);
+    uv_poll_start(trigger.poll, UV_PRIORITIZED, OnPoll);
+    uv_unref(reinterpret_cast<uv_handle_t*>(trigger.poll));
+
+    return true;
+}
+
+void PressureGate::Unregister(Trigger& trigger) {
+    if (trigger.poll) {
+        uv_close(reinterpret_cast<uv_handle_t*>(trigger.poll), [](uv_handle_t *handle) {
+            delete reinterpret_cast<uv_poll_t*>(handle);
+        });
+
+        trigger.poll = nullptr;
+    }
+
+    if (trigger.fd != -1) {
+        close(trigger.fd);
+        trigger.fd = -1;
+    }
+}
+
+// Closes the gate, or keeps it closed for another `holdMs`.
+void PressureGate::Fire(Trigger& trigger) {
+    trigger.fired++;
+
+    if (!closed_) {
+        closed_ = true;
+        closedSince_ = uv_hrtime();
+    }
+
+    uv_timer_start(timer_, OnTimer, holdMs_, 0);
+}
+
+void PressureGate::OnPoll(uv_poll_t *handle, int status, int events) {
+    PressureGate *gate = static_cast<PressureGate*>(handle->data);
+
+    for (Trigger& trigger : gate->triggers_) {
+        if (trigger.poll != handle) {
+            continue;
+        }
+
+        if (status < 0) {
+            // the trigger is broken, keep the gate open rather than stuck
+            gate->Unregister(trigger);
+        } else if (events & UV_PRIORITIZED) {
+            gate->Fire(trigger);
+        }
+
+        return;
+    }
+}
+
+void PressureGate::OnTimer(uv_timer_t *handle) {
+    PressureGate *gate = static_cast<PressureGate*>(handle->data);
+
+    gate->closed_ = false;
+    gate->closedTotal_ += uv_hrtime() - gate->closedSince_;
+
+    gate->onOpen_();
+}
+
+Local<Object> PressureGate::Stats() {
+    Nan::EscapableHandleScope scope;
+
+    uint64_t closedTotal = closedTotal_ + (closed_ ? uv_hrtime() - closedSince_ : 0);
+
+    Local<Object> triggers = Nan::New<Object>();
+
+    for (int resource = 0; resource < kResourceCount; resource++) {
+        Trigger& trigger = triggers_[resource];
+
+        if (trigger.fd == -1) {
+            continue;
+        }
+
+        Local<Object> object = Nan::New<Object>();
+        object->Set(Nan::New("type").ToLocalChecked(),
+                Nan::New(trigger.full ? "full" : "some").ToLocalChecked());
+        object->Set(Nan::New("stallMs").ToLocalChecked(), Nan::New(trigger.stallUs / 1000));
+        object->Set(Nan::New("windowMs").ToLocalChecked(), Nan::New(trigger.windowUs / 1000));
+        object->Set(Nan::New("fired").ToLocalChecked(),
+                Nan::New<Number>(static_cast<double>(trigger.fired)));
+
+        triggers->Set(Nan::New(resourceNames[resource]).ToLocalChecked(), object);
+    }
+
+    Local<Array> operations = Nan::New<Array>();
+
+    for (int operation = 0; operation < Metrics::kOperationCount; operation++) {
+        if (gated_[operation]) {
+            operations->Set(operations->Length(), Nan::New(
+                    Metrics::OperationName(static_cast<Metrics::Operation>(operation))).ToLocalChecked());
+        }
+    }
+
+    Local<Object> stats = Nan::New<Object>();
+    stats->Set(Nan::New("closed").ToLocalChecked(), Nan::New(closed_));
+    stats->Set(Nan::New("closedMs").ToLocalChecked(),
+            Nan::New<Number>(static_cast<double>(closedTotal / 1000000)));
+    stats->Set(Nan::New("holdMs").ToLocalChecked(), Nan::New(holdMs_));
+    stats->Set(Nan::New("reject").ToLocalChecked(), Nan::New(reject_));
+    stats->Set(Nan::New("operations").ToLocalChecked(), operations);
+    stats->Set(Nan::New("triggers").ToLocalChecked(), triggers);
+    stats->Set(Nan::New("delayed").ToLocalChecked(),
+            Nan::New<Number>(static_cast<double>(delayed_)));
+    stats->Set(Nan::New("rejected").ToLocalChecked(),
+            Nan::New<Number>(static_cast<double>(rejected_)));
+
+    return scope.Escape(stats);
+}
@@ -0,0 +1,99 @@
+#ifndef SOURCEBOX_PRESSURE_H
+#define SOURCEBOX_PRESSURE_H
+
+#include <functional>
+#include <string>
+
+#include <node.h>
+#include <nan.h>
+
+#include "metrics.h"
+
+/**
+ * Admission gate for heavy operations, driven by the host's pressure stall
+ * information (PSI). A trigger is registered on /proc/pressure/{cpu,memory,io}
+ * for every configured resource, the kernel wakes us once tasks stalled longer
+ * than the threshold within the window. The gate then closes for `holdMs`,
+ * every further trigger extends it. While it is closed, the scheduler holds
+ * back (or rejects) heavy operations, cheap ones are dispatched as usual.
+ *
+ * Everything runs on the loop thread.
+ */
+class PressureGate {
+public:
+    enum Resource {
+        kCpu,
+        kMemory,
+        kIo,
+        kResourceCount
+    };
+
+    PressureGate(uv_loop_t *loop, std::function<void()> onOpen);
+    ~PressureGate();
+
+    // Replaces the triggers. Returns false and sets `error` if a trigger could
+    // not be registered, the gate is disabled then.
+    bool Configure(v8::Local<v8::Value> options, std::string& error);
+
+    bool Closed() const {
+        return closed_;
+    }
+
+    // Whether the operation is held back while the gate is closed.
+    bool Gates(Metrics::Operation operation) const {
+        return gated_[operation];
+    }
+
+    // Reject gated operations instead of delaying them.
+    bool Rejects() const {
+        return reject_;
+    }
+
+    void CountDelayed() {
+        delayed_++;
+    }
+
+    void CountRejected() {
+        rejected_++;
+    }
+
+    v8::Local<v8::Object> Stats();
+
+private:
+    struct Trigger {
+        int fd = -1;
+        uv_poll_t *poll = nullptr;
+
+        bool full = false;
+        unsigned int stallUs = 0;
+        unsigned int windowUs = 0;
+
+        uint64_t fired = 0;
+    };
+
+    bool Register(Resource resource, v8::Local<v8::Object> options, std::string& error);
+    void Unregister(Trigger& trigger);
+    void Fire(Trigger& trigger);
+
+    static void OnPoll(uv_poll_t *handle, int status, int events);
+    static void OnTimer(uv_timer_t *handle);
+
+    uv_loop_t *loop_;
+    std::function<void()> onOpen_;
+
+    Trigger triggers_[kResourceCount];
+    uv_timer_t *timer_;
+
+    bool gated_[Metrics::kOperationCount] = {};
+    bool reject_ = false;
+    unsigned int holdMs_ = 2000;
+
+    bool closed_ = false;
+    uint64_t closedSince_ = 0;
+    uint64_t closedTotal_ = 0;
+
+    uint64_t delayed_ = 0;
+    uint64_t rejected_ = 0;
+};
+
+#endif
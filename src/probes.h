@@ -0,0 +1,33 @@
+#ifndef SOURCEBOX_PROBES_H
+#define SOURCEBOX_PROBES_H
+
+/**
+ * Static tracepoints (USDT) of the `sourcebox_lxc` provider, e.g.
+ *
+ *     bpftrace -e 'usdt:./build/Release/lxc.node:sourcebox_lxc:attach__done { ... }'
+ *
+ * A probe compiles to a single nop unless a tracer is attached. Without
+ * sys/sdt.h (systemtap-sdt-dev), the probes are left out entirely.
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define HAVE_SYS_SDT_H
+#endif
+#endif
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define PROBE(name) DTRACE_PROBE(sourcebox_lxc, name)
+#define PROBE1(name, a) DTRACE_PROBE1(sourcebox_lxc, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(sourcebox_lxc, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(sourcebox_lxc, name, a, b, c)
+#else
+#define PROBE(name)
+#define PROBE1(name, a)
+#define PROBE2(name, a, b)
+#define PROBE3(name, a, b, c)
+#endif
+
+#endif
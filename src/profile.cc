@@ -0,0 +1,394 @@
+#include "profile.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstring>
+#include <map>
+
+#include "placement.h"
+
+using namespace v8;
+
+static const std::map<std::string, int> nsMap = {
+    {"ns", CLONE_NEWNS},
+    {"mount", CLONE_NEWNS},
+    {"uts", CLONE_NEWUTS},
+    {"ipc", CLONE_NEWIPC},
+    {"user", CLONE_NEWUSER},
+    {"pid", CLONE_NEWPID},
+    {"net", CLONE_NEWNET},
+};
+
+static const std::map<std::string, int> limitMap = {
+    {"as", RLIMIT_AS},
+    {"core", RLIMIT_CORE},
+    {"cpu", RLIMIT_CPU},
+    {"data", RLIMIT_DATA},
+    {"fsize", RLIMIT_FSIZE},
+    {"locks", RLIMIT_LOCKS},
+    {"memlock", RLIMIT_MEMLOCK},
+    {"msgqueue", RLIMIT_MSGQUEUE},
+    {"nice", RLIMIT_NICE},
+    {"nofile", RLIMIT_NOFILE},
+    {"nproc", RLIMIT_NPROC},
+    {"rss", RLIMIT_RSS},
+    {"rtprio", RLIMIT_RTPRIO},
+    {"sigpending", RLIMIT_SIGPENDING},
+    {"stack", RLIMIT_STACK},
+};
+
+static const std::map<std::string, int> schedPolicyMap = {
+    {"other", SCHED_OTHER},
+    {"batch", SCHED_BATCH},
+    {"idle", SCHED_IDLE},
+};
+
+// From linux/ioprio.h, which is not installed everywhere
+static const int kIoprioWhoProcess = 1;
+static const int kIoprioClassShift = 13;
+static const int kIoprioClassBestEffort = 2;
+static const int kIoprioClassIdle = 3;
+
+AttachProfile::AttachProfile(const std::string& cwd,
+        const std::vector<std::string>& env, int uid, int gid, int namespaces,
+        bool cgroup)
+        : cwd(cwd), uid(uid), gid(gid), namespaces(namespaces), cgroup(cgroup) {
+    this->env.resize(env.size() + 1);
+    this->env.back() = nullptr;
+
+    for (unsigned int i = 0; i < env.size(); i++) {
+        this->env[i] = strdup(env[i].c_str());
+    }
+}
+
+AttachProfile::~AttachProfile() {
+    for (char *p: env) {
+        free(p);
+    }
+}
+
+// A limit is a number or a [soft, hard] pair, Infinity means unlimited.
+static bool ParseLimitValue(Local<Value> value, rlim_t& limit) {
+    if (!value->IsNumber()) {
+        return false;
+    }
+
+    double number = value->NumberValue();
+
+    if (std::isinf(number) && number > 0) {
+        limit = RLIM_INFINITY;
+        return true;
+    }
+
+    if (!(number >= 0) || std::floor(number) != number) {
+        return false;
+    }
+
+    limit = static_cast<rlim_t>(number);
+
+    return true;
+}
+
+std::shared_ptr<AttachProfile> AttachProfile::FromOptions(Local<Object> options) {
+    // env
+    std::vector<std::string> env;
+    Local<Value> envValue = options->Get(Nan::New("env").ToLocalChecked());
+
+    if (envValue->IsArray()) {
+        Local<Array> envArray = envValue.As<Array>();
+
+        for (unsigned int i = 0; i < envArray->Length(); i++) {
+            env.push_back(*String::Utf8Value(envArray->Get(i)));
+        }
+    }
+
+    // cwd
+    std::string cwd = "/";
+    Local<Value> cwdValue = options->Get(Nan::New("cwd").ToLocalChecked());
+
+    if (cwdValue->IsString()) {
+        cwd = *String::Utf8Value(cwdValue);
+    }
+
+    // uid & gid
+    int uid = -1;
+    Local<Value> uidValue = options->Get(Nan::New("uid").ToLocalChecked());
+
+    if (uidValue->IsUint32()) {
+        uid = uidValue->Uint32Value();
+    }
+
+    int gid = -1;
+    Local<Value> gidValue = options->Get(Nan::New("gid").ToLocalChecked());
+
+    if (gidValue->IsUint32()) {
+        gid = gidValue->Uint32Value();
+    }
+
+    // cgroup
+    bool cgroup = true;
+    Local<Value> cgroupValue = options->Get(Nan::New("cgroup").ToLocalChecked());
+
+    if (cgroupValue->IsBoolean()) {
+        cgroup = cgroupValue->BooleanValue();
+    }
+
+    // namespaces
+    int namespaces = -1;
+    Local<Value> nsValue = options->Get(Nan::New("namespaces").ToLocalChecked());
+
+    if (nsValue->IsArray()) {
+        Local<Array> nsArray = nsValue.As<Array>();
+        int length = nsArray->Length();
+        namespaces = 0;
+
+        for (int i = 0; i < length; i++) {
+            std::string ns = *String::Utf8Value(nsArray->Get(i));
+            auto it = nsMap.find(ns);
+            if (it != nsMap.end()) {
+                namespaces |= it->second;
+            } else {
+                Nan::ThrowTypeError(("invalid namespace: " + ns).c_str());
+                return nullptr;
+            }
+        }
+    }
+
+    // limits
+    std::vector<Limit> limits;
+    Local<Value> limitsValue = options->Get(Nan::New("limits").ToLocalChecked());
+
+    if (limitsValue->IsObject()) {
+        Local<Object> limitsObject = limitsValue->ToObject();
+        Local<Array> names = limitsObject->GetOwnPropertyNames();
+
+        for (unsigned int i = 0; i < names->Length(); i++) {
+            std::string name = *String::Utf8Value(names->Get(i));
+            Local<Value> value = limitsObject->Get(names->Get(i));
+            auto it = limitMap.find(name);
+
+            if (it == limitMap.end()) {
+                Nan::ThrowTypeError(("invalid limit: " + name).c_str());
+                return nullptr;
+            }
+
+            Limit limit;
+            limit.resource = it->second;
+
+            bool valid;
+
+            if (value->IsArray() && value.As<Array>()->Length() == 2) {
+                valid = ParseLimitValue(value.As<Array>()->Get(0), limit.limit.rlim_cur) &&
+                    ParseLimitValue(value.As<Array>()->Get(1), limit.limit.rlim_max) &&
+                    limit.limit.rlim_cur <= limit.limit.rlim_max;
+            } else {
+                valid = ParseLimitValue(value, limit.limit.rlim_cur);
+                limit.limit.rlim_max = limit.limit.rlim_cur;
+            }
+
+            if (!valid) {
+                Nan::ThrowTypeError(("invalid value for limit: " + name).c_str());
+                return nullptr;
+            }
+
+            limits.push_back(limit);
+        }
+    }
+
+    auto profile = std::make_shared<AttachProfile>(cwd, env, uid, gid, namespaces, cgroup);
+    profile->limits = limits;
+
+    // nice
+    Local<Value> niceValue = options->Get(Nan::New("nice").ToLocalChecked());
+
+    if (niceValue->IsInt32() && niceValue->Int32Value() >= -20 && niceValue->Int32Value() <= 19) {
+        profile->nice = niceValue->Int32Value();
+    } else if (!niceValue->IsUndefined()) {
+        Nan::ThrowTypeError("nice must be an integer between -20 and 19");
+        return nullptr;
+    }
+
+    // scheduling policy
+    Local<Value> policyValue = options->Get(Nan::New("schedPolicy").ToLocalChecked());
+
+    if (!policyValue->IsUndefined()) {
+        std::string policy = *String::Utf8Value(policyValue);
+        auto it = schedPolicyMap.find(policy);
+
+        if (it == schedPolicyMap.end()) {
+            Nan::ThrowTypeError(("invalid schedPolicy: " + policy).c_str());
+            return nullptr;
+        }
+
+        profile->schedPolicy = it->second;
+    }
+
+    // io priority, a best effort level or 'idle'
+    Local<Value> ioValue = options->Get(Nan::New("ioPriority").ToLocalChecked());
+
+    if (ioValue->IsUint32() && ioValue->Uint32Value() <= 7) {
+        profile->ioPriority = kIoprioClassBestEffort << kIoprioClassShift | ioValue->Uint32Value();
+    } else if (ioValue->IsString() && *String::Utf8Value(ioValue) == std::string("idle")) {
+        profile->ioPriority = kIoprioClassIdle << kIoprioClassShift;
+    } else if (!ioValue->IsUndefined()) {
+        Nan::ThrowTypeError("ioPriority must be a level between 0 and 7 or 'idle'");
+        return nullptr;
+    }
+
+    // oom score
+    Local<Value> oomValue = options->Get(Nan::New("oomScoreAdj").ToLocalChecked());
+
+    if (oomValue->IsInt32() && oomValue->Int32Value() >= -1000 && oomValue->Int32Value() <= 1000) {
+        profile->oomScoreAdj = oomValue->Int32Value();
+    } else if (!oomValue->IsUndefined()) {
+        Nan::ThrowTypeError("oomScoreAdj must be an integer between -1000 and 1000");
+        return nullptr;
+    }
+
+    // affinity, an array of cpus or a cpu list like "2-3"
+    Local<Value> cpusValue = options->Get(Nan::New("cpus").ToLocalChecked());
+
+    if (cpusValue->IsArray()) {
+        Local<Array> cpusArray = cpusValue.As<Array>();
+
+        for (unsigned int i = 0; i < cpusArray->Length(); i++) {
+            Local<Value> cpu = cpusArray->Get(i);
+
+            if (!cpu->IsUint32() || cpu->Uint32Value() >= CPU_SETSIZE) {
+                Nan::ThrowTypeError("invalid cpu");
+                return nullptr;
+            }
+
+            profile->cpus.push_back(cpu->Uint32Value());
+        }
+    } else if (cpusValue->IsString()) {
+        if (!ParseCpuList(*String::Utf8Value(cpusValue), profile->cpus)) {
+            Nan::ThrowTypeError("invalid cpu list");
+            return nullptr;
+        }
+    } else if (!cpusValue->IsUndefined()) {
+        Nan::ThrowTypeError("cpus must be an array or a cpu list");
+        return nullptr;
+    }
+
+    return profile;
+}
+
+bool AttachProfile::Apply() const {
+    for (const Limit& limit: limits) {
+        if (setrlimit(limit.resource, &limit.limit) == -1) {
+            return false;
+        }
+    }
+
+    if (schedPolicy != kUnset) {
+        sched_param param = {};
+
+        if (sched_setscheduler(0, schedPolicy, &param) == -1) {
+            return false;
+        }
+    }
+
+    if (nice != kUnset && setpriority(PRIO_PROCESS, 0, nice) == -1) {
+        return false;
+    }
+
+    if (ioPriority != kUnset &&
+            syscall(SYS_ioprio_set, kIoprioWhoProcess, 0, ioPriority) == -1) {
+        return false;
+    }
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+
+        // fails with EINVAL if none of the cpus is in the container's cpuset
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            return false;
+        }
+    }
+
+    if (oomScoreAdj != kUnset) {
+        // needs the container's /proc
+        int fd = open("/proc/self/oom_score_adj", O_WRONLY | O_CLOEXEC);
+
+        if (fd == -1) {
+            return false;
+        }
+
+        std::string value = std::to_string(oomScoreAdj);
+        ssize_t ret = write(fd, value.data(), value.size());
+
+        close(fd);
+
+        if (ret == -1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Javascript Functions
+
+static void WeakCallback(const Nan::WeakCallbackInfo<std::shared_ptr<AttachProfile>>& info) {
+    delete info.GetParameter();
+}
+
+NAN_METHOD(CreateAttachProfile) {
+    if (!info[0]->IsObject()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    AddonData *data = GetAddonData(info);
+    std::shared_ptr<AttachProfile> profile = AttachProfile::FromOptions(info[0]->ToObject());
+
+    if (!profile) {
+        return;
+    }
+
+    // tasks that were queued with the profile keep it alive on their own
+    auto *ref = new std::shared_ptr<AttachProfile>(profile);
+
+    Local<Object> wrap = Nan::New(data->profileTemplate)->GetFunction()->NewInstance();
+    Nan::SetInternalFieldPointer(wrap, 0, ref);
+
+    Nan::Persistent<Object> persistent(wrap);
+    persistent.SetWeak(ref, WeakCallback, Nan::WeakCallbackType::kParameter);
+
+    info.GetReturnValue().Set(wrap);
+}
+
+std::shared_ptr<AttachProfile> UnwrapProfile(AddonData *data, Local<Value> value) {
+    if (!Nan::New(data->profileTemplate)->HasInstance(value)) {
+        return nullptr;
+    }
+
+    void *ptr = Nan::GetInternalFieldPointer(value->ToObject(), 0);
+    return *static_cast<std::shared_ptr<AttachProfile>*>(ptr);
+}
+
+// Initialization
+
+void ProfileInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> constructorTemplate = Nan::New<FunctionTemplate>();
+
+    constructorTemplate->SetClassName(Nan::New("AttachProfile").ToLocalChecked());
+    constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+
+    data->profileTemplate.Reset(constructorTemplate);
+
+    // Exports
+    exports->Set(Nan::New("createAttachProfile").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(CreateAttachProfile, data->External())->GetFunction());
+}
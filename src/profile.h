@@ -0,0 +1,69 @@
+#ifndef SOURCEBOX_PROFILE_H
+#define SOURCEBOX_PROFILE_H
+
+#include <sys/resource.h>
+
+#include <climits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <node.h>
+#include <nan.h>
+
+#include "addon.h"
+
+/**
+ * The parts of the attach options that do not change between processes: the
+ * environment, working directory, credentials, namespaces, resource limits,
+ * scheduling settings and cpu affinity.
+ * A profile is immutable once created and shared by all tasks that use it, so
+ * it is only parsed (and its environment copied) once.
+ */
+struct AttachProfile {
+    // Scheduling settings that are not set keep the values of the container
+    static const int kUnset = INT_MIN;
+
+    struct Limit {
+        int resource;
+        rlimit limit;
+    };
+
+    AttachProfile(const std::string& cwd, const std::vector<std::string>& env,
+            int uid, int gid, int namespaces, bool cgroup);
+
+    ~AttachProfile();
+
+    // Parses the options of an attach call. Throws and returns nullptr if they
+    // are invalid.
+    static std::shared_ptr<AttachProfile> FromOptions(v8::Local<v8::Object> options);
+
+    // Applies the limits, scheduling settings and affinity, runs within the
+    // container. Returns false and sets errno on failure.
+    bool Apply() const;
+
+    std::string cwd;
+    std::vector<char*> env;
+    int uid;
+    int gid;
+    int namespaces;
+    bool cgroup;
+    std::vector<Limit> limits;
+
+    int nice = kUnset;
+    int schedPolicy = kUnset;
+    // ioprio_set() value
+    int ioPriority = kUnset;
+    int oomScoreAdj = kUnset;
+
+    // affinity, empty to keep the cpus of the container
+    std::vector<int> cpus;
+};
+
+// Returns the profile of an object created by createAttachProfile(), nullptr
+// for any other value.
+std::shared_ptr<AttachProfile> UnwrapProfile(AddonData *data, v8::Local<v8::Value> value);
+
+void ProfileInit(v8::Handle<v8::Object> exports, AddonData *data);
+
+#endif
@@ -0,0 +1,390 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+#include "cgroup.h"
+#include "lxc.h"
+
+using namespace v8;
+
+Sampler::Sampler(AddonData *data, Local<Float64Array> array, Local<Function> callback)
+        : data_(data), array_(array), callback_(callback) {
+    int capacity = array->Length() / kFieldCount;
+
+    slots_.resize(capacity);
+    snapshot_.resize(capacity * kFieldCount, 0);
+
+    uv_mutex_init(&mutex_);
+    uv_cond_init(&cond_);
+
+    async_ = new uv_async_t;
+    async_->data = this;
+    uv_async_init(data_->loop, async_, Publish);
+
+    // a sampler alone should not keep the event loop alive
+    uv_unref(reinterpret_cast<uv_handle_t*>(async_));
+
+    data_->samplers.insert(this);
+}
+
+Sampler::~Sampler() {
+    Stop();
+
+    data_->samplers.erase(this);
+
+    for (Slot& slot : slots_) {
+        if (slot.container) {
+            lxc_container_put(slot.container);
+        }
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(async_), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+    });
+
+    uv_cond_destroy(&cond_);
+    uv_mutex_destroy(&mutex_);
+
+    array_.Reset();
+}
+
+void Sampler::Start(unsigned int interval) {
+    uv_mutex_lock(&mutex_);
+
+    interval_ = interval;
+    bool running = running_;
+    running_ = true;
+
+    uv_mutex_unlock(&mutex_);
+
+    if (!running) {
+        uv_thread_create(&thread_, Run, this);
+    }
+}
+
+void Sampler::Stop() {
+    uv_mutex_lock(&mutex_);
+
+    bool running = running_;
+    running_ = false;
+    uv_cond_signal(&cond_);
+
+    uv_mutex_unlock(&mutex_);
+
+    if (running) {
+        uv_thread_join(&thread_);
+    }
+}
+
+int Sampler::Add(lxc_container *container) {
+    int ret = -1;
+
+    uv_mutex_lock(&mutex_);
+
+    for (unsigned int i = 0; i < slots_.size(); i++) {
+        if (!slots_[i].container && lxc_container_get(container)) {
+            slots_[i] = Slot();
+            slots_[i].container = container;
+            ret = i;
+            break;
+        }
+    }
+
+    uv_mutex_unlock(&mutex_);
+
+    return ret;
+}
+
+bool Sampler::Remove(int slot) {
+    lxc_container *container = nullptr;
+
+    uv_mutex_lock(&mutex_);
+
+    if (slot >= 0 && static_cast<unsigned int>(slot) < slots_.size()) {
+        container = slots_[slot].container;
+        slots_[slot] = Slot();
+        std::fill_n(snapshot_.begin() + slot * kFieldCount, kFieldCount, 0);
+    }
+
+    uv_mutex_unlock(&mutex_);
+
+    if (container) {
+        lxc_container_put(container);
+    }
+
+    return container != nullptr;
+}
+
+void Sampler::Run(void *arg) {
+    Sampler *sampler = static_cast<Sampler*>(arg);
+
+    uv_mutex_lock(&sampler->mutex_);
+
+    while (sampler->running_) {
+        // Sample copies of the slots without holding the lock, so that slots
+        // can be added or removed in the meantime. The extra reference keeps
+        // the container alive if its slot gets removed.
+        std::vector<std::pair<int, Slot>> slots;
+
+        for (unsigned int i = 0; i < sampler->slots_.size(); i++) {
+            Slot& slot = sampler->slots_[i];
+
+            if (slot.container && lxc_container_get(slot.container)) {
+                slots.push_back(std::make_pair(i, slot));
+            }
+        }
+
+        uv_mutex_unlock(&sampler->mutex_);
+
+        std::vector<double> values(slots.size() * kFieldCount, 0);
+
+        for (unsigned int i = 0; i < slots.size(); i++) {
+            sampler->Sample(slots[i].second, &values[i * kFieldCount]);
+        }
+
+        uv_mutex_lock(&sampler->mutex_);
+
+        for (unsigned int i = 0; i < slots.size(); i++) {
+            int index = slots[i].first;
+            Slot& slot = slots[i].second;
+
+            if (sampler->slots_[index].container == slot.container) {
+                sampler->slots_[index] = slot;
+                std::copy_n(&values[i * kFieldCount], kFieldCount,
+                        sampler->snapshot_.begin() + index * kFieldCount);
+            }
+        }
+
+        uv_mutex_unlock(&sampler->mutex_);
+
+        for (auto& pair : slots) {
+            lxc_container_put(pair.second.container);
+        }
+
+        uv_async_send(sampler->async_);
+
+        uv_mutex_lock(&sampler->mutex_);
+
+        if (sampler->running_) {
+            uv_cond_timedwait(&sampler->cond_, &sampler->mutex_,
+                    sampler->interval_ * static_cast<uint64_t>(1e6));
+        }
+    }
+
+    uv_mutex_unlock(&sampler->mutex_);
+}
+
+// This method gets called on the sampler thread
+void Sampler::Sample(Slot& slot, double *values) {
+    uint64_t now = uv_hrtime();
+    std::string content;
+
+    values[kTimestamp] = now / 1e6;
+
+    pid_t initPid = slot.container->init_pid(slot.container);
+
+    if (slot.cgroup.empty() || initPid != slot.initPid) {
+        // restarted containers get a new cgroup, even if the old path still
+        // reads fine in between
+        slot.cgroup = CgroupPath(initPid);
+        slot.initPid = initPid;
+        slot.time = 0;
+    }
+
+    if (slot.cgroup.empty() || !ReadFile(slot.cgroup + "/memory.current", content)) {
+        // container is not running (anymore)
+        slot.cgroup.clear();
+        return;
+    }
+
+    values[kRunning] = 1;
+    values[kMemory] = strtoull(content.c_str(), nullptr, 10);
+
+    if (ReadFile(slot.cgroup + "/pids.current", content)) {
+        values[kPids] = strtoull(content.c_str(), nullptr, 10);
+    }
+
+    uint64_t cpuUsec = slot.cpuUsec;
+
+    if (ReadFile(slot.cgroup + "/cpu.stat", content)) {
+        ParseKeyedValue(content, "usage_usec", cpuUsec);
+    }
+
+    // io.stat has one line per device: "8:0 rbytes=1 wbytes=2 rios=3 ..."
+    uint64_t ioRead = 0;
+    uint64_t ioWrite = 0;
+
+    if (ReadFile(slot.cgroup + "/io.stat", content)) {
+        std::istringstream stat(content);
+        std::string field;
+
+        while (stat >> field) {
+            if (field.compare(0, 7, "rbytes=") == 0) {
+                ioRead += strtoull(field.c_str() + 7, nullptr, 10);
+            } else if (field.compare(0, 7, "wbytes=") == 0) {
+                ioWrite += strtoull(field.c_str() + 7, nullptr, 10);
+            }
+        }
+    }
+
+    values[kCpuSeconds] = cpuUsec / 1e6;
+
+    // A counter that went down belongs to a new cgroup, its rate is skipped
+    // for one interval instead of wrapping around.
+    if (slot.time != 0 && now > slot.time) {
+        double elapsed = now - slot.time; // ns
+
+        if (cpuUsec >= slot.cpuUsec) {
+            values[kCpuRate] = (cpuUsec - slot.cpuUsec) * 1e3 / elapsed;
+        }
+
+        if (ioRead >= slot.ioRead) {
+            values[kIoReadRate] = (ioRead - slot.ioRead) * 1e9 / elapsed;
+        }
+
+        if (ioWrite >= slot.ioWrite) {
+            values[kIoWriteRate] = (ioWrite - slot.ioWrite) * 1e9 / elapsed;
+        }
+    }
+
+    slot.cpuUsec = cpuUsec;
+    slot.ioRead = ioRead;
+    slot.ioWrite = ioWrite;
+    slot.time = now;
+}
+
+void Sampler::Publish(uv_async_t *handle) {
+    Nan::HandleScope scope;
+
+    Sampler *sampler = static_cast<Sampler*>(handle->data);
+
+    Local<Float64Array> array = Nan::New(sampler->array_);
+    Nan::TypedArrayContents<double> contents(array);
+
+    uv_mutex_lock(&sampler->mutex_);
+    std::copy_n(sampler->snapshot_.begin(),
+            std::min<size_t>(contents.length(), sampler->snapshot_.size()), *contents);
+    uv_mutex_unlock(&sampler->mutex_);
+
+    if (!sampler->callback_.IsEmpty()) {
+        sampler->callback_.Call(0, nullptr);
+    }
+}
+
+// Javascript Functions
+
+NAN_INLINE Sampler *UnwrapSampler(Local<Object> object) {
+    void *ptr = Nan::GetInternalFieldPointer(object, 0);
+    return static_cast<Sampler*>(ptr);
+}
+
+NAN_METHOD(CreateSampler) {
+    if (!info[0]->IsFloat64Array() || !info[1]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    AddonData *data = GetAddonData(info);
+    Sampler *sampler = new Sampler(data, info[0].As<Float64Array>(), info[1].As<Function>());
+
+    Local<Object> wrap = Nan::New(data->samplerConstructor)->NewInstance();
+    Nan::SetInternalFieldPointer(wrap, 0, sampler);
+
+    info.GetReturnValue().Set(wrap);
+}
+
+NAN_METHOD(SamplerStart) {
+    if (!info[0]->IsUint32()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    Sampler *sampler = UnwrapSampler(info.Holder());
+
+    if (!sampler) {
+        return Nan::ThrowError("Sampler is closed");
+    }
+
+    sampler->Start(info[0]->Uint32Value());
+}
+
+NAN_METHOD(SamplerStop) {
+    Sampler *sampler = UnwrapSampler(info.Holder());
+
+    if (sampler) {
+        sampler->Stop();
+    }
+}
+
+NAN_METHOD(SamplerAdd) {
+    if (!info[0]->IsObject()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    Sampler *sampler = UnwrapSampler(info.Holder());
+
+    if (!sampler) {
+        return Nan::ThrowError("Sampler is closed");
+    }
+
+    int slot = sampler->Add(Unwrap(info[0]->ToObject()));
+
+    if (slot < 0) {
+        return Nan::ThrowError("No free sampler slot");
+    }
+
+    info.GetReturnValue().Set(Nan::New<Uint32>(slot));
+}
+
+NAN_METHOD(SamplerRemove) {
+    if (!info[0]->IsUint32()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    Sampler *sampler = UnwrapSampler(info.Holder());
+
+    if (sampler) {
+        info.GetReturnValue().Set(Nan::New(sampler->Remove(info[0]->Uint32Value())));
+    }
+}
+
+NAN_METHOD(SamplerClose) {
+    Sampler *sampler = UnwrapSampler(info.Holder());
+
+    Nan::SetInternalFieldPointer(info.Holder(), 0, nullptr);
+    delete sampler;
+}
+
+// Initialization
+
+void SamplerInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> constructorTemplate = Nan::New<FunctionTemplate>();
+
+    constructorTemplate->SetClassName(Nan::New("Sampler").ToLocalChecked());
+    constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(constructorTemplate, "start", SamplerStart);
+    Nan::SetPrototypeMethod(constructorTemplate, "stop", SamplerStop);
+    Nan::SetPrototypeMethod(constructorTemplate, "add", SamplerAdd);
+    Nan::SetPrototypeMethod(constructorTemplate, "remove", SamplerRemove);
+    Nan::SetPrototypeMethod(constructorTemplate, "close", SamplerClose);
+
+    data->samplerConstructor.Reset(constructorTemplate->GetFunction());
+
+    // Exports
+    exports->Set(Nan::New("createSampler").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(CreateSampler, data->External())->GetFunction());
+    exports->Set(Nan::New("samplerFields").ToLocalChecked(),
+            Nan::New<Uint32>(Sampler::kFieldCount));
+}
+
+void SamplerCleanup(AddonData *data) {
+    // samplers that were not closed, the JS wrappers are gone with the context
+    while (!data->samplers.empty()) {
+        delete *data->samplers.begin();
+    }
+
+    data->samplerConstructor.Reset();
+}
@@ -0,0 +1,79 @@
+#ifndef SOURCEBOX_SAMPLER_H
+#define SOURCEBOX_SAMPLER_H
+
+#include <string>
+#include <vector>
+
+#include <node.h>
+#include <nan.h>
+#include <lxc/lxccontainer.h>
+
+#include "addon.h"
+
+/**
+ * Reads the cgroup statistics of a set of containers on a background thread
+ * and publishes them into a Float64Array, so that JavaScript can read them
+ * without calling into the binding for every container.
+ */
+class Sampler {
+public:
+    // Layout of a slot in the shared array, must match lib/sampler.js
+    enum Field {
+        kRunning,
+        kCpuRate,
+        kCpuSeconds,
+        kMemory,
+        kPids,
+        kIoReadRate,
+        kIoWriteRate,
+        kTimestamp,
+        kFieldCount
+    };
+
+    Sampler(AddonData *data, v8::Local<v8::Float64Array> array,
+            v8::Local<v8::Function> callback);
+    ~Sampler();
+
+    void Start(unsigned int interval);
+    void Stop();
+
+    int Add(lxc_container *container);
+    bool Remove(int slot);
+
+private:
+    struct Slot {
+        lxc_container *container = nullptr;
+        std::string cgroup;
+        pid_t initPid = 0;
+        uint64_t cpuUsec = 0;
+        uint64_t ioRead = 0;
+        uint64_t ioWrite = 0;
+        uint64_t time = 0;
+    };
+
+    static void Run(void *arg);
+    static void Publish(uv_async_t *handle);
+
+    void Sample(Slot& slot, double *values);
+
+    AddonData *data_;
+
+    uv_thread_t thread_;
+    uv_mutex_t mutex_;
+    uv_cond_t cond_;
+    uv_async_t *async_;
+
+    bool running_ = false;
+    unsigned int interval_ = 1000;
+
+    std::vector<Slot> slots_;
+    std::vector<double> snapshot_;
+
+    Nan::Persistent<v8::Float64Array> array_;
+    Nan::Callback callback_;
+};
+
+void SamplerInit(v8::Handle<v8::Object> exports, AddonData *data);
+void SamplerCleanup(AddonData *data);
+
+#endif
@@ -0,0 +1,362 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "async.h"
+
+using namespace v8;
+
+// Index of the smallest power of two that is larger than `value`.
+static int WaitBucket(uint64_t value) {
+    int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    return std::min(bucket, Scheduler::kWaitBuckets - 1);
+}
+
+Scheduler::Scheduler(uv_loop_t *loop) : gate_(loop, [this]() {
+    Dispatch();
+    UpdateRef();
+}) {
+    // by default, do not queue more work on the threadpool than it has threads
+    const char *size = getenv("UV_THREADPOOL_SIZE");
+    concurrency_ = size && atoi(size) > 0 ? atoi(size) : 4;
+
+    async_ = new uv_async_t;
+    async_->data = this;
+    uv_async_init(loop, async_, Drain);
+    uv_unref(reinterpret_cast<uv_handle_t*>(async_));
+}
+
+Scheduler::~Scheduler() {
+    uv_close(reinterpret_cast<uv_handle_t*>(async_), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+    });
+}
+
+void Scheduler::Shutdown() {
+    std::vector<AsyncWorker*> workers;
+
+    for (auto& pair : queues_) {
+        for (Entry& entry : pair.second.entries) {
+            workers.push_back(entry.worker);
+        }
+
+        pair.second.entries.clear();
+    }
+
+    for (auto& pair : rejected_) {
+        workers.push_back(pair.first);
+    }
+
+    queued_ = 0;
+    rejected_.clear();
+    UpdateRef();
+
+    // the context is going away, drop the workers without calling back
+    for (AsyncWorker *worker : workers) {
+        worker->Destroy();
+    }
+}
+
+void Scheduler::Submit(AsyncWorker *worker, const std::string& key) {
+    Queue& queue = queues_[key];
+    queue.submitted++;
+
+    worker->key_ = key;
+
+    if (maxQueue_ > 0 && queue.entries.size() >= maxQueue_) {
+        queue.rejected++;
+        return Reject(worker, "Queue is full");
+    }
+
+    if (gate_.Closed() && gate_.Rejects() && gate_.Gates(worker->OperationType())) {
+        gate_.CountRejected();
+        Reject(worker, "Host is under pressure");
+        return Prune(key);
+    }
+
+    // start-time fair queuing, a key that was idle starts at the current
+    // virtual time instead of catching up
+    double start = std::max(time_, queue.finish);
+    queue.finish = start + 1 / queue.weight;
+
+    queue.entries.push_back(Entry{worker, start, uv_hrtime(), false});
+    worker->state_ = AsyncWorker::kQueued;
+    queued_++;
+
+    Dispatch();
+    UpdateRef();
+}
+
+bool Scheduler::Cancel(AsyncWorker *worker) {
+    if (worker->state_ != AsyncWorker::kQueued) {
+        return false;
+    }
+
+    auto& entries = queues_[worker->key_].entries;
+
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (it->worker == worker) {
+            entries.erase(it);
+            queued_--;
+            break;
+        }
+    }
+
+    Reject(worker, "Operation cancelled");
+    Prune(worker->key_);
+
+    return true;
+}
+
+void Scheduler::Done(AsyncWorker *worker) {
+    if (worker->state_ != AsyncWorker::kDispatched) {
+        return;
+    }
+
+    worker->state_ = AsyncWorker::kDone;
+
+    queues_[worker->key_].running--;
+    running_--;
+
+    Prune(worker->key_);
+    Dispatch();
+    UpdateRef();
+}
+
+void Scheduler::Dispatch() {
+    while (concurrency_ == 0 || running_ < concurrency_) {
+        Queue *next = nullptr;
+
+        for (auto& pair : queues_) {
+            Queue& queue = pair.second;
+            unsigned int limit = queue.configured ? queue.limit : limit_;
+
+            if (queue.entries.empty() || (limit > 0 && queue.running >= limit)) {
+                continue;
+            }
+
+            // operations of a key stay in order, a held back heavy operation
+            // also holds back the cheap ones behind it
+            Entry& front = queue.entries.front();
+
+            if (gate_.Closed() && gate_.Gates(front.worker->OperationType())) {
+                if (!front.delayed) {
+                    front.delayed = true;
+                    gate_.CountDelayed();
+                }
+
+                continue;
+            }
+
+            if (!next || queue.entries.front().tag < next->entries.front().tag) {
+                next = &queue;
+            }
+        }
+
+        if (!next) {
+            return;
+        }
+
+        Entry entry = next->entries.front();
+        next->entries.pop_front();
+        queued_--;
+
+        next->running++;
+        running_++;
+
+        time_ = entry.tag;
+        next->waits[WaitBucket((uv_hrtime() - entry.time) / 1000)]++;
+
+        entry.worker->state_ = AsyncWorker::kDispatched;
+        Nan::AsyncQueueWorker(entry.worker);
+    }
+}
+
+// Drops the queue of `key` once it is idle, keys are often session or user ids
+// and would pile up otherwise. A key that comes back starts at the current
+// virtual time, at most one operation ahead of where it left off. Configured
+// keys are kept.
+void Scheduler::Prune(const std::string& key) {
+    auto it = queues_.find(key);
+
+    if (it != queues_.end() && !it->second.configured &&
+            it->second.entries.empty() && it->second.running == 0) {
+        queues_.erase(it);
+    }
+}
+
+// Completes the worker with an error on the next loop iteration, callbacks
+// are never called synchronously.
+void Scheduler::Reject(AsyncWorker *worker, const char *message) {
+    worker->state_ = AsyncWorker::kDone;
+    rejected_.push_back(std::make_pair(worker, message));
+
+    uv_async_send(async_);
+    UpdateRef();
+}
+
+// Queued workers have nothing on the loop yet, so keep it alive for them.
+void Scheduler::UpdateRef() {
+    uv_handle_t *handle = reinterpret_cast<uv_handle_t*>(async_);
+
+    if (queued_ > 0 || !rejected_.empty()) {
+        uv_ref(handle);
+    } else {
+        uv_unref(handle);
+    }
+}
+
+void Scheduler::Drain(uv_async_t *handle) {
+    Scheduler *scheduler = static_cast<Scheduler*>(handle->data);
+    std::vector<std::pair<AsyncWorker*, const char*>> rejected;
+
+    rejected.swap(scheduler->rejected_);
+    scheduler->UpdateRef();
+
+    for (auto& pair : rejected) {
+        AsyncWorker *worker = pair.first;
+
+        worker->SetErrorMessage(pair.second);
+        worker->WorkComplete();
+        worker->Destroy();
+    }
+}
+
+bool Scheduler::Configure(Local<Object> options, std::string& error) {
+    Local<Value> concurrency = options->Get(Nan::New("concurrency").ToLocalChecked());
+    if (concurrency->IsUint32()) {
+        concurrency_ = concurrency->Uint32Value();
+    }
+
+    Local<Value> limit = options->Get(Nan::New("limit").ToLocalChecked());
+    if (limit->IsUint32()) {
+        limit_ = limit->Uint32Value();
+    }
+
+    Local<Value> maxQueue = options->Get(Nan::New("maxQueue").ToLocalChecked());
+    if (maxQueue->IsUint32()) {
+        maxQueue_ = maxQueue->Uint32Value();
+    }
+
+    Local<Value> keys = options->Get(Nan::New("keys").ToLocalChecked());
+
+    if (keys->IsObject()) {
+        Local<Array> names = keys->ToObject()->GetOwnPropertyNames();
+
+        for (unsigned int i = 0; i < names->Length(); i++) {
+            Local<Value> name = names->Get(i);
+            Local<Value> value = keys->ToObject()->Get(name);
+
+            if (!value->IsObject()) {
+                continue;
+            }
+
+            Local<Object> keyOptions = value->ToObject();
+            Queue& queue = queues_[*String::Utf8Value(name)];
+
+            queue.configured = true;
+
+            Local<Value> weight = keyOptions->Get(Nan::New("weight").ToLocalChecked());
+            if (weight->IsNumber() && weight->NumberValue() > 0) {
+                queue.weight = weight->NumberValue();
+            }
+
+            Local<Value> keyLimit = keyOptions->Get(Nan::New("limit").ToLocalChecked());
+            if (keyLimit->IsUint32()) {
+                queue.limit = keyLimit->Uint32Value();
+            }
+        }
+    }
+
+    bool result = true;
+
+    if (options->Has(Nan::New("pressure").ToLocalChecked())) {
+        result = gate_.Configure(options->Get(Nan::New("pressure").ToLocalChecked()), error);
+    }
+
+    // limits might have been raised
+    Dispatch();
+    UpdateRef();
+
+    return result;
+}
+
+Local<Object> Scheduler::Stats() {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> stats = Nan::New<Object>();
+    stats->Set(Nan::New("concurrency").ToLocalChecked(), Nan::New(concurrency_));
+    stats->Set(Nan::New("limit").ToLocalChecked(), Nan::New(limit_));
+    stats->Set(Nan::New("maxQueue").ToLocalChecked(), Nan::New(maxQueue_));
+    stats->Set(Nan::New("running").ToLocalChecked(), Nan::New(running_));
+    stats->Set(Nan::New("queued").ToLocalChecked(),
+            Nan::New<Number>(static_cast<double>(queued_)));
+
+    Local<Object> keys = Nan::New<Object>();
+
+    for (auto& pair : queues_) {
+        Queue& queue = pair.second;
+        Local<Object> key = Nan::New<Object>();
+
+        key->Set(Nan::New("weight").ToLocalChecked(), Nan::New(queue.weight));
+        key->Set(Nan::New("limit").ToLocalChecked(),
+                Nan::New(queue.configured ? queue.limit : limit_));
+        key->Set(Nan::New("queued").ToLocalChecked(),
+                Nan::New<Number>(static_cast<double>(queue.entries.size())));
+        key->Set(Nan::New("running").ToLocalChecked(), Nan::New(queue.running));
+        key->Set(Nan::New("submitted").ToLocalChecked(),
+                Nan::New<Number>(static_cast<double>(queue.submitted)));
+        key->Set(Nan::New("rejected").ToLocalChecked(),
+                Nan::New<Number>(static_cast<double>(queue.rejected)));
+
+        Local<Array> waits = Nan::New<Array>(kWaitBuckets);
+
+        for (int i = 0; i < kWaitBuckets; i++) {
+            waits->Set(i, Nan::New<Number>(static_cast<double>(queue.waits[i])));
+        }
+
+        key->Set(Nan::New("wait").ToLocalChecked(), waits);
+
+        keys->Set(Nan::New(pair.first).ToLocalChecked(), key);
+    }
+
+    stats->Set(Nan::New("keys").ToLocalChecked(), keys);
+    stats->Set(Nan::New("pressure").ToLocalChecked(), gate_.Stats());
+
+    return scope.Escape(stats);
+}
+
+// Javascript Functions
+
+NAN_METHOD(ConfigureScheduler) {
+    if (!info[0]->IsObject()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    std::string error;
+
+    if (!GetAddonData(info)->scheduler->Configure(info[0]->ToObject(), error)) {
+        return Nan::ThrowError(error.c_str());
+    }
+}
+
+NAN_METHOD(SchedulerStats) {
+    info.GetReturnValue().Set(GetAddonData(info)->scheduler->Stats());
+}
+
+// Initialization
+
+void SchedulerInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    data->scheduler = new Scheduler(data->loop);
+
+    Local<External> external = data->External();
+
+    // Exports
+    exports->Set(Nan::New("configureScheduler").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(ConfigureScheduler, external)->GetFunction());
+    exports->Set(Nan::New("schedulerStats").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(SchedulerStats, external)->GetFunction());
+}
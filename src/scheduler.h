@@ -0,0 +1,105 @@
+#ifndef SOURCEBOX_SCHEDULER_H
+#define SOURCEBOX_SCHEDULER_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <node.h>
+#include <nan.h>
+
+#include "addon.h"
+#include "pressure.h"
+
+class AsyncWorker;
+
+/**
+ * Admission control in front of the threadpool. Workers are queued per key
+ * (usually a tenant) and dispatched in weighted fair order, so that one key
+ * with thousands of queued operations can not starve the others. At most
+ * `concurrency` workers are on the threadpool at once, a key may be limited
+ * further. While the host is under pressure, heavy operations are held back
+ * or rejected by the PressureGate.
+ */
+class Scheduler {
+public:
+    // Wait times are recorded in buckets of powers of two microseconds
+    static const int kWaitBuckets = 32;
+
+    explicit Scheduler(uv_loop_t *loop);
+    ~Scheduler();
+
+    // Queues the worker, or rejects it if the queue of its key is full.
+    void Submit(AsyncWorker *worker, const std::string& key);
+
+    // Removes a worker that was not dispatched yet, returns false otherwise.
+    bool Cancel(AsyncWorker *worker);
+
+    // Called when a dispatched worker completed.
+    void Done(AsyncWorker *worker);
+
+    // Destroys the workers that were not dispatched yet, without calling
+    // back. Dispatched workers complete as usual.
+    void Shutdown();
+
+    // Returns false and sets `error` if the pressure gate could not be set up.
+    bool Configure(v8::Local<v8::Object> options, std::string& error);
+    v8::Local<v8::Object> Stats();
+
+private:
+    struct Entry {
+        AsyncWorker *worker;
+        double tag;
+        uint64_t time;
+
+        // held back by the pressure gate at least once
+        bool delayed;
+    };
+
+    struct Queue {
+        std::deque<Entry> entries;
+
+        // configured with `keys`, otherwise the defaults apply
+        bool configured = false;
+        double weight = 1;
+        unsigned int limit = 0;
+
+        unsigned int running = 0;
+        double finish = 0;
+
+        uint64_t submitted = 0;
+        uint64_t rejected = 0;
+        uint64_t waits[kWaitBuckets] = {};
+    };
+
+    void Dispatch();
+    void Prune(const std::string& key);
+    void Reject(AsyncWorker *worker, const char *message);
+    void UpdateRef();
+
+    static void Drain(uv_async_t *handle);
+
+    uv_async_t *async_;
+
+    unsigned int concurrency_;
+    unsigned int limit_ = 0;
+    unsigned int maxQueue_ = 0;
+
+    unsigned int running_ = 0;
+    size_t queued_ = 0;
+
+    // virtual time of the last dispatched worker
+    double time_ = 0;
+
+    std::map<std::string, Queue> queues_;
+
+    PressureGate gate_;
+
+    // workers that complete without running, see Drain()
+    std::vector<std::pair<AsyncWorker*, const char*>> rejected_;
+};
+
+void SchedulerInit(v8::Handle<v8::Object> exports, AddonData *data);
+
+#endif
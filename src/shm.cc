@@ -0,0 +1,323 @@
+#include "shm.h"
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+
+#include <cstring>
+
+#include "memfd.h"
+#include "sourcebox/shm_ring.h"
+
+using namespace v8;
+
+static const size_t kMinCapacity = 4096;
+static const size_t kMaxCapacity = 1 << 30;
+
+static void Signal(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+ShmChannel *ShmChannel::Create(AddonData *data, size_t capacity,
+        Local<Function> onMessage, Local<Function> onEnd) {
+    // positions are masked, so the capacity must be a power of two
+    size_t rounded = kMinCapacity;
+
+    while (rounded < capacity && rounded < kMaxCapacity) {
+        rounded <<= 1;
+    }
+
+    size_t size = SOURCEBOX_RING_HEADER_SIZE + rounded;
+
+    // no fallback without memfds, the producer must not be able to truncate
+    // the file under our mapping
+    int memFd = MemfdCreate("sourcebox-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (memFd == -1) {
+        return nullptr;
+    }
+
+    void *map = MAP_FAILED;
+
+    if (ftruncate(memFd, size) == 0 &&
+            fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == 0) {
+        map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    }
+
+    if (map == MAP_FAILED) {
+        int err = errno;
+        close(memFd);
+        errno = err;
+        return nullptr;
+    }
+
+    // we only read from the data eventfd in the poll callback, the producer
+    // blocks on the space eventfd
+    int dataFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int spaceFd = eventfd(0, EFD_CLOEXEC);
+
+    if (dataFd == -1 || spaceFd == -1) {
+        int err = errno;
+        close(dataFd);
+        close(spaceFd);
+        close(memFd);
+        munmap(map, size);
+        errno = err;
+        return nullptr;
+    }
+
+    sourcebox_ring_header *header = static_cast<sourcebox_ring_header*>(map);
+    header->magic = SOURCEBOX_RING_MAGIC;
+    header->version = SOURCEBOX_RING_VERSION;
+    header->capacity = rounded;
+
+    ShmChannel *channel = new ShmChannel(data, memFd, map, rounded, dataFd, spaceFd);
+
+    channel->onMessage_.Reset(onMessage);
+    channel->onEnd_.Reset(onEnd);
+
+    return channel;
+}
+
+ShmChannel::ShmChannel(AddonData *data, int memFd, void *map, size_t capacity,
+        int dataFd, int spaceFd)
+        : data_(data), memFd_(memFd), dataFd_(dataFd), spaceFd_(spaceFd),
+        header_(static_cast<sourcebox_ring_header*>(map)),
+        ring_(static_cast<unsigned char*>(map) + SOURCEBOX_RING_HEADER_SIZE),
+        capacity_(capacity) {
+    poll_ = new uv_poll_t;
+    poll_->data = this;
+    uv_poll_init(data_->loop, poll_, dataFd_);
+    uv_poll_start(poll_, UV_READABLE, OnPoll);
+
+    data_->shmChannels.insert(this);
+}
+
+ShmChannel::~ShmChannel() {
+    munmap(header_, SOURCEBOX_RING_HEADER_SIZE + capacity_);
+}
+
+Local<Object> ShmChannel::Wrap() {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> wrap = Nan::New(data_->shmChannelConstructor)->NewInstance();
+    Nan::SetInternalFieldPointer(wrap, 0, this);
+
+    Local<ArrayBuffer> buffer = ArrayBuffer::New(Isolate::GetCurrent(), ring_, capacity_);
+    buffer_.Reset(buffer);
+    buffer_.SetWeak(this, OnCollect, Nan::WeakCallbackType::kParameter);
+
+    Local<Array> fds = Nan::New<Array>(3);
+    fds->Set(0, Nan::New(memFd_));
+    fds->Set(1, Nan::New(dataFd_));
+    fds->Set(2, Nan::New(spaceFd_));
+
+    // the mapping is freed with the buffer, so it must stay on the wrapper
+    Nan::DefineOwnProperty(wrap, Nan::New("buffer").ToLocalChecked(), buffer,
+            static_cast<PropertyAttribute>(ReadOnly | DontDelete));
+    wrap->Set(Nan::New("fds").ToLocalChecked(), fds);
+    wrap->Set(Nan::New("capacity").ToLocalChecked(),
+            Nan::New<Number>(static_cast<double>(capacity_)));
+
+    return scope.Escape(wrap);
+}
+
+void ShmChannel::Drain() {
+    Nan::HandleScope scope;
+
+    uint64_t mask = capacity_ - 1;
+    uint64_t tail = tail_;
+
+    while (!closed_) {
+        uint64_t head = __atomic_load_n(&header_->head, __ATOMIC_ACQUIRE);
+
+        if (head - tail > capacity_ || head % 8 != 0) {
+            return End("Invalid head in shared memory channel");
+        }
+
+        while (tail != head && !closed_) {
+            uint64_t pos = tail & mask;
+            uint32_t length;
+
+            memcpy(&length, ring_ + pos, sizeof(length));
+
+            uint64_t total = length == SOURCEBOX_RING_PAD
+                ? capacity_ - pos
+                : sourcebox_ring_record_size(length);
+
+            if (total > head - tail || (length != SOURCEBOX_RING_PAD && pos + total > capacity_)) {
+                return End("Invalid record in shared memory channel");
+            }
+
+            if (length != SOURCEBOX_RING_PAD) {
+                const int argc = 2;
+                Local<Value> argv[argc] = {
+                    Nan::New<Number>(static_cast<double>(pos + 4)),
+                    Nan::New<Number>(length)
+                };
+
+                onMessage_.Call(argc, argv);
+            }
+
+            tail_ = tail += total;
+        }
+
+        if (closed_) {
+            return;
+        }
+
+        __atomic_store_n(&header_->tail, tail, __ATOMIC_SEQ_CST);
+
+        if (__atomic_exchange_n(&header_->producer_waiting, 0, __ATOMIC_SEQ_CST)) {
+            Signal(spaceFd_);
+        }
+
+        // the producer only signals if it saw the ring empty, so check once
+        // more after publishing the tail
+        bool producerClosed = __atomic_load_n(&header_->closed, __ATOMIC_SEQ_CST);
+
+        if (__atomic_load_n(&header_->head, __ATOMIC_SEQ_CST) == tail) {
+            if (producerClosed) {
+                End(nullptr);
+            }
+
+            break;
+        }
+    }
+}
+
+void ShmChannel::End(const char *error) {
+    if (closed_) {
+        return;
+    }
+
+    Nan::HandleScope scope;
+    Nan::Callback onEnd(onEnd_.GetFunction());
+
+    Close();
+
+    const int argc = 1;
+    Local<Value> argv[argc] = {
+        error ? Nan::Error(error) : Nan::Null().As<Value>()
+    };
+
+    onEnd.Call(argc, argv);
+}
+
+void ShmChannel::Close() {
+    if (closed_) {
+        return;
+    }
+
+    closed_ = true;
+    data_->shmChannels.erase(this);
+
+    uv_poll_stop(poll_);
+    uv_close(reinterpret_cast<uv_handle_t*>(poll_), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_poll_t*>(handle);
+    });
+
+    close(memFd_);
+    close(dataFd_);
+    close(spaceFd_);
+
+    onMessage_.Reset();
+    onEnd_.Reset();
+}
+
+void ShmChannel::Destroy() {
+    Close();
+
+    buffer_.ClearWeak();
+    buffer_.Reset();
+
+    delete this;
+}
+
+void ShmChannel::OnPoll(uv_poll_t *handle, int status, int events) {
+    ShmChannel *channel = static_cast<ShmChannel*>(handle->data);
+
+    if (status < 0) {
+        return channel->End(uv_strerror(status));
+    }
+
+    // reset the counter, the ring tells how much there is to read
+    uint64_t value;
+    while (read(channel->dataFd_, &value, sizeof(value)) == -1 && errno == EINTR);
+
+    channel->Drain();
+}
+
+// Nothing can reach the mapping anymore once the buffer is gone. Open
+// channels are referenced by their callbacks, so this is already closed.
+void ShmChannel::OnCollect(const Nan::WeakCallbackInfo<ShmChannel>& info) {
+    ShmChannel *channel = info.GetParameter();
+
+    channel->Close();
+    delete channel;
+}
+
+// Javascript Functions
+
+NAN_METHOD(CreateShmChannel) {
+    if (!info[0]->IsUint32() || !info[1]->IsFunction() || !info[2]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    ShmChannel *channel = ShmChannel::Create(GetAddonData(info), info[0]->Uint32Value(),
+            info[1].As<Function>(), info[2].As<Function>());
+
+    if (!channel) {
+        return Nan::ThrowError(Nan::ErrnoException(errno, "createShmChannel"));
+    }
+
+    info.GetReturnValue().Set(channel->Wrap());
+}
+
+static ShmChannel *Unwrap(const Nan::FunctionCallbackInfo<Value>& info) {
+    return static_cast<ShmChannel*>(Nan::GetInternalFieldPointer(info.Holder(), 0));
+}
+
+NAN_METHOD(ShmChannelDrain) {
+    Unwrap(info)->Drain();
+}
+
+NAN_METHOD(ShmChannelEnd) {
+    ShmChannel *channel = Unwrap(info);
+
+    channel->Drain();
+    channel->End(nullptr);
+}
+
+NAN_METHOD(ShmChannelClose) {
+    Unwrap(info)->Close();
+}
+
+// Initialization
+
+void ShmInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> constructorTemplate = Nan::New<FunctionTemplate>();
+
+    constructorTemplate->SetClassName(Nan::New("ShmChannel").ToLocalChecked());
+    constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(constructorTemplate, "drain", ShmChannelDrain);
+    Nan::SetPrototypeMethod(constructorTemplate, "end", ShmChannelEnd);
+    Nan::SetPrototypeMethod(constructorTemplate, "close", ShmChannelClose);
+
+    data->shmChannelConstructor.Reset(constructorTemplate->GetFunction());
+
+    // Exports
+    exports->Set(Nan::New("createShmChannel").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(CreateShmChannel, data->External())->GetFunction());
+}
+
+void ShmCleanup(AddonData *data) {
+    while (!data->shmChannels.empty()) {
+        (*data->shmChannels.begin())->Destroy();
+    }
+
+    data->shmChannelConstructor.Reset();
+}
@@ -0,0 +1,75 @@
+#ifndef SOURCEBOX_SHM_H
+#define SOURCEBOX_SHM_H
+
+#include <node.h>
+#include <nan.h>
+
+#include "addon.h"
+
+struct sourcebox_ring_header;
+
+/**
+ * Consumer side of a single producer, single consumer ring buffer in a memfd
+ * that is shared with an attached process (see include/sourcebox/shm_ring.h).
+ * The data region is exposed as an external ArrayBuffer, messages are passed
+ * to JS as offsets into it. The producer wakes us through an eventfd when the
+ * ring was empty, we wake it through another one when it waits for space.
+ *
+ * The producer is not trusted, every record is checked before it is passed
+ * on.
+ */
+class ShmChannel {
+public:
+    // Returns nullptr and sets errno on failure.
+    static ShmChannel *Create(AddonData *data, size_t capacity,
+            v8::Local<v8::Function> onMessage, v8::Local<v8::Function> onEnd);
+
+    v8::Local<v8::Object> Wrap();
+
+    // Passes all complete messages to onMessage.
+    void Drain();
+
+    // Closes the channel and calls onEnd with the error or null.
+    void End(const char *error);
+
+    // Stops polling and closes the fds. The mapping stays until the
+    // ArrayBuffer is garbage collected.
+    void Close();
+
+    // Frees everything right away, only while the context is torn down.
+    void Destroy();
+
+private:
+    ShmChannel(AddonData *data, int memFd, void *map, size_t capacity,
+            int dataFd, int spaceFd);
+    ~ShmChannel();
+
+    static void OnPoll(uv_poll_t *handle, int status, int events);
+    static void OnCollect(const Nan::WeakCallbackInfo<ShmChannel>& info);
+
+    AddonData *data_;
+
+    int memFd_;
+    int dataFd_;
+    int spaceFd_;
+
+    sourcebox_ring_header *header_;
+    unsigned char *ring_;
+    size_t capacity_;
+
+    // the shared tail may be overwritten by the producer, this one is ours
+    uint64_t tail_ = 0;
+
+    uv_poll_t *poll_ = nullptr;
+
+    bool closed_ = false;
+
+    Nan::Callback onMessage_;
+    Nan::Callback onEnd_;
+    Nan::Persistent<v8::ArrayBuffer> buffer_;
+};
+
+void ShmInit(v8::Handle<v8::Object> exports, AddonData *data);
+void ShmCleanup(AddonData *data);
+
+#endif
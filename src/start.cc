@@ -1,9 +1,35 @@
 #include "start.h"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <csignal>
+#include <cstring>
+
+#include <lxc/version.h>
+
+// Before 2.1, liblxc ignored the daemonize flag when starting application
+// containers (lxc_execute) and start() only returned once the command exited.
+#if defined(LXC_VERSION_MAJOR) && \
+    (LXC_VERSION_MAJOR > 2 || (LXC_VERSION_MAJOR == 2 && LXC_VERSION_MINOR >= 1))
+#define HAVE_DAEMONIZED_EXECUTE
+#endif
+
 using namespace v8;
 
-StartWorker::StartWorker(lxc_container *container, Nan::Callback *callback,
-        Local<Array> arguments) : LxcWorker(container, callback) {
+// Time between readiness probes, and the time an attempt may take, in ms.
+static const uint64_t kProbeInterval = 50;
+static const uint64_t kProbeTimeout = 5000;
+
+StartWorker::StartWorker(AddonData *data, lxc_container *container,
+        Nan::Callback *callback, Local<Array> arguments, Local<Object> options)
+        : LxcWorker(data, container, callback) {
     Nan::HandleScope scope;
 
     args_.resize(arguments->Length() + 1, nullptr);
@@ -11,6 +37,77 @@ StartWorker::StartWorker(lxc_container *container, Nan::Callback *callback,
     for (unsigned int i = 0; i < args_.size() - 1; i++) {
         args_[i] = strdup(*String::Utf8Value(arguments->Get(i)));
     }
+
+    Local<Value> init = options->Get(Nan::New("init").ToLocalChecked());
+
+    if (init->IsString()) {
+        lxcInit_ = std::string(*String::Utf8Value(init)) == "lxc-init";
+    }
+
+    Local<Value> timeout = options->Get(Nan::New("timeoutMs").ToLocalChecked());
+    if (timeout->IsUint32()) {
+        timeout_ = timeout->Uint32Value();
+    }
+
+    Local<Value> placement = options->Get(Nan::New("placement").ToLocalChecked());
+    if (placement->IsObject()) {
+        place_ = true;
+
+        Local<Object> request = placement->ToObject();
+
+        Local<Value> cpus = request->Get(Nan::New("cpus").ToLocalChecked());
+        if (cpus->IsUint32()) {
+            placement_.cpus = cpus->Uint32Value();
+        }
+
+        placement_.reserved = request->Get(Nan::New("reserved").ToLocalChecked())->BooleanValue();
+    } else {
+        place_ = placement->IsTrue();
+    }
+
+    Local<Value> ready = options->Get(Nan::New("ready").ToLocalChecked());
+    if (!ready->IsObject()) {
+        return;
+    }
+
+    waitReady_ = true;
+
+    Local<Object> probes = ready->ToObject();
+
+    Local<Value> file = probes->Get(Nan::New("file").ToLocalChecked());
+    if (file->IsString()) {
+        readyFile_ = *String::Utf8Value(file);
+    }
+
+    Local<Value> socket = probes->Get(Nan::New("unixSocket").ToLocalChecked());
+    if (socket->IsString()) {
+        readySocket_ = *String::Utf8Value(socket);
+    }
+
+    Local<Value> command = probes->Get(Nan::New("command").ToLocalChecked());
+    if (command->IsArray()) {
+        Local<Array> array = command.As<Array>();
+
+        for (unsigned int i = 0; i < array->Length(); i++) {
+            readyCommand_.push_back(*String::Utf8Value(array->Get(i)));
+        }
+    } else if (command->IsString()) {
+        readyCommand_ = { "/bin/sh", "-c", *String::Utf8Value(command) };
+    }
+
+    Local<Value> runlevel = probes->Get(Nan::New("runlevel").ToLocalChecked());
+    if (runlevel->IsString() || runlevel->IsNumber()) {
+        std::string level = *String::Utf8Value(runlevel);
+
+        // compared with the output of runlevel, never passed to a shell; an
+        // invalid level is never reached
+        readyRunlevel_ = true;
+        if (level.size() == 1 && std::string("0123456Ss").find(level[0]) != std::string::npos) {
+            runlevel_ = toupper(level[0]);
+        }
+    } else if (runlevel->IsTrue()) {
+        readyRunlevel_ = true;
+    }
 }
 
 StartWorker::~StartWorker() {
@@ -20,7 +117,445 @@ StartWorker::~StartWorker() {
 }
 
 void StartWorker::LxcExecute() {
-    if (!container_->start(container_, lxcInit_, args_.data())) {
+    start_ = uv_hrtime();
+    deadline_ = start_ + timeout_ * static_cast<uint64_t>(1e6);
+
+    bool ret;
+
+    if (lxcInit_) {
+        ret = StartInit();
+    } else {
+        ret = container_->start(container_, 0, args_.data());
+    }
+
+    std::string error;
+
+    if (!ret) {
         SetErrorMessage("Failed to start container");
+    } else if (place_ && !data_->placement->Assign(container_, placement_, error)) {
+        // the container keeps running, like after a failed readiness check
+        SetErrorMessage(error.c_str());
+    } else if (waitReady_ && !WaitRunning()) {
+        // the container keeps running when waiting for it is cancelled
+        SetErrorMessage(Cancelled() ? "Operation cancelled"
+                : "Timeout while waiting for container to run");
+    }
+}
+
+void StartWorker::HandleOKCallback() {
+    Nan::HandleScope scope;
+
+    if (waitReady_) {
+        return StartProbing();
+    }
+
+    callback->Call(0, nullptr);
+}
+
+// Keeps the worker alive while probing, it is deleted in FinishProbing().
+void StartWorker::Destroy() {
+    if (!probing_) {
+        LxcWorker::Destroy();
+    }
+}
+
+bool StartWorker::WaitRunning() {
+    while (!container_->wait(container_, "RUNNING", 1)) {
+        if (uv_hrtime() >= deadline_ || Cancelled()) {
+            return false;
+        }
+    }
+
+    runningTime_ = (uv_hrtime() - start_) / 1e6;
+
+    return true;
+}
+
+void StartWorker::StartProbing() {
+    probing_ = true;
+    data_->startWorkers.insert(this);
+
+    probeTimer_ = new uv_timer_t;
+    probeTimer_->data = this;
+    probeWork_.data = this;
+
+    uv_timer_init(data_->loop, probeTimer_);
+    uv_timer_start(probeTimer_, ProbeTimer, 0, 0);
+}
+
+void StartWorker::FinishProbing(bool ready) {
+    probing_ = false;
+    data_->startWorkers.erase(this);
+
+    CloseProbeTimer();
+
+    if (abandoned_) {
+        return LxcWorker::Destroy();
+    }
+
+    Nan::HandleScope scope;
+
+    if (ready) {
+        Local<Object> times = Nan::New<Object>();
+        times->Set(Nan::New("running").ToLocalChecked(), Nan::New(runningTime_));
+        times->Set(Nan::New("ready").ToLocalChecked(), Nan::New(readyTime_));
+
+        const int argc = 2;
+        Local<Value> argv[argc] = {
+            Nan::Null(),
+            times
+        };
+
+        callback->Call(argc, argv);
+    } else {
+        SetErrorMessage(Cancelled() ? "Operation cancelled"
+                : "Timeout while waiting for container to become ready");
+        HandleErrorCallback();
+    }
+
+    LxcWorker::Destroy();
+}
+
+void StartWorker::Abandon() {
+    abandoned_ = true;
+    Cancel();
+
+    // A probe on the threadpool still finishes in ProbeDone(), if the loop
+    // runs again at all.
+    if (probeQueued_) {
+        data_->startWorkers.erase(this);
+        CloseProbeTimer();
+    } else {
+        FinishProbing(false);
+    }
+}
+
+void StartWorker::CloseProbeTimer() {
+    if (!probeTimer_) {
+        return;
+    }
+
+    uv_close(reinterpret_cast<uv_handle_t*>(probeTimer_), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_timer_t*>(handle);
+    });
+
+    probeTimer_ = nullptr;
+}
+
+void StartWorker::ProbeTimer(uv_timer_t *handle) {
+    StartWorker *worker = static_cast<StartWorker*>(handle->data);
+
+    if (worker->Cancelled() || uv_hrtime() >= worker->deadline_) {
+        return worker->FinishProbing(false);
+    }
+
+    worker->probeQueued_ = true;
+    uv_queue_work(worker->data_->loop, &worker->probeWork_, ProbeWork, ProbeDone);
+}
+
+void StartWorker::ProbeWork(uv_work_t *req) {
+    StartWorker *worker = static_cast<StartWorker*>(req->data);
+    lxc_container *container = worker->container_;
+
+    // a command that hangs must not hold the thread until the timeout
+    uint64_t deadline = std::min(worker->deadline_,
+            uv_hrtime() + kProbeTimeout * static_cast<uint64_t>(1e6));
+
+    if (!lxc_container_get(container)) {
+        worker->probeResult_ = false;
+        return;
+    }
+
+    worker->probeResult_ = worker->Probe(deadline);
+    lxc_container_put(container);
+}
+
+void StartWorker::ProbeDone(uv_work_t *req, int status) {
+    StartWorker *worker = static_cast<StartWorker*>(req->data);
+    worker->probeQueued_ = false;
+
+    if (worker->abandoned_) {
+        return worker->FinishProbing(false);
+    }
+
+    if (status == 0 && worker->probeResult_) {
+        worker->readyTime_ = (uv_hrtime() - worker->start_) / 1e6;
+        return worker->FinishProbing(true);
+    }
+
+    uv_timer_start(worker->probeTimer_, ProbeTimer, kProbeInterval, 0);
+}
+
+bool StartWorker::Probe(uint64_t deadline) {
+    if (!readyFile_.empty() || !readySocket_.empty()) {
+        pid_t pid = container_->init_pid(container_);
+
+        if (pid <= 0) {
+            return false;
+        }
+
+        // paths within the container's root, as seen through its init process
+        std::string root = "/proc/" + std::to_string(pid) + "/root";
+
+        if (!readyFile_.empty() && access((root + readyFile_).c_str(), F_OK) != 0) {
+            return false;
+        }
+
+        if (!readySocket_.empty()) {
+            std::string path = root + readySocket_;
+            sockaddr_un address = {};
+
+            if (path.size() >= sizeof(address.sun_path)) {
+                return false;
+            }
+
+            address.sun_family = AF_UNIX;
+            strcpy(address.sun_path, path.c_str());
+
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            int ret = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+            close(fd);
+
+            if (ret != 0) {
+                return false;
+            }
+        }
+    }
+
+    if (readyRunlevel_) {
+        std::string runlevel = "runlevel";
+        std::vector<char*> argv = { &runlevel[0], nullptr };
+        std::string output;
+
+        // runlevel prints "<previous> <current>", and fails with "unknown"
+        // until a runlevel has been reached
+        if (!RunCommand(argv, deadline, &output)) {
+            return false;
+        }
+
+        while (!output.empty() && isspace(output.back())) {
+            output.pop_back();
+        }
+
+        if (runlevel_ != 0 && (output.size() < 2 || output[output.size() - 2] != ' '
+                || toupper(output.back()) != runlevel_)) {
+            return false;
+        }
+    }
+
+    if (!readyCommand_.empty()) {
+        std::vector<char*> argv;
+
+        for (std::string& arg : readyCommand_) {
+            argv.push_back(&arg[0]);
+        }
+
+        argv.push_back(nullptr);
+
+        return RunCommand(argv, deadline);
+    }
+
+    return true;
+}
+
+// Runs a command inside the container and returns true if it exits with 0.
+// The command is killed if it is still running at `deadline` or when the
+// operation is cancelled. With `output`, its stdout is collected.
+bool StartWorker::RunCommand(std::vector<char*>& argv, uint64_t deadline,
+        std::string *output) {
+    int devnull = open("/dev/null", O_RDWR | O_CLOEXEC);
+    int pipefds[2] = { -1, -1 };
+
+    if (devnull < 0) {
+        return false;
+    }
+
+    if (output && pipe2(pipefds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        close(devnull);
+        return false;
+    }
+
+    lxc_attach_options_t options = LXC_ATTACH_OPTIONS_DEFAULT;
+    options.env_policy = LXC_ATTACH_CLEAR_ENV;
+    options.stdin_fd = devnull;
+    options.stdout_fd = output ? pipefds[1] : devnull;
+    options.stderr_fd = devnull;
+
+    lxc_attach_command_t command = { argv[0], argv.data() };
+    pid_t pid;
+
+#ifdef HAVE_UV_CLOEXEC_LOCK
+    // Acquire write lock to prevent opening new FDs in other threads.
+    uv_loop_t *loop = data_->loop;
+    CloexecWriteLock(loop);
+#endif
+
+    int ret = container_->attach(container_, lxc_attach_run_command, &command,
+            &options, &pid);
+
+#ifdef HAVE_UV_CLOEXEC_LOCK
+    CloexecWriteUnlock(loop);
+#endif
+
+    close(devnull);
+
+    if (output) {
+        close(pipefds[1]);
+    }
+
+    if (ret == -1) {
+        if (output) {
+            close(pipefds[0]);
+        }
+
+        return false;
+    }
+
+    int status;
+    bool killed = false;
+
+    for (;;) {
+        ret = waitpid(pid, &status, WNOHANG);
+
+        if (ret != 0) {
+            if (ret == -1 && errno == EINTR) {
+                continue;
+            }
+
+            break;
+        }
+
+        if (uv_hrtime() >= deadline || Cancelled()) {
+            kill(pid, SIGKILL);
+            killed = true;
+
+            do {
+                ret = waitpid(pid, &status, 0);
+            } while (ret == -1 && errno == EINTR);
+
+            break;
+        }
+
+        usleep(10 * 1000);
+    }
+
+    if (output) {
+        // the output of runlevel is far below the pipe's capacity
+        char buffer[256];
+        ssize_t n;
+
+        while ((n = read(pipefds[0], buffer, sizeof(buffer))) > 0) {
+            output->append(buffer, n);
+        }
+
+        close(pipefds[0]);
+    }
+
+    return !killed && ret == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#ifdef HAVE_DAEMONIZED_EXECUTE
+
+bool StartWorker::StartInit() {
+    container_->want_daemonize(container_, true);
+    return container_->start(container_, 1, args_.data());
+}
+
+#else
+
+// Closes all file descriptors except `keep`, the child must not hold on to
+// any of node's sockets for the lifetime of the container.
+static void CloseFds(int keep) {
+    int devnull = open("/dev/null", O_RDWR);
+
+    if (devnull >= 0) {
+        dup2(devnull, STDIN_FILENO);
+        dup2(devnull, STDOUT_FILENO);
+        dup2(devnull, STDERR_FILENO);
+    }
+
+    int maxfd = getdtablesize();
+
+    for (int fd = 3; fd < maxfd; fd++) {
+        if (fd != keep) {
+            close(fd);
+        }
+    }
+}
+
+bool StartWorker::StartInit() {
+    int fds[2];
+
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        return false;
+    }
+
+    // start() blocks until the command exits, so run it in a detached
+    // grandchild and wait until the container is running
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        close(fds[0]);
+        setsid();
+
+        if (fork() == 0) {
+            CloseFds(fds[1]);
+
+            bool ret = container_->start(container_, 1, args_.data());
+
+            // tell the parent that start() returned, in case it still waits
+            ssize_t written;
+            do {
+                written = write(fds[1], &ret, sizeof(ret));
+            } while (written == -1 && errno == EINTR);
+
+            _exit(ret ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+
+    if (pid < 0) {
+        close(fds[0]);
+        return false;
+    }
+
+    int ret;
+
+    do {
+        ret = waitpid(pid, nullptr, 0);
+    } while (ret == -1 && errno == EINTR);
+
+    pollfd pfd = { fds[0], POLLIN, 0 };
+    bool running = false;
+
+    for (;;) {
+        if (container_->wait(container_, "RUNNING", 0)) {
+            running = true;
+            break;
+        }
+
+        // readable (or hung up) means start() has already returned
+        ret = poll(&pfd, 1, 50);
+
+        if (ret > 0 || (ret == -1 && errno != EINTR)) {
+            running = container_->is_running(container_);
+            break;
+        }
+    }
+
+    close(fds[0]);
+
+    return running;
+}
+
+#endif
+
+void StartCleanup(AddonData *data) {
+    // Abandon() removes the worker from the set
+    while (!data->startWorkers.empty()) {
+        (*data->startWorkers.begin())->Abandon();
     }
 }
@@ -1,22 +1,80 @@
 #ifndef SOURCEBOX_START_H
 #define SOURCEBOX_START_H
 
+#include <string>
 #include <vector>
 
 #include "async.h"
+#include "placement.h"
 
 class StartWorker : public LxcWorker {
 public:
-    StartWorker(lxc_container *container, Nan::Callback *callback,
-            v8::Local<v8::Array> args);
+    StartWorker(AddonData *data, lxc_container *container, Nan::Callback *callback,
+            v8::Local<v8::Array> args, v8::Local<v8::Object> options);
 
     ~StartWorker();
 
+    Metrics::Operation OperationType() const override {
+        return Metrics::kStart;
+    }
+
+    // Completes workers that are still waiting for readiness without calling
+    // back, once their context is gone.
+    void Abandon();
+
+protected:
+    void Destroy() override;
+
 private:
     void LxcExecute() override;
+    void HandleOKCallback() override;
+
+    bool StartInit();
+    bool WaitRunning();
+
+    // Readiness is probed from the loop, so the worker's threadpool thread
+    // and scheduler slot are released once the container is running. Every
+    // attempt is a separate work item on the threadpool.
+    void StartProbing();
+    void FinishProbing(bool ready);
+    void CloseProbeTimer();
+    static void ProbeTimer(uv_timer_t *handle);
+    static void ProbeWork(uv_work_t *req);
+    static void ProbeDone(uv_work_t *req, int status);
+
+    bool Probe(uint64_t deadline);
+    bool RunCommand(std::vector<char*>& argv, uint64_t deadline,
+            std::string *output = nullptr);
 
     std::vector<char*> args_;
-    bool lxcInit_ = false; // TODO start just freezes when this is true
+    bool lxcInit_ = false;
+
+    bool place_ = false;
+    Placement::Request placement_;
+
+    // readiness
+    bool waitReady_ = false;
+    uint64_t timeout_ = 30000;
+    std::string readyFile_;
+    std::string readySocket_;
+    std::vector<std::string> readyCommand_;
+    bool readyRunlevel_ = false;
+    char runlevel_ = 0;
+
+    uint64_t start_ = 0;
+    uint64_t deadline_ = 0;
+    double runningTime_ = -1;
+    double readyTime_ = -1;
+
+    // probing from the loop
+    bool probing_ = false;
+    bool abandoned_ = false;
+    bool probeQueued_ = false;
+    bool probeResult_ = false;
+    uv_timer_t *probeTimer_ = nullptr;
+    uv_work_t probeWork_;
 };
 
+void StartCleanup(AddonData *data);
+
 #endif
@@ -1,9 +1,13 @@
 #include "stop.h"
 
+#include "placement.h"
+
 using namespace v8;
 
 void StopWorker::LxcExecute() {
     if (!container_->stop(container_)) {
         SetErrorMessage("Failed to stop container");
+    } else {
+        data_->placement->Release(container_);
     }
 }
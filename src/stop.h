@@ -7,6 +7,10 @@ class StopWorker : public LxcWorker {
 public:
     using LxcWorker::LxcWorker;
 
+    Metrics::Operation OperationType() const override {
+        return Metrics::kStop;
+    }
+
 private:
     void LxcExecute() override;
 };
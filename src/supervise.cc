@@ -0,0 +1,554 @@
+#include "supervise.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "lxc.h"
+#include "supervisor_protocol.h"
+
+using namespace v8;
+
+// Requests are answered right away, unless the supervisor hangs
+static const int kReplyTimeout = 30;
+
+static void CloseAll(std::vector<int>& fds) {
+    for (int fd : fds) {
+        close(fd);
+    }
+
+    fds.clear();
+}
+
+// Message of an `error <errno>` reply.
+static const char *ReplyError(SuperviseWorker::Mode mode, int error) {
+    switch (error) {
+    case ENOENT:
+        return mode == SuperviseWorker::kAdopt
+            ? "Unknown supervised process" : "Container does not exist";
+    case EBUSY:
+        return "Supervised process is already adopted";
+    case EEXIST:
+        return "Supervised process id is already in use";
+    case ESRCH:
+        return "Container is not running";
+    default:
+        return strerror(error);
+    }
+}
+
+SupervisedProcess::SupervisedProcess(AddonData *data, int sock,
+        Local<Object> attachedProcess)
+        : data_(data), sock_(sock), attachedProcess_(attachedProcess) {
+    fcntl(sock_, F_SETFL, fcntl(sock_, F_GETFL) | O_NONBLOCK);
+
+    poll_ = new uv_poll_t;
+    poll_->data = this;
+    uv_poll_init(data_->loop, poll_, sock_);
+    uv_poll_start(poll_, UV_READABLE, OnPoll);
+
+    data_->supervisedProcesses.insert(this);
+}
+
+SupervisedProcess::~SupervisedProcess() {
+    close(sock_);
+}
+
+Local<Object> SupervisedProcess::Wrap() {
+    Nan::EscapableHandleScope scope;
+
+    Local<Object> wrap = Nan::New(data_->supervisedConstructor)->NewInstance();
+    Nan::SetInternalFieldPointer(wrap, 0, this);
+
+    wrap_.Reset(wrap);
+
+    return scope.Escape(wrap);
+}
+
+void SupervisedProcess::Ref() {
+    uv_ref(reinterpret_cast<uv_handle_t*>(poll_));
+}
+
+void SupervisedProcess::Unref() {
+    uv_unref(reinterpret_cast<uv_handle_t*>(poll_));
+}
+
+void SupervisedProcess::Close() {
+    Nan::HandleScope scope;
+
+    data_->supervisedProcesses.erase(this);
+
+    if (!wrap_.IsEmpty()) {
+        Nan::SetInternalFieldPointer(Nan::New(wrap_), 0, nullptr);
+        wrap_.Reset();
+    }
+
+    attachedProcess_.Reset();
+
+    uv_close(reinterpret_cast<uv_handle_t*>(poll_), OnClose);
+}
+
+void SupervisedProcess::OnMessage() {
+    std::vector<std::string> fields;
+    std::vector<int> fds;
+
+    int ret = ReceiveMessage(sock_, fields, fds);
+
+    if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+
+    // nothing but the exit is expected
+    CloseAll(fds);
+
+    Nan::HandleScope scope;
+    Local<Object> attachedProcess = Nan::New(attachedProcess_);
+
+    if (ret != 1 || fields.size() != 3 || fields[0] != "exit") {
+        Close();
+        return EmitError(attachedProcess, "Lost connection to supervisor");
+    }
+
+    Local<Value> exitCode = Nan::Null();
+    Local<Value> signalCode = Nan::Null();
+
+    if (!fields[2].empty()) {
+        signalCode = Nan::New(node::signo_string(atoi(fields[2].c_str()))).ToLocalChecked();
+    } else if (!fields[1].empty()) {
+        exitCode = Nan::New<Uint32>(atoi(fields[1].c_str()));
+    }
+
+    Close();
+
+    const int argc = 3;
+    Local<Value> argv[argc] = {
+        attachedProcess,
+        exitCode,
+        signalCode
+    };
+
+    data_->exitCallback.Call(argc, argv);
+}
+
+void SupervisedProcess::OnPoll(uv_poll_t *handle, int status, int events) {
+    static_cast<SupervisedProcess*>(handle->data)->OnMessage();
+}
+
+void SupervisedProcess::OnClose(uv_handle_t *handle) {
+    SupervisedProcess *process = static_cast<SupervisedProcess*>(handle->data);
+
+    delete process->poll_;
+    delete process;
+}
+
+SuperviseWorker::SuperviseWorker(AddonData *data, lxc_container *container,
+        const std::string& socket, const std::string& id, AttachTask *task,
+        Local<Object> attachedProcess)
+        : AsyncWorker(data, container, nullptr), mode_(kAttach), socket_(socket),
+        id_(id), task_(task), name_(container->name), configPath_(container->config_path) {
+    Nan::HandleScope scope;
+
+    SaveToPersistent("attachedProcess", attachedProcess);
+
+    // the streams might close the parent ends before we get to send them
+    Local<Array> fds = attachedProcess->Get(Nan::New("_fds").ToLocalChecked()).As<Array>();
+
+    for (unsigned int i = 0; i < task_->fds.size(); i++) {
+        Local<Value> fd = fds->Get(i);
+
+        if (task_->fds[i] == -1) {
+            stdio_.push_back('i');
+            continue;
+        }
+
+        childFds_.push_back(task_->fds[i]);
+
+        if (fd->IsUint32()) {
+            stdio_.push_back('p');
+            parentFds_.push_back(fcntl(fd->Uint32Value(), F_DUPFD_CLOEXEC, 3));
+        } else {
+            stdio_.push_back('f');
+        }
+    }
+}
+
+SuperviseWorker::SuperviseWorker(AddonData *data, lxc_container *container,
+        Nan::Callback *callback, const std::string& socket, const std::string& id,
+        Local<Function> attachedProcessConstructor, Local<Value> owner)
+        : AsyncWorker(data, container, callback), mode_(kAdopt), socket_(socket),
+        id_(id), name_(container->name) {
+    Nan::HandleScope scope;
+
+    SaveToPersistent("attachedProcessConstructor", attachedProcessConstructor);
+    SaveToPersistent("owner", owner);
+}
+
+SuperviseWorker::SuperviseWorker(AddonData *data, Nan::Callback *callback,
+        const std::string& socket)
+        : AsyncWorker(data, nullptr, callback), mode_(kList), socket_(socket) {}
+
+SuperviseWorker::~SuperviseWorker() {
+    if (sock_ != -1) {
+        close(sock_);
+    }
+
+    for (int fd : parentFds_) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+
+    CloseAll(replyFds_);
+
+    delete task_;
+}
+
+std::vector<std::string> SuperviseWorker::Request() const {
+    if (mode_ == kList) {
+        return {"list"};
+    }
+
+    if (mode_ == kAdopt) {
+        return {"adopt", id_, name_};
+    }
+
+    const AttachProfile& profile = *task_->profile;
+    std::vector<std::string> request = {"attach", id_, configPath_, name_, profile.cwd,
+        std::to_string(profile.uid), std::to_string(profile.gid),
+        task_->term ? "1" : "0", stdio_};
+
+    size_t envc = 0;
+
+    while (profile.env[envc]) {
+        envc++;
+    }
+
+    request.push_back(std::to_string(envc));
+    request.insert(request.end(), profile.env.begin(), profile.env.begin() + envc);
+
+    // only plain commands are supervised, see QueueSupervisedAttach()
+    const std::vector<char*>& args = static_cast<ExecCommand*>(task_->command)->Arguments();
+    request.insert(request.end(), args.begin(), args.end() - 1);
+
+    return request;
+}
+
+void SuperviseWorker::AsyncExecute() {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (socket_.size() >= sizeof(address.sun_path)) {
+        SetErrorMessage("Invalid supervisor socket");
+        return;
+    }
+
+    strcpy(address.sun_path, socket_.c_str());
+
+    sock_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    timeval timeout = {kReplyTimeout, 0};
+    setsockopt(sock_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (connect(sock_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+        std::string message = std::string("Could not connect to supervisor: ") + strerror(errno);
+        SetErrorMessage(message.c_str());
+        return;
+    }
+
+    std::vector<int> fds = childFds_;
+    fds.insert(fds.end(), parentFds_.begin(), parentFds_.end());
+
+    if (!SendMessage(sock_, Request(), fds)) {
+        SetErrorMessage(strerror(errno));
+        return;
+    }
+
+    int ret = ReceiveMessage(sock_, reply_, replyFds_);
+
+    if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        SetErrorMessage("Supervisor did not respond");
+        return;
+    } else if (ret == -1) {
+        SetErrorMessage(strerror(errno));
+        return;
+    } else if (ret == 0 || reply_.empty()) {
+        SetErrorMessage("Lost connection to supervisor");
+        return;
+    }
+
+    const std::string& type = reply_[0];
+
+    if (type == "error" && reply_.size() == 2) {
+        SetErrorMessage(ReplyError(mode_, atoi(reply_[1].c_str())));
+    } else if (mode_ == kAttach && (type == "attached" || type == "failed") && reply_.size() == 2) {
+        return;
+    } else if (mode_ == kAdopt && type == "adopted" && reply_.size() == 5) {
+        return;
+    } else if (mode_ == kList && type == "list" && reply_.size() % 4 == 1) {
+        return;
+    } else {
+        SetErrorMessage("Invalid reply from supervisor");
+    }
+}
+
+void SuperviseWorker::HandleOKCallback() {
+    Nan::HandleScope scope;
+
+    switch (mode_) {
+    case kAttach:
+        return HandleAttached();
+    case kAdopt:
+        return HandleAdopted();
+    case kList:
+        return HandleList();
+    }
+}
+
+void SuperviseWorker::HandleErrorCallback() {
+    Nan::HandleScope scope;
+
+    if (mode_ != kAttach) {
+        return AsyncWorker::HandleErrorCallback();
+    }
+
+    EmitError(GetFromPersistent("attachedProcess")->ToObject(), ErrorMessage());
+}
+
+void SuperviseWorker::HandleAttached() {
+    Local<Object> attachedProcess = GetFromPersistent("attachedProcess")->ToObject();
+
+    if (reply_[0] == "failed") {
+        // attaching was successful but exec failed
+        const int argc = 2;
+        Local<Value> argv[argc] = {
+            attachedProcess,
+            Nan::New<Int32>(-atoi(reply_[1].c_str()))
+        };
+
+        data_->exitCallback.Call(argc, argv);
+        return;
+    }
+
+    int pid = atoi(reply_[1].c_str());
+    Local<Uint32> pidValue = Nan::New<Uint32>(pid);
+
+    attachedProcess->Set(Nan::New("pid").ToLocalChecked(), pidValue);
+
+    SupervisedProcess *process = new SupervisedProcess(data_, sock_, attachedProcess);
+    sock_ = -1;
+
+    attachedProcess->Set(Nan::New("_supervised").ToLocalChecked(), process->Wrap());
+
+    if (!attachedProcess->Get(Nan::New("_ref").ToLocalChecked())->BooleanValue()) {
+        process->Unref();
+    }
+
+    if (Cancelled()) {
+        // cancelled after the worker finished, the supervisor reports the exit
+        kill(pid, SIGKILL);
+    }
+
+    const int argc = 2;
+    Local<Value> argv[argc] = {
+        Nan::New("attach").ToLocalChecked(),
+        pidValue
+    };
+
+    Emit(attachedProcess, argc, argv);
+}
+
+void SuperviseWorker::HandleAdopted() {
+    const std::string& stdio = reply_[4];
+    bool term = reply_[3] == "1";
+
+    size_t pipes = std::count(stdio.begin(), stdio.end(), 'p');
+
+    if (pipes != replyFds_.size() || (term && (stdio.size() < 3 || pipes < 3))) {
+        const int argc = 1;
+        Local<Value> argv[argc] = {
+            Nan::Error("Invalid reply from supervisor")
+        };
+
+        callback->Call(argc, argv);
+        return;
+    }
+
+    Local<Array> fdArray = Nan::New<Array>(stdio.size());
+    size_t next = 0;
+
+    for (unsigned int i = 0; i < stdio.size(); i++) {
+        if (stdio[i] != 'p') {
+            fdArray->Set(i, Nan::Null());
+            continue;
+        }
+
+        int fd = replyFds_[next++];
+
+        if (term && i > 0 && i < 3) {
+            // stdin, stdout and stderr share the terminal
+            close(fd);
+            fd = replyFds_[0];
+        }
+
+        fdArray->Set(i, Nan::New<Uint32>(fd));
+    }
+
+    // owned by the AttachedProcess now
+    replyFds_.clear();
+
+    Local<Function> AttachedProcess = GetFromPersistent("attachedProcessConstructor").As<Function>();
+
+    const int argc = 4;
+    Local<Value> argv[argc] = {
+        Nan::New(reply_[2]).ToLocalChecked(),
+        fdArray,
+        Nan::New(term),
+        GetFromPersistent("owner")
+    };
+
+    Local<Object> attachedProcess = AttachedProcess->NewInstance(argc, argv);
+    attachedProcess->Set(Nan::New("pid").ToLocalChecked(),
+            Nan::New<Uint32>(atoi(reply_[1].c_str())));
+
+    SupervisedProcess *process = new SupervisedProcess(data_, sock_, attachedProcess);
+    sock_ = -1;
+
+    attachedProcess->Set(Nan::New("_supervised").ToLocalChecked(), process->Wrap());
+
+    const int cbArgc = 2;
+    Local<Value> cbArgv[cbArgc] = {
+        Nan::Null(),
+        attachedProcess
+    };
+
+    // an exit that happened while nobody owned the process follows
+    callback->Call(cbArgc, cbArgv);
+}
+
+void SuperviseWorker::HandleList() {
+    size_t count = (reply_.size() - 1) / 4;
+    Local<Array> processes = Nan::New<Array>(count);
+
+    for (size_t i = 0; i < count; i++) {
+        const std::string *fields = &reply_[1 + i * 4];
+        Local<Object> process = Nan::New<Object>();
+
+        process->Set(Nan::New("id").ToLocalChecked(), Nan::New(fields[0]).ToLocalChecked());
+        process->Set(Nan::New("container").ToLocalChecked(), Nan::New(fields[1]).ToLocalChecked());
+        process->Set(Nan::New("pid").ToLocalChecked(), Nan::New<Uint32>(atoi(fields[2].c_str())));
+        process->Set(Nan::New("running").ToLocalChecked(), Nan::New(fields[3] == "1"));
+
+        processes->Set(i, process);
+    }
+
+    const int argc = 2;
+    Local<Value> argv[argc] = {
+        Nan::Null(),
+        processes
+    };
+
+    callback->Call(argc, argv);
+}
+
+void QueueSupervisedAttach(const Nan::FunctionCallbackInfo<Value>& info,
+        AttachTask *task, Local<Object> attachedProcess,
+        Local<Object> supervise, Local<Value> key) {
+    AddonData *data = GetAddonData(info);
+    std::string name;
+
+    if (key->IsString()) {
+        name = *String::Utf8Value(key);
+    }
+
+    std::string socket = *String::Utf8Value(
+            supervise->Get(Nan::New("socket").ToLocalChecked()));
+    std::string id = *String::Utf8Value(
+            supervise->Get(Nan::New("id").ToLocalChecked()));
+
+    SuperviseWorker *worker = new SuperviseWorker(data, Unwrap(info.Holder()),
+            socket, id, task, attachedProcess);
+
+    attachedProcess->Set(Nan::New("_operation").ToLocalChecked(), worker->OperationHandle());
+
+    data->scheduler->Submit(worker, name);
+}
+
+// Javascript Functions
+
+NAN_METHOD(Adopt) {
+    if (!info[0]->IsFunction() || !info[1]->IsString() || !info[2]->IsString()
+            || !info[3]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    Nan::Callback *callback = new Nan::Callback(info[3].As<Function>());
+
+    QueueWorker(info, new SuperviseWorker(GetAddonData(info), Unwrap(info.Holder()),
+            callback, *String::Utf8Value(info[1]), *String::Utf8Value(info[2]),
+            info[0].As<Function>(), info.Holder()->Get(Nan::New("owner").ToLocalChecked())));
+}
+
+NAN_METHOD(ListSupervised) {
+    if (!info[0]->IsString() || !info[1]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    Nan::Callback *callback = new Nan::Callback(info[1].As<Function>());
+
+    QueueWorker(info, new SuperviseWorker(GetAddonData(info), callback,
+            *String::Utf8Value(info[0])));
+}
+
+NAN_INLINE SupervisedProcess *UnwrapSupervisedProcess(Local<Object> object) {
+    return static_cast<SupervisedProcess*>(Nan::GetInternalFieldPointer(object, 0));
+}
+
+NAN_METHOD(SupervisedProcessRef) {
+    SupervisedProcess *process = UnwrapSupervisedProcess(info.Holder());
+
+    if (process) {
+        process->Ref();
+    }
+}
+
+NAN_METHOD(SupervisedProcessUnref) {
+    SupervisedProcess *process = UnwrapSupervisedProcess(info.Holder());
+
+    if (process) {
+        process->Unref();
+    }
+}
+
+// Initialization
+
+void SuperviseInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> constructorTemplate = Nan::New<FunctionTemplate>();
+
+    constructorTemplate->SetClassName(Nan::New("SupervisedProcess").ToLocalChecked());
+    constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(constructorTemplate, "ref", SupervisedProcessRef);
+    Nan::SetPrototypeMethod(constructorTemplate, "unref", SupervisedProcessUnref);
+
+    data->supervisedConstructor.Reset(constructorTemplate->GetFunction());
+
+    // Exports
+    exports->Set(Nan::New("listSupervised").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(ListSupervised, data->External())->GetFunction());
+}
+
+void SuperviseCleanup(AddonData *data) {
+    // the processes keep running under the supervisor
+    while (!data->supervisedProcesses.empty()) {
+        (*data->supervisedProcesses.begin())->Close();
+    }
+
+    data->supervisedConstructor.Reset();
+}
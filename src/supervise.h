@@ -0,0 +1,123 @@
+#ifndef SOURCEBOX_SUPERVISE_H
+#define SOURCEBOX_SUPERVISE_H
+
+#include <string>
+#include <vector>
+
+#include <node.h>
+#include <nan.h>
+
+#include "addon.h"
+#include "async.h"
+#include "attach.h"
+
+/**
+ * A process that runs under sourcebox-supervisor (see src/supervisor.cc).
+ * It is not our child, the supervisor reports its exit over the connection
+ * that attached or adopted it. Closing the connection leaves the process
+ * running, it can be adopted again.
+ */
+class SupervisedProcess {
+public:
+    SupervisedProcess(AddonData *data, int sock, v8::Local<v8::Object> attachedProcess);
+
+    // Stored as `_supervised` on the AttachedProcess, for ref() and unref().
+    v8::Local<v8::Object> Wrap();
+
+    void Ref();
+    void Unref();
+
+    // Disowns the process, the supervisor keeps it for adoption.
+    void Close();
+
+private:
+    ~SupervisedProcess();
+
+    void OnMessage();
+
+    static void OnPoll(uv_poll_t *handle, int status, int events);
+    static void OnClose(uv_handle_t *handle);
+
+    AddonData *data_;
+    int sock_;
+    uv_poll_t *poll_;
+
+    Nan::Persistent<v8::Object> attachedProcess_;
+    Nan::Persistent<v8::Object> wrap_;
+};
+
+/**
+ * Talks to the supervisor on the threadpool: attaches a process through it,
+ * adopts one or lists the processes it supervises.
+ */
+class SuperviseWorker : public AsyncWorker {
+public:
+    enum Mode {
+        kAttach,
+        kAdopt,
+        kList
+    };
+
+    // Attaches the process of `task`, the worker takes ownership of it.
+    SuperviseWorker(AddonData *data, lxc_container *container,
+            const std::string& socket, const std::string& id, AttachTask *task,
+            v8::Local<v8::Object> attachedProcess);
+
+    // Adopts a process, the callback receives a new AttachedProcess that
+    // belongs to `owner`, the JS container.
+    SuperviseWorker(AddonData *data, lxc_container *container, Nan::Callback *callback,
+            const std::string& socket, const std::string& id,
+            v8::Local<v8::Function> attachedProcessConstructor, v8::Local<v8::Value> owner);
+
+    // Lists the supervised processes.
+    SuperviseWorker(AddonData *data, Nan::Callback *callback, const std::string& socket);
+
+    ~SuperviseWorker();
+
+    Metrics::Operation OperationType() const override {
+        return mode_ == kList ? Metrics::kList : Metrics::kAttach;
+    }
+
+private:
+    void AsyncExecute() override;
+    void HandleOKCallback() override;
+    void HandleErrorCallback() override;
+
+    // Request that is sent to the supervisor
+    std::vector<std::string> Request() const;
+
+    void HandleAttached();
+    void HandleAdopted();
+    void HandleList();
+
+    Mode mode_;
+    std::string socket_;
+    std::string id_;
+
+    AttachTask *task_ = nullptr;
+    std::string name_;
+    std::string configPath_;
+    std::string stdio_;
+
+    // child fds are owned by the task, the duplicates of the parent ends by us
+    std::vector<int> childFds_;
+    std::vector<int> parentFds_;
+
+    // results
+    int sock_ = -1;
+    std::vector<std::string> reply_;
+    std::vector<int> replyFds_;
+};
+
+// Attaches the process of `task` through the supervisor instead of the
+// AttachWorker. `supervise` are the options, `{id, socket}`.
+void QueueSupervisedAttach(const Nan::FunctionCallbackInfo<v8::Value>& info,
+        AttachTask *task, v8::Local<v8::Object> attachedProcess,
+        v8::Local<v8::Object> supervise, v8::Local<v8::Value> key);
+
+NAN_METHOD(Adopt);
+
+void SuperviseInit(v8::Handle<v8::Object> exports, AddonData *data);
+void SuperviseCleanup(AddonData *data);
+
+#endif
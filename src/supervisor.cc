@@ -0,0 +1,711 @@
+/**
+ * sourcebox-supervisor, keeps attached processes alive across restarts of
+ * the node process that attached them.
+ *
+ * Processes attached with the `supervise` option are attached by the
+ * supervisor, on behalf of the addon. It is their parent, holds the parent
+ * ends of their pipes and waits for them through a pidfd. If node goes away,
+ * the processes keep running, and a new node process can adopt them: it gets
+ * the pipes back and is told when they exit. See supervisor_protocol.h.
+ *
+ *     sourcebox-supervisor [socket]
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <utmp.h>
+
+#include <algorithm>
+#include <map>
+
+#include <lxc/lxccontainer.h>
+
+#include "child_fds.h"
+#include "supervisor_protocol.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+static const char *kDefaultSocket = "/run/sourcebox-supervisor.sock";
+
+// Time an attached process gets to exec its command, below the time the addon
+// waits for a reply
+static const int kExecTimeoutMs = 20000;
+
+struct Process {
+    std::string id;
+    std::string name;
+    std::string command;
+
+    pid_t pid;
+    int pidfd;
+
+    bool term;
+    std::string stdio;
+
+    // one per pipe, in the order of `stdio`
+    std::vector<int> parentFds;
+
+    // connection that receives the exit, -1 while nobody owns the process
+    int owner = -1;
+
+    bool exited = false;
+    int status = 0;
+};
+
+// What AttachMain() needs within the container
+struct AttachRequest {
+    std::vector<int> fds;
+    std::vector<char*> argv;
+    bool term;
+    int errorFd;
+};
+
+// An attach in progress. Attaching blocks until the command was executed, so
+// every attach runs on a thread of its own and the poll loop keeps serving
+// everyone else.
+struct Attaching {
+    std::vector<std::string> fields;
+    std::vector<int> fds;
+
+    // connection that receives the result, -1 once it went away
+    int client;
+
+    // readable once the thread is done
+    int doneFd;
+    pthread_t thread;
+
+    // results, only valid once the thread is done
+    pid_t pid = -1;
+    int pidfd = -1;
+    int error = 0;
+    bool execFailed = false;
+    std::vector<int> parentFds;
+};
+
+static std::map<std::string, Process*> processes;
+static std::map<std::string, Attaching*> attaching;
+static std::vector<int> clients;
+
+static void DropClient(int client);
+
+static void CloseAll(const std::vector<int>& fds) {
+    for (int fd : fds) {
+        close(fd);
+    }
+}
+
+// Client sockets are non-blocking, a client that does not read its messages
+// is dropped instead of blocking the supervisor.
+static bool Send(int client, const std::vector<std::string>& fields,
+        const std::vector<int>& fds = std::vector<int>()) {
+    if (SendMessage(client, fields, fds)) {
+        return true;
+    }
+
+    DropClient(client);
+    return false;
+}
+
+static void SendError(int client, int error) {
+    Send(client, {"error", std::to_string(error)});
+}
+
+// Runs within the container, like AttachTask::Main() in the addon.
+static int AttachMain(void *payload) {
+    AttachRequest *request = static_cast<AttachRequest*>(payload);
+
+    if (request->term) {
+        login_tty(0);
+    } else {
+        setsid();
+    }
+
+    SetupChildFds(request->fds, { &request->errorFd });
+
+    execvp(request->argv.front(), request->argv.data());
+
+    int error = errno;
+    ssize_t ret;
+
+    do {
+        ret = write(request->errorFd, &error, sizeof(error));
+    } while (ret == -1 && errno == EINTR);
+
+    return 127;
+}
+
+// Returns the pid, or -1 with errno set. `execFailed` tells a failed exec
+// apart from a failed attach.
+static pid_t Attach(const std::string& lxcpath, const std::string& name,
+        lxc_attach_options_t& options, AttachRequest& request, bool& execFailed) {
+    execFailed = false;
+
+    lxc_container *container = lxc_container_new(name.c_str(),
+            lxcpath.empty() ? nullptr : lxcpath.c_str());
+
+    if (!container) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (!container->is_running(container)) {
+        lxc_container_put(container);
+        errno = ESRCH;
+        return -1;
+    }
+
+    int errorFds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, errorFds) == -1) {
+        lxc_container_put(container);
+        return -1;
+    }
+
+    request.errorFd = errorFds[1];
+
+    pid_t pid;
+    int ret = container->attach(container, AttachMain, &request, &options, &pid);
+
+    lxc_container_put(container);
+    close(errorFds[1]);
+
+    if (ret == -1) {
+        close(errorFds[0]);
+        errno = EIO;
+        return -1;
+    }
+
+    // closed on exec, a process that hangs before is given up on
+    pollfd pfd = { errorFds[0], POLLIN, 0 };
+
+    do {
+        ret = poll(&pfd, 1, kExecTimeoutMs);
+    } while (ret == -1 && errno == EINTR);
+
+    if (ret == 0) {
+        close(errorFds[0]);
+        kill(pid, SIGKILL);
+
+        do {
+            ret = waitpid(pid, nullptr, 0);
+        } while (ret == -1 && errno == EINTR);
+
+        errno = ETIMEDOUT;
+        return -1;
+    }
+
+    int execErrno = 0;
+
+    do {
+        ret = read(errorFds[0], &execErrno, sizeof(execErrno));
+    } while (ret == -1 && errno == EINTR);
+
+    close(errorFds[0]);
+
+    if (ret != 0) {
+        // exec failed
+        do {
+            ret = waitpid(pid, nullptr, 0);
+        } while (ret == -1 && errno == EINTR);
+
+        execFailed = true;
+        errno = execErrno ? execErrno : EIO;
+        return -1;
+    }
+
+    return pid;
+}
+
+// Runs on the thread of an attach.
+static void *AttachThread(void *arg) {
+    Attaching *attach = static_cast<Attaching*>(arg);
+    const std::vector<std::string>& fields = attach->fields;
+    std::vector<int>& fds = attach->fds;
+
+    const std::string& stdio = fields[8];
+    size_t envc = strtoul(fields[9].c_str(), nullptr, 10);
+    size_t passed = 0;
+
+    for (char mode : stdio) {
+        passed += mode == 'p' || mode == 'f';
+    }
+
+    AttachRequest request;
+    request.term = fields[7] == "1";
+
+    size_t next = 0;
+
+    for (char mode : stdio) {
+        request.fds.push_back(mode == 'i' ? -1 : fds[next++]);
+    }
+
+    std::vector<int> childFds(fds.begin(), fds.begin() + passed);
+    std::vector<int> parentFds(fds.begin() + passed, fds.end());
+
+    std::vector<char*> env;
+
+    for (size_t i = 0; i < envc; i++) {
+        env.push_back(const_cast<char*>(fields[10 + i].c_str()));
+    }
+
+    env.push_back(nullptr);
+
+    for (size_t i = 10 + envc; i < fields.size(); i++) {
+        request.argv.push_back(const_cast<char*>(fields[i].c_str()));
+    }
+
+    request.argv.push_back(nullptr);
+
+    lxc_attach_options_t options = LXC_ATTACH_OPTIONS_DEFAULT;
+
+    options.initial_cwd = const_cast<char*>(fields[4].c_str());
+    options.env_policy = LXC_ATTACH_CLEAR_ENV;
+    options.extra_env_vars = env.data();
+    options.uid = strtoul(fields[5].c_str(), nullptr, 10);
+    options.gid = strtoul(fields[6].c_str(), nullptr, 10);
+    options.stdin_fd = request.fds[0];
+    options.stdout_fd = request.fds[1];
+    options.stderr_fd = request.fds[2];
+
+    bool execFailed;
+    pid_t pid = Attach(fields[2], fields[3], options, request, execFailed);
+    int error = errno;
+
+    // the child has its own copies now
+    CloseAll(childFds);
+
+    int pidfd = pid == -1 ? -1 : syscall(SYS_pidfd_open, pid, 0);
+
+    if (pid != -1 && pidfd == -1) {
+        // can not wait for it, do not leave it behind
+        error = errno;
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        pid = -1;
+    }
+
+    if (pid == -1) {
+        CloseAll(parentFds);
+        parentFds.clear();
+    } else {
+        fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+    }
+
+    attach->pid = pid;
+    attach->pidfd = pidfd;
+    attach->error = error;
+    attach->execFailed = execFailed;
+    attach->parentFds = parentFds;
+
+    uint64_t value = 1;
+    ssize_t ret;
+
+    do {
+        ret = write(attach->doneFd, &value, sizeof(value));
+    } while (ret == -1 && errno == EINTR);
+
+    return nullptr;
+}
+
+static void HandleAttach(int client, std::vector<std::string>& fields,
+        std::vector<int>& fds) {
+    // attach id lxcpath name cwd uid gid term stdio envc env... command args...
+    if (fields.size() < 11) {
+        CloseAll(fds);
+        return SendError(client, EINVAL);
+    }
+
+    const std::string& id = fields[1];
+    const std::string& stdio = fields[8];
+    size_t envc = strtoul(fields[9].c_str(), nullptr, 10);
+
+    size_t pipes = 0;
+    size_t passed = 0;
+
+    for (char mode : stdio) {
+        pipes += mode == 'p';
+        passed += mode == 'p' || mode == 'f';
+    }
+
+    if (fields.size() < 11 + envc || stdio.size() < 3 || fds.size() != passed + pipes) {
+        CloseAll(fds);
+        return SendError(client, EINVAL);
+    }
+
+    if (processes.count(id) || attaching.count(id)) {
+        CloseAll(fds);
+        return SendError(client, EEXIST);
+    }
+
+    Attaching *attach = new Attaching();
+    attach->client = client;
+    attach->doneFd = eventfd(0, EFD_CLOEXEC);
+
+    if (attach->doneFd == -1) {
+        int error = errno;
+        delete attach;
+        CloseAll(fds);
+        return SendError(client, error);
+    }
+
+    attach->fields.swap(fields);
+    attach->fds.swap(fds);
+
+    int error = pthread_create(&attach->thread, nullptr, AttachThread, attach);
+
+    if (error != 0) {
+        close(attach->doneFd);
+        CloseAll(attach->fds);
+        delete attach;
+        return SendError(client, error);
+    }
+
+    attaching[attach->fields[1]] = attach;
+}
+
+// Called on the poll loop once the thread of an attach is done.
+static void FinishAttach(Attaching *attach) {
+    pthread_join(attach->thread, nullptr);
+    close(attach->doneFd);
+
+    const std::vector<std::string>& fields = attach->fields;
+    const std::string& id = fields[1];
+    int client = attach->client;
+
+    attaching.erase(id);
+
+    if (attach->pid == -1) {
+        if (client != -1) {
+            if (attach->execFailed) {
+                Send(client, {"failed", std::to_string(attach->error)});
+            } else {
+                SendError(client, attach->error);
+            }
+        }
+
+        delete attach;
+        return;
+    }
+
+    size_t envc = strtoul(fields[9].c_str(), nullptr, 10);
+
+    // kept for adoption if the client went away in the meantime
+    Process *process = new Process();
+    process->id = id;
+    process->name = fields[3];
+    process->command = fields[10 + envc];
+    process->pid = attach->pid;
+    process->pidfd = attach->pidfd;
+    process->term = fields[7] == "1";
+    process->stdio = fields[8];
+    process->parentFds = attach->parentFds;
+    process->owner = client;
+
+    processes[id] = process;
+
+    delete attach;
+
+    if (client != -1) {
+        Send(client, {"attached", std::to_string(process->pid)});
+    }
+}
+
+static void Forget(Process *process) {
+    CloseAll(process->parentFds);
+
+    if (process->pidfd != -1) {
+        close(process->pidfd);
+    }
+
+    processes.erase(process->id);
+    delete process;
+}
+
+static bool SendExit(Process *process) {
+    std::string code, signal;
+
+    if (WIFEXITED(process->status)) {
+        code = std::to_string(WEXITSTATUS(process->status));
+    } else if (WIFSIGNALED(process->status)) {
+        signal = std::to_string(WTERMSIG(process->status));
+    }
+
+    return Send(process->owner, {"exit", code, signal});
+}
+
+static void HandleAdopt(int client, const std::vector<std::string>& fields) {
+    auto it = fields.size() == 3 ? processes.find(fields[1]) : processes.end();
+
+    // only the container it was attached to may adopt it
+    if (it == processes.end() || it->second->name != fields[2]) {
+        return SendError(client, ENOENT);
+    }
+
+    Process *process = it->second;
+
+    if (process->owner != -1) {
+        return SendError(client, EBUSY);
+    }
+
+    // sent as duplicates, the supervisor keeps its own
+    if (!Send(client, {"adopted", std::to_string(process->pid), process->command,
+                    process->term ? "1" : "0", process->stdio}, process->parentFds)) {
+        return;
+    }
+
+    process->owner = client;
+
+    if (process->exited && SendExit(process)) {
+        Forget(process);
+    }
+}
+
+static void HandleList(int client) {
+    std::vector<std::string> fields = {"list"};
+
+    for (auto& pair : processes) {
+        Process *process = pair.second;
+
+        fields.push_back(process->id);
+        fields.push_back(process->name);
+        fields.push_back(std::to_string(process->pid));
+        fields.push_back(process->exited ? "0" : "1");
+    }
+
+    Send(client, fields);
+}
+
+static void DropClient(int client) {
+    auto it = std::find(clients.begin(), clients.end(), client);
+
+    if (it == clients.end()) {
+        return;
+    }
+
+    for (auto& pair : processes) {
+        if (pair.second->owner == client) {
+            pair.second->owner = -1;
+        }
+    }
+
+    for (auto& pair : attaching) {
+        if (pair.second->client == client) {
+            pair.second->client = -1;
+        }
+    }
+
+    clients.erase(it);
+    close(client);
+}
+
+static void HandleClient(int client) {
+    std::vector<std::string> fields;
+    std::vector<int> fds;
+
+    int ret = ReceiveMessage(client, fields, fds);
+
+    if (ret == -1 && errno == EAGAIN) {
+        return;
+    }
+
+    if (ret <= 0 || fields.empty()) {
+        CloseAll(fds);
+        return DropClient(client);
+    }
+
+    if (fields[0] == "attach") {
+        HandleAttach(client, fields, fds);
+        return;
+    }
+
+    CloseAll(fds);
+
+    if (fields[0] == "adopt") {
+        HandleAdopt(client, fields);
+    } else if (fields[0] == "list") {
+        HandleList(client);
+    } else {
+        SendError(client, EINVAL);
+    }
+}
+
+static void HandleExit(Process *process) {
+    int ret;
+
+    do {
+        ret = waitpid(process->pid, &process->status, 0);
+    } while (ret == -1 && errno == EINTR);
+
+    process->exited = true;
+    close(process->pidfd);
+    process->pidfd = -1;
+
+    // otherwise it is kept until it is adopted
+    if (process->owner != -1 && SendExit(process)) {
+        Forget(process);
+    }
+}
+
+static void Accept(int listenFd) {
+    int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+    if (client == -1) {
+        return;
+    }
+
+    // the socket is 0600 already, but attaching is as good as root
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &credentials, &length) == -1 ||
+            credentials.uid != geteuid()) {
+        close(client);
+        return;
+    }
+
+    clients.push_back(client);
+}
+
+static int Listen(const char *path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if (fd == -1) {
+        return -1;
+    }
+
+    // a stale socket is replaced, but not one a supervisor still listens on
+    int probe = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+    if (probe != -1) {
+        int ret = connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        close(probe);
+
+        if (ret == 0) {
+            close(fd);
+            errno = EADDRINUSE;
+            return -1;
+        }
+    }
+
+    unlink(path);
+
+    mode_t mask = umask(0077);
+    int ret = bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(mask);
+
+    if (ret == -1 || listen(fd, 64) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : getenv("SOURCEBOX_SUPERVISOR_SOCKET");
+
+    if (!path || !*path) {
+        path = kDefaultSocket;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    int listenFd = Listen(path);
+
+    if (listenFd == -1) {
+        fprintf(stderr, "sourcebox-supervisor: %s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    while (true) {
+        std::vector<pollfd> fds;
+        std::vector<Attaching*> attaches;
+        std::vector<Process*> waiting;
+
+        fds.push_back({listenFd, POLLIN, 0});
+
+        for (int client : clients) {
+            fds.push_back({client, POLLIN, 0});
+        }
+
+        for (auto& pair : attaching) {
+            fds.push_back({pair.second->doneFd, POLLIN, 0});
+            attaches.push_back(pair.second);
+        }
+
+        for (auto& pair : processes) {
+            if (pair.second->pidfd != -1) {
+                fds.push_back({pair.second->pidfd, POLLIN, 0});
+                waiting.push_back(pair.second);
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            fprintf(stderr, "sourcebox-supervisor: poll: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        size_t i = 1;
+
+        // copies, the handlers change the lists
+        std::vector<int> ready;
+
+        for (size_t j = 0; j < clients.size(); j++, i++) {
+            if (fds[i].revents) {
+                ready.push_back(fds[i].fd);
+            }
+        }
+
+        // clients first, so that the exit of a process whose owner just went
+        // away is kept for adoption
+        for (int client : ready) {
+            // might have been dropped while handling another one
+            if (std::find(clients.begin(), clients.end(), client) != clients.end()) {
+                HandleClient(client);
+            }
+        }
+
+        for (Attaching *attach : attaches) {
+            if (fds[i++].revents) {
+                FinishAttach(attach);
+            }
+        }
+
+        for (Process *process : waiting) {
+            if (fds[i++].revents) {
+                HandleExit(process);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            Accept(listenFd);
+        }
+    }
+}
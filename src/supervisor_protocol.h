@@ -0,0 +1,156 @@
+#ifndef SOURCEBOX_SUPERVISOR_PROTOCOL_H
+#define SOURCEBOX_SUPERVISOR_PROTOCOL_H
+
+/**
+ * Protocol between the addon and sourcebox-supervisor, shared by both. It
+ * must not depend on node or V8.
+ *
+ * Every message is one packet on a SOCK_SEQPACKET unix socket: NUL separated
+ * fields, the first one is the message type. Fds are passed along with
+ * SCM_RIGHTS.
+ *
+ *   attach <id> <lxcpath> <name> <cwd> <uid> <gid> <term> <stdio> <envc>
+ *          <env>... <command> <arg>...
+ *     stdio has one character per fd: 'p' (pipe), 'f' (fd) or 'i' (ignore).
+ *     The child fds of 'p' and 'f' are passed in order, followed by the
+ *     parent ends of the pipes, which the supervisor holds on to.
+ *     -> attached <pid> | failed <errno> (exec failed) | error <errno>
+ *     The reply is sent once the command was executed, replies to later
+ *     messages on the same connection may arrive before it.
+ *
+ *   adopt <id> <name>
+ *     -> adopted <pid> <command> <term> <stdio> | error <errno>
+ *     with the parent ends of the pipes.
+ *
+ *   list
+ *     -> list [<id> <name> <pid> <running>]...
+ *
+ * The connection that attached or adopted a process owns it, and receives
+ *     exit <code> <signal>
+ * once it exited, an empty field if there is no code or signal. Processes
+ * whose owner went away keep running until they are adopted again.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+static const size_t kMaxMessageSize = 65536;
+static const size_t kMaxMessageFds = 64;
+
+// Returns false and sets errno on failure.
+inline bool SendMessage(int sock, const std::vector<std::string>& fields,
+        const std::vector<int>& fds = std::vector<int>()) {
+    std::string data;
+
+    for (const std::string& field : fields) {
+        data.append(field);
+        data.push_back('\0');
+    }
+
+    if (data.size() > kMaxMessageSize || fds.size() > kMaxMessageFds) {
+        errno = EMSGSIZE;
+        return false;
+    }
+
+    iovec iov;
+    iov.iov_base = const_cast<char*>(data.data());
+    iov.iov_len = data.size();
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxMessageFds));
+
+    if (!fds.empty()) {
+        message.msg_control = control.data();
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+    }
+
+    ssize_t ret;
+
+    do {
+        ret = sendmsg(sock, &message, MSG_NOSIGNAL);
+    } while (ret == -1 && errno == EINTR);
+
+    return ret != -1;
+}
+
+// Returns 1 on success, 0 if the peer closed the connection and -1 with errno
+// set on failure. Received fds are close-on-exec.
+inline int ReceiveMessage(int sock, std::vector<std::string>& fields,
+        std::vector<int>& fds) {
+    std::vector<char> data(kMaxMessageSize);
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxMessageFds));
+
+    iovec iov;
+    iov.iov_base = data.data();
+    iov.iov_len = data.size();
+
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.data();
+    message.msg_controllen = control.size();
+
+    ssize_t length;
+
+    do {
+        length = recvmsg(sock, &message, MSG_CMSG_CLOEXEC);
+    } while (length == -1 && errno == EINTR);
+
+    if (length <= 0) {
+        return length;
+    }
+
+    fields.clear();
+    fds.clear();
+
+    for (cmsghdr *header = CMSG_FIRSTHDR(&message); header;
+            header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t offset = fds.size();
+
+            fds.resize(offset + count);
+            memcpy(fds.data() + offset, CMSG_DATA(header), sizeof(int) * count);
+        }
+    }
+
+    if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        for (int fd : fds) {
+            close(fd);
+        }
+
+        fds.clear();
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    size_t start = 0;
+
+    for (ssize_t i = 0; i < length; i++) {
+        if (data[i] == '\0') {
+            fields.push_back(std::string(data.data() + start, i - start));
+            start = i + 1;
+        }
+    }
+
+    return 1;
+}
+
+#endif
@@ -0,0 +1,502 @@
+#include "watch.h"
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <climits>
+#include <cstring>
+
+#include "cgroup.h"
+
+using namespace v8;
+
+static const char *states[] = {
+    "STOPPED", "STARTING", "RUNNING", "STOPPING",
+    "ABORTING", "FREEZING", "FROZEN", "THAWED"
+};
+
+// Returns our own copy of a state string, so it outlives the container.
+static const char *LookupState(const char *state) {
+    if (state) {
+        for (const char *s : states) {
+            if (strcmp(s, state) == 0) {
+                return s;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+// States a container only passes through, checked more often.
+static bool IsTransitional(const char *state) {
+    return state == states[1] || state == states[3] || state == states[4]
+        || state == states[5];
+}
+
+Watcher::Watcher(AddonData *data, const std::string& path, unsigned int interval,
+        Local<Function> callback)
+        : data_(data), path_(path), interval_(interval), callback_(callback) {
+    uv_mutex_init(&mutex_);
+
+    async_ = new uv_async_t;
+    async_->data = this;
+    uv_async_init(data_->loop, async_, Publish);
+
+    work_.data = this;
+
+    wakeFd_ = eventfd(0, EFD_CLOEXEC);
+
+    uv_thread_create(&thread_, Run, this);
+
+    data_->watchers.insert(this);
+}
+
+Watcher::~Watcher() {
+    uv_close(reinterpret_cast<uv_handle_t*>(async_), [](uv_handle_t *handle) {
+        delete reinterpret_cast<uv_async_t*>(handle);
+    });
+
+    if (wakeFd_ != -1) {
+        close(wakeFd_);
+    }
+
+    uv_mutex_destroy(&mutex_);
+}
+
+void Watcher::Stop() {
+    uv_mutex_lock(&mutex_);
+    closed_ = true;
+    uv_mutex_unlock(&mutex_);
+
+    uint64_t value = 1;
+    ssize_t written;
+
+    do {
+        written = write(wakeFd_, &value, sizeof(value));
+    } while (written == -1 && errno == EINTR);
+}
+
+void Watcher::Destroy() {
+    data_->watchers.erase(this);
+
+    Stop();
+    uv_thread_join(&thread_);
+    delete this;
+}
+
+void Watcher::Close() {
+    Stop();
+
+    // no longer reachable from JS
+    data_->watchers.erase(this);
+
+    // The thread may still be busy querying a container's state, so join it
+    // on the threadpool instead of the event loop.
+    uv_queue_work(data_->loop, &work_, [](uv_work_t *req) {
+        Watcher *watcher = static_cast<Watcher*>(req->data);
+        uv_thread_join(&watcher->thread_);
+    }, [](uv_work_t *req, int) {
+        delete static_cast<Watcher*>(req->data);
+    });
+}
+
+void Watcher::Run(void *arg) {
+    Watcher *watcher = static_cast<Watcher*>(arg);
+    uint64_t interval = watcher->interval_ * static_cast<uint64_t>(1e6);
+    uint64_t next = 0;
+    bool rescan = true;
+
+    const char *path = watcher->path_.empty()
+        ? lxc_get_global_config_item("lxc.lxcpath") : watcher->path_.c_str();
+    watcher->lxcpath_ = path ? path : "";
+
+    watcher->inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (watcher->inotifyFd_ != -1) {
+        watcher->pathWd_ = inotify_add_watch(watcher->inotifyFd_, watcher->lxcpath_.c_str(),
+                IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+
+        // cgroups of containers that are not nested in another cgroup
+        int wd = inotify_add_watch(watcher->inotifyFd_, HostCgroupMount().c_str(),
+                IN_CREATE | IN_DELETE | IN_ONLYDIR);
+
+        if (wd != -1) {
+            watcher->dirWds_.insert(wd);
+        }
+    }
+
+    for (;;) {
+        uv_mutex_lock(&watcher->mutex_);
+        bool closed = watcher->closed_;
+        uv_mutex_unlock(&watcher->mutex_);
+
+        if (closed) {
+            break;
+        }
+
+        if (rescan || uv_hrtime() >= next) {
+            watcher->Rescan();
+            next = uv_hrtime() + interval;
+            rescan = false;
+
+            // without inotify, nothing tells us about state changes
+            if (watcher->inotifyFd_ == -1) {
+                for (auto& pair : watcher->entries_) {
+                    pair.second.check = true;
+                }
+            }
+        }
+
+        bool transitional = false;
+
+        for (auto& pair : watcher->entries_) {
+            Entry& entry = pair.second;
+
+            if (entry.check || IsTransitional(entry.state)) {
+                watcher->Update(pair.first, entry);
+            }
+
+            transitional = transitional || IsTransitional(entry.state);
+        }
+
+        uint64_t now = uv_hrtime();
+        uint64_t timeout = next > now ? (next - now) / 1000000 + 1 : 0;
+
+        if (transitional && timeout > 50) {
+            timeout = 50;
+        }
+
+        pollfd fds[2] = {
+            { watcher->wakeFd_, POLLIN, 0 },
+            { watcher->inotifyFd_, POLLIN, 0 }
+        };
+
+        int ret = poll(fds, 2, std::min<uint64_t>(timeout, INT_MAX));
+
+        if (ret > 0 && (fds[1].revents & POLLIN)) {
+            rescan = watcher->ReadEvents();
+        }
+    }
+
+    for (auto& pair : watcher->entries_) {
+        lxc_container_put(pair.second.container);
+    }
+
+    watcher->entries_.clear();
+    watcher->cgroupWds_.clear();
+    watcher->pendingWds_.clear();
+
+    if (watcher->inotifyFd_ != -1) {
+        close(watcher->inotifyFd_);
+    }
+}
+
+// Compares the entries with the directories in the LXC path. Only new
+// containers are checked, the others are left to their inotify watches.
+void Watcher::Rescan() {
+    DIR *dir = opendir(lxcpath_.c_str());
+
+    if (!dir) {
+        return;
+    }
+
+    std::set<std::string> names;
+    dirent *de;
+
+    while ((de = readdir(dir))) {
+        // also skips the trash of destroyAll()
+        if (de->d_name[0] != '.') {
+            names.insert(de->d_name);
+        }
+    }
+
+    closedir(dir);
+
+    for (const std::string& name : names) {
+        if (!entries_.count(name)) {
+            Discover(name);
+        }
+    }
+
+    for (auto it = entries_.begin(); it != entries_.end(); ) {
+        it = names.count(it->first) ? std::next(it) : Remove(it);
+    }
+}
+
+// Adds or removes the container `name` after its directory changed.
+void Watcher::Discover(const std::string& name) {
+    auto it = entries_.find(name);
+
+    if (it != entries_.end()) {
+        lxc_container *container = it->second.container;
+
+        if (!container->is_defined(container)) {
+            Remove(it);
+        }
+
+        return;
+    }
+
+    lxc_container *container = lxc_container_new(name.c_str(), lxcpath_.c_str());
+
+    if (container && container->is_defined(container)) {
+        for (auto pending = pendingWds_.begin(); pending != pendingWds_.end(); ++pending) {
+            if (pending->second == name) {
+                inotify_rm_watch(inotifyFd_, pending->first);
+                pendingWds_.erase(pending);
+                break;
+            }
+        }
+
+        entries_[name] = Entry{container, nullptr, -1, true};
+        return;
+    }
+
+    if (container) {
+        lxc_container_put(container);
+    }
+
+    // the directory is created before the config is written
+    if (inotifyFd_ != -1) {
+        int wd = inotify_add_watch(inotifyFd_, (lxcpath_ + "/" + name).c_str(),
+                IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ONLYDIR);
+
+        if (wd != -1) {
+            pendingWds_[wd] = name;
+        }
+    }
+}
+
+std::map<std::string, Watcher::Entry>::iterator Watcher::Remove(
+        std::map<std::string, Entry>::iterator it) {
+    Unwatch(it->second);
+    lxc_container_put(it->second.container);
+
+    Push(it->first, nullptr);
+    return entries_.erase(it);
+}
+
+// Returns the container a cgroup created by LXC belongs to, e.g.
+// lxc.payload.foo, lxc.monitor.foo or lxc.payload.foo-1 after a name clash.
+// LXC before 4.0 named the cgroup after the container.
+std::map<std::string, Watcher::Entry>::iterator Watcher::FindCgroupOwner(
+        const std::string& cgroup) {
+    std::string name = cgroup;
+
+    for (const char *prefix : { "lxc.payload.", "lxc.monitor." }) {
+        if (name.compare(0, strlen(prefix), prefix) == 0) {
+            name = name.substr(strlen(prefix));
+            break;
+        }
+    }
+
+    auto it = entries_.find(name);
+    size_t separator = name.rfind('-');
+
+    if (it == entries_.end() && separator != std::string::npos && separator + 1 < name.size()
+            && name.find_first_not_of("0123456789", separator + 1) == std::string::npos) {
+        it = entries_.find(name.substr(0, separator));
+    }
+
+    return it;
+}
+
+// Marks the containers whose files changed for a check. Returns true if
+// events were lost and the LXC path has to be scanned again.
+bool Watcher::ReadEvents() {
+    alignas(inotify_event) char buffer[4096];
+    bool rescan = false;
+    ssize_t length;
+
+    while ((length = read(inotifyFd_, buffer, sizeof(buffer))) > 0) {
+        for (char *p = buffer; p < buffer + length; ) {
+            inotify_event *event = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+
+            std::string name = event->len > 0 ? event->name : "";
+            auto cgroup = cgroupWds_.find(event->wd);
+            auto pending = pendingWds_.find(event->wd);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                rescan = true;
+            } else if (event->wd == pathWd_) {
+                // a container directory was created, removed or renamed
+                if (!name.empty() && name[0] != '.') {
+                    Discover(name);
+                }
+            } else if (pending != pendingWds_.end()) {
+                if (event->mask & IN_IGNORED) {
+                    pendingWds_.erase(pending);
+                } else {
+                    // the config may be written now, Discover() drops the watch then
+                    Discover(std::string(pending->second));
+                }
+            } else if (cgroup != cgroupWds_.end()) {
+                Entry& entry = entries_[cgroup->second];
+                entry.check = true;
+
+                if (event->mask & IN_IGNORED) {
+                    // the cgroup is gone
+                    entry.wd = -1;
+                    cgroupWds_.erase(cgroup);
+                }
+            } else if (dirWds_.count(event->wd) && !name.empty()) {
+                // a cgroup was created or removed, i.e. a container starts
+                auto it = FindCgroupOwner(name);
+
+                if (it != entries_.end() && it->second.wd == -1) {
+                    it->second.check = true;
+                }
+            }
+        }
+    }
+
+    return rescan;
+}
+
+void Watcher::Update(const std::string& name, Entry& entry) {
+    lxc_container *container = entry.container;
+    const char *state = LookupState(container->state(container));
+
+    entry.check = false;
+
+    if (state && state != entry.state) {
+        entry.state = state;
+        Push(name, state);
+    }
+
+    if (!state || state == states[0]) {
+        Unwatch(entry);
+        return;
+    }
+
+    if (entry.wd != -1 || inotifyFd_ == -1) {
+        return;
+    }
+
+    std::string cgroup = CgroupPath(container->init_pid(container));
+
+    if (cgroup.empty()) {
+        return;
+    }
+
+    // populated and frozen in cgroup.events change with the container's state
+    entry.wd = inotify_add_watch(inotifyFd_, (cgroup + "/cgroup.events").c_str(),
+            IN_MODIFY);
+
+    if (entry.wd != -1) {
+        cgroupWds_[entry.wd] = name;
+    }
+
+    // other containers are usually started next to this one
+    int wd = inotify_add_watch(inotifyFd_, cgroup.substr(0, cgroup.rfind('/')).c_str(),
+            IN_CREATE | IN_DELETE | IN_ONLYDIR);
+
+    if (wd != -1) {
+        dirWds_.insert(wd);
+    }
+}
+
+void Watcher::Unwatch(Entry& entry) {
+    if (entry.wd != -1) {
+        inotify_rm_watch(inotifyFd_, entry.wd);
+        cgroupWds_.erase(entry.wd);
+        entry.wd = -1;
+    }
+}
+
+void Watcher::Push(const std::string& name, const char *state) {
+    uv_mutex_lock(&mutex_);
+    events_.push_back(std::make_pair(name, state));
+    uv_mutex_unlock(&mutex_);
+
+    uv_async_send(async_);
+}
+
+void Watcher::Publish(uv_async_t *handle) {
+    Nan::HandleScope scope;
+
+    Watcher *watcher = static_cast<Watcher*>(handle->data);
+    std::vector<std::pair<std::string, const char*>> events;
+
+    uv_mutex_lock(&watcher->mutex_);
+    events.swap(watcher->events_);
+    bool closed = watcher->closed_;
+    uv_mutex_unlock(&watcher->mutex_);
+
+    if (closed) {
+        return;
+    }
+
+    for (auto& event : events) {
+        const int argc = 2;
+        Local<Value> argv[argc] = {
+            Nan::New(event.first).ToLocalChecked(),
+            event.second ? Nan::New(event.second).ToLocalChecked().As<Value>()
+                : Nan::Null().As<Value>()
+        };
+
+        watcher->callback_.Call(argc, argv);
+    }
+}
+
+// Javascript Functions
+
+NAN_METHOD(Watch) {
+    if (!info[0]->IsString() || !info[1]->IsUint32() || !info[2]->IsFunction()) {
+        return Nan::ThrowTypeError("Invalid argument");
+    }
+
+    AddonData *data = GetAddonData(info);
+    Watcher *watcher = new Watcher(data, *String::Utf8Value(info[0]),
+            info[1]->Uint32Value(), info[2].As<Function>());
+
+    Local<Object> wrap = Nan::New(data->watcherConstructor)->NewInstance();
+    Nan::SetInternalFieldPointer(wrap, 0, watcher);
+
+    info.GetReturnValue().Set(wrap);
+}
+
+NAN_METHOD(WatcherClose) {
+    Watcher *watcher = static_cast<Watcher*>(
+            Nan::GetInternalFieldPointer(info.Holder(), 0));
+
+    if (watcher) {
+        Nan::SetInternalFieldPointer(info.Holder(), 0, nullptr);
+        watcher->Close();
+    }
+}
+
+// Initialization
+
+void WatchInit(Handle<Object> exports, AddonData *data) {
+    Nan::HandleScope scope;
+
+    Local<FunctionTemplate> constructorTemplate = Nan::New<FunctionTemplate>();
+
+    constructorTemplate->SetClassName(Nan::New("Watcher").ToLocalChecked());
+    constructorTemplate->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetPrototypeMethod(constructorTemplate, "close", WatcherClose);
+
+    data->watcherConstructor.Reset(constructorTemplate->GetFunction());
+
+    // Exports
+    exports->Set(Nan::New("watch").ToLocalChecked(),
+            Nan::New<FunctionTemplate>(Watch, data->External())->GetFunction());
+}
+
+void WatchCleanup(AddonData *data) {
+    while (!data->watchers.empty()) {
+        (*data->watchers.begin())->Destroy();
+    }
+
+    data->watcherConstructor.Reset();
+}
@@ -0,0 +1,98 @@
+#ifndef SOURCEBOX_WATCH_H
+#define SOURCEBOX_WATCH_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <node.h>
+#include <nan.h>
+#include <lxc/lxccontainer.h>
+
+#include "addon.h"
+
+/**
+ * Reports state changes of all containers under a path. A single thread per
+ * watcher polls an inotify fd, nothing is polled per container:
+ *
+ * - the LXC path for created and destroyed containers
+ * - the cgroup directories for cgroups LXC creates when a container starts
+ * - the `cgroup.events` of running containers for stops and freezes
+ *
+ * A container's state is only queried when one of its files changed, and
+ * every 50 ms while it is in a transitional state such as STARTING. The LXC
+ * path is scanned again if inotify lost events, and as a safety net every
+ * `interval` milliseconds.
+ */
+class Watcher {
+public:
+    Watcher(AddonData *data, const std::string& path, unsigned int interval,
+            v8::Local<v8::Function> callback);
+
+    // Stops the thread and deletes the watcher once it is joined.
+    void Close();
+
+    // Same as Close(), but joins the thread right away.
+    void Destroy();
+
+private:
+    struct Entry {
+        lxc_container *container;
+        const char *state;
+
+        // inotify watch of the cgroup.events file while running
+        int wd;
+        bool check;
+    };
+
+    ~Watcher();
+
+    static void Run(void *arg);
+    static void Publish(uv_async_t *handle);
+
+    void Rescan();
+    void Discover(const std::string& name);
+    std::map<std::string, Entry>::iterator Remove(std::map<std::string, Entry>::iterator it);
+    std::map<std::string, Entry>::iterator FindCgroupOwner(const std::string& cgroup);
+    bool ReadEvents();
+    void Update(const std::string& name, Entry& entry);
+    void Unwatch(Entry& entry);
+    void Push(const std::string& name, const char *state);
+    void Stop();
+
+    AddonData *data_;
+    std::string path_;
+    unsigned int interval_;
+
+    uv_thread_t thread_;
+    uv_mutex_t mutex_;
+    uv_async_t *async_;
+    uv_work_t work_;
+
+    // wakes up the thread when the watcher is closed
+    int wakeFd_;
+
+    bool closed_ = false;
+
+    // only accessed by the watcher thread
+    std::string lxcpath_;
+    int inotifyFd_ = -1;
+    int pathWd_ = -1;
+    std::set<int> dirWds_;
+    std::map<int, std::string> cgroupWds_;
+
+    // directories of containers whose config was not written yet
+    std::map<int, std::string> pendingWds_;
+    std::map<std::string, Entry> entries_;
+
+    // pending events, a null state signals a removed container
+    std::vector<std::pair<std::string, const char*>> events_;
+
+    Nan::Callback callback_;
+};
+
+void WatchInit(v8::Handle<v8::Object> exports, AddonData *data);
+void WatchCleanup(AddonData *data);
+
+#endif